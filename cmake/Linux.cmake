@@ -9,6 +9,14 @@ target_sources(soem PRIVATE
   oshw/linux/oshw.h
   oshw/linux/nicdrv.c
   oshw/linux/nicdrv.h
+  oshw/linux/nicdrv_xdp.c
+  oshw/linux/nicdrv_xdp.h
+  oshw/linux/nicdrv_sim.c
+  oshw/linux/nicdrv_sim.h
+  oshw/linux/nicdrv_pcap.c
+  oshw/linux/nicdrv_pcap.h
+  oshw/linux/nicdrv_replay.c
+  oshw/linux/nicdrv_replay.h
 )
 
 target_include_directories(soem PUBLIC
@@ -24,6 +32,8 @@ foreach(target IN ITEMS
     eni_test
     eoe_test
     firm_update
+    rtt_test
+    sim_bench
     simple_ng
     slaveinfo)
   if (TARGET ${target})
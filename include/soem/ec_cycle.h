@@ -0,0 +1,125 @@
+/*
+ * This software is dual-licensed under GPLv3 and a commercial
+ * license. See the file LICENSE.md distributed with this software for
+ * full license information.
+ */
+
+/** \file
+ * \brief
+ * Headerfile for ec_cycle.c
+ */
+
+#ifndef _EC_CYCLE_H
+#define _EC_CYCLE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** number of histogram bins of cycle statistics */
+#define EC_CYCLEBINS     64
+/** default width of a histogram bin in ns */
+#define EC_CYCLEBINWIDTH 1000
+/** stack size of cycle thread */
+#define EC_CYCLESTACK    128000
+
+/** phase of a cycle in which the hook is called */
+typedef enum
+{
+   /** after the wakeup, before the outputs are sent */
+   EC_CYCLE_OUTPUTS,
+   /** after the inputs are received */
+   EC_CYCLE_INPUTS,
+   /** at the end of the cycle, after the mailbox handler */
+   EC_CYCLE_END
+} ec_cyclephaset;
+
+/** statistics of one time measured every cycle, all times in ns */
+typedef struct
+{
+   /** number of values */
+   uint64 count;
+   /** smallest value */
+   int64 min;
+   /** largest value */
+   int64 max;
+   /** sum of all values */
+   int64 sum;
+   /** histogram, bin n counts the values from n * binwidth up to
+    * (n + 1) * binwidth. Negative values are in the first bin, values
+    * beyond the last bin in the last one. */
+   uint32 bin[EC_CYCLEBINS];
+} ec_cyclestatt;
+
+typedef struct ec_cycle ec_cyclet;
+
+/** hook called by the cycle thread in each phase of a cycle */
+typedef void (*ec_cyclehookt)(ec_cyclet *cycle, ec_cyclephaset phase);
+
+/** Realtime cycle engine, runs the processdata exchange of a group in its
+ * own thread, see ecx_cycle_start(). Set up with ecx_cycle_init(), the
+ * configuration can be changed before the start. */
+struct ec_cycle
+{
+   /** context the cycle runs on */
+   ecx_contextt *context;
+   /** group to exchange */
+   uint8 group;
+   /** cycle time in ns */
+   int64 cycletime;
+   /** CPU to pin the cycle thread to, -1 for none */
+   int cpu;
+   /** time in ns to busy wait before each wakeup instead of sleeping,
+    * 0 to only sleep */
+   int64 spintime;
+   /** update the DC sync controller every cycle */
+   boolean dcsync;
+   /** DC sync controller, in master shift mode the wakeups follow the
+    * reference clock. Set up again with ecx_dcsync_init() for another
+    * mode, cycle time or syncoffset. */
+   ec_dcsynct sync;
+   /** limit of the mailbox handler per cycle, 0 for no mailbox handling */
+   int mbxlimit;
+   /** receive timeout in us */
+   int timeout;
+   /** width of a histogram bin in ns */
+   int64 binwidth;
+   /** hook called in each phase, NULL if none */
+   ec_cyclehookt hook;
+   /** user data of the hook */
+   void *userdata;
+
+   /** number of cycles run */
+   uint64 cycles;
+   /** number of wakeups skipped because the cycle ran too long */
+   uint64 overruns;
+   /** work counter of the last cycle */
+   int wkc;
+   /** wakeup latency, from deadline to wakeup */
+   ec_cyclestatt latency;
+   /** exchange time, from send to receive of the processdata */
+   ec_cyclestatt exchange;
+   /** overrun, from deadline to the end of a cycle that ran too long */
+   ec_cyclestatt overrun;
+
+   /** @privatesection */
+   /** cycle thread */
+   OSAL_THREAD_HANDLE thread;
+   /** thread keeps running while set */
+   volatile boolean running;
+   /** set while thread runs */
+   volatile boolean active;
+   /** statistics are cleared by the thread when set */
+   volatile boolean clearstats;
+};
+
+void ecx_cycle_init(ec_cyclet *cycle, ecx_contextt *context, uint8 group, int64 cycletime);
+int ecx_cycle_start(ec_cyclet *cycle);
+void ecx_cycle_stop(ec_cyclet *cycle);
+void ecx_cycle_clearstats(ec_cyclet *cycle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _EC_CYCLE_H */
@@ -16,9 +16,69 @@
 extern "C" {
 #endif
 
+/** mode of DC sync controller */
+typedef enum
+{
+   /** the master shifts its cycle to follow the reference clock */
+   EC_DCSYNC_MASTERSHIFT,
+   /** the reference clock is written to follow the master clock */
+   EC_DCSYNC_BUSSHIFT
+} ec_dcsyncmodet;
+
+/** DC sync controller, set up with ecx_dcsync_init() and updated once per
+ * cycle with ecx_dcsync(). All times in ns. */
+typedef struct
+{
+   /** mode */
+   ec_dcsyncmodet mode;
+   /** cycle time */
+   int64 cycletime;
+   /** master shift: DC time in the cycle at which the processdata passes
+    * the reference clock */
+   int64 syncoffset;
+
+   /** master shift: difference of the DC time to syncoffset, bus shift:
+    * difference of the reference clock to the written master time, of the
+    * last update */
+   int64 offset;
+   /** largest absolute offset since the start */
+   int64 maxoffset;
+   /** drift of the reference clock to the master clock in ppb, measured
+    * over windows of a second and filtered */
+   int64 drift;
+   /** master shift: correction of the cycle time of the last update */
+   int64 correction;
+   /** number of updates with a new DC time */
+   uint64 updates;
+
+   /** @privatesection */
+   /** integral of offset */
+   int64 integral;
+   /** bus shift: reference clock minus master clock at the start */
+   int64 base;
+   /** DC time of the last update */
+   int64 lastdctime;
+   /** DC time at the start of the drift window */
+   int64 windowdctime;
+   /** master time at the start of the drift window */
+   int64 windownow;
+   /** number of drift windows */
+   uint32 windows;
+   /** master time of the last update */
+   int64 lastnow;
+   /** master time written to the reference clock in the last update */
+   int64 lastwrite;
+} ec_dcsynct;
+
 boolean ecx_configdc(ecx_contextt *context);
 void ecx_dcsync0(ecx_contextt *context, uint16 slave, boolean act, uint32 CyclTime, int32 CyclShift);
 void ecx_dcsync01(ecx_contextt *context, uint16 slave, boolean act, uint32 CyclTime0, uint32 CyclTime1, int32 CyclShift);
+int ecx_dcsync0_multi(ecx_contextt *context, int n, const uint16 *slave, boolean act, uint32 CyclTime, int32 CyclShift);
+int ecx_dcsync01_multi(ecx_contextt *context, int n, const uint16 *slave, boolean act, uint32 CyclTime0, uint32 CyclTime1, int32 CyclShift);
+int ecx_dcstaticdrift(ecx_contextt *context, int32 threshold, int maxframes);
+int ecx_dcsync_init(ecx_contextt *context, ec_dcsynct *sync, ec_dcsyncmodet mode, int64 cycletime, int64 syncoffset);
+int64 ecx_dcsync(ecx_contextt *context, ec_dcsynct *sync, const ec_timet *now);
+void ecx_dcsync_close(ecx_contextt *context, ec_dcsynct *sync);
 
 #ifdef __cplusplus
 }
@@ -79,6 +79,7 @@ typedef struct
 #define EC_MBXQUEUESTATE_REQ  1
 #define EC_MBXQUEUESTATE_FAIL 2
 #define EC_MBXQUEUESTATE_DONE 3
+#define EC_MBXQUEUESTATE_SEND 4
 
 typedef struct
 {
@@ -253,6 +254,9 @@ typedef struct ec_slave
    int mbxrmpstate;
    /** mailbox handler RMP extended mbx in state */
    uint16 mbxinstateex;
+   /** mailbox handler, processdata cycle of the group the out mailbox was
+    * last read with in mailbox piggyback mode */
+   uint32 mbxreadcycle;
    /** pointer to CoE mailbox in buffer */
    uint8 *coembxin;
    /** CoE mailbox in flag, true = mailbox full */
@@ -295,6 +299,139 @@ typedef struct ec_slave
    char name[EC_MAXNAME + 1];
 } ec_slavet;
 
+/** stack structure to store segmented LRD/LWR/LRW constructs, one entry
+ * per datagram, several datagrams can share one frame. Entries are pulled
+ * in the order they are pushed, in pipelined mode the stack holds the
+ * datagrams of more than one cycle. */
+typedef struct ec_idxstack
+{
+   /** position of next entry to push */
+   uint8 pushed;
+   /** position of next entry to pull */
+   uint8 pulled;
+   /** number of entries on stack */
+   uint8 stacked;
+   /** TRUE if an entry was not pushed because the stack was full, the
+    * send call fails then */
+   boolean overflow;
+   /** frame index */
+   uint8 idx[EC_MAXBUF];
+   /** process data of datagram */
+   void *data[EC_MAXBUF];
+   /** length of datagram data */
+   uint16 length[EC_MAXBUF];
+   /** offset of datagram data in rx frame */
+   uint16 offset[EC_MAXBUF];
+   /** datagram command */
+   uint8 type[EC_MAXBUF];
+   /** number of leading output bytes not copied back to process data */
+   uint16 skip[EC_MAXBUF];
+   /** TRUE if last datagram of a cycle */
+   boolean cycleend[EC_MAXBUF];
+   /** TRUE if datagram is already collected */
+   boolean done[EC_MAXBUF];
+   /** group of datagram */
+   uint8 group[EC_MAXBUF];
+   /** processdata cycle of the group the datagram is sent with */
+   uint32 cycle[EC_MAXBUF];
+   /** number of frames of the oldest cycle collected so far */
+   uint8 collected;
+   /** work counter of the oldest cycle collected so far */
+   int wkc;
+   /** TRUE if wkc holds a work counter */
+   boolean validwkc;
+   /** work counter of each group of the oldest cycle collected so far */
+   int groupwkc[EC_MAXGROUP];
+   /** TRUE if groupwkc of a group holds a work counter */
+   boolean groupvalidwkc[EC_MAXGROUP];
+   /** NIC timestamp of first frame of the oldest cycle sent */
+   ec_timet txtime;
+   /** NIC timestamp of last frame of the oldest cycle received so far */
+   ec_timet rxtime;
+} ec_idxstackT;
+
+/** frame template of cyclic processdata. The frames of the first cycle are
+ * kept with their indexes, later cycles only copy the outputs and clear
+ * the WKC before they are sent again. */
+typedef struct ec_pdtemplate
+{
+   /** TRUE if the frames can be sent again */
+   boolean valid;
+   /** groups the frames are built for, bit n set is group n */
+   uint32 groupmask;
+   /** groups of the last cycle sent */
+   uint32 lastmask;
+   /** number of frames */
+   uint8 frames;
+   /** frame indexes */
+   uint8 idx[EC_MAXBUF];
+   /** number of datagrams */
+   uint8 datagrams;
+   /** frame index of datagram */
+   uint8 dgidx[EC_MAXBUF];
+   /** offset of datagram data in tx frame */
+   uint16 dgoffset[EC_MAXBUF];
+   /** length of datagram data */
+   uint16 dglength[EC_MAXBUF];
+   /** outputs copied to datagram data, NULL if none */
+   const void *dgdata[EC_MAXBUF];
+   /** index stack entries pushed for each cycle */
+   ec_idxstackT stack;
+} ec_pdtemplateT;
+
+/** max. number of mailbox datagrams of a group pending in mailbox piggyback
+ * mode */
+#define EC_MAXMBXDG 4
+
+#define EC_MBXDG_FREE   0
+#define EC_MBXDG_QUEUED 1
+#define EC_MBXDG_SENT   2
+
+/** mailbox datagram carried by the processdata frames in mailbox piggyback
+ * mode, see ecx_contextt.mbxpiggybackMode */
+typedef struct ec_mbxdg
+{
+   /** EC_MBXDG_QUEUED until sent with the processdata, EC_MBXDG_SENT
+    * until received, EC_MBXDG_FREE after */
+   uint8 state;
+   /** EC_CMD_FPRD reads the out mailbox of the slave, EC_CMD_FPWR writes
+    * the in mailbox */
+   uint8 com;
+   /** slave number */
+   uint16 slave;
+   /** mailbox buffer, NULL if the write was dropped from the queue */
+   ec_mbxbuft *mbx;
+} ec_mbxdgT;
+
+/** max. number of register subscriptions of a group */
+#define EC_MAXREGSUB 16
+
+/** register read with the processdata of a group, see ecx_regsubscribe() */
+typedef struct ec_regsub
+{
+   /** slave number, 0 to read all slaves with BRD */
+   uint16 slave;
+   /** register address */
+   uint16 ADO;
+   /** register length in bytes */
+   uint16 length;
+   /** read every divider processdata cycles of the group */
+   uint16 divider;
+   /** buffer the register is copied to */
+   void *data;
+   /** work counter of the last read, with BRD the number of slaves read,
+    * EC_NOFRAME if the frame was lost */
+   int wkc;
+   /** number of reads copied to data */
+   uint32 updates;
+   /** internal, TRUE if subscribed */
+   boolean active;
+   /** internal, cycles until the next read */
+   uint16 next;
+   /** internal, TRUE if read in the cycle being built */
+   boolean due;
+} ec_regsubT;
+
 /** for list of ethercat slave groups */
 typedef struct ec_group
 {
@@ -340,6 +477,40 @@ typedef struct ec_group
    uint16 lastmbxpos;
    /** mailbox  transmit queue struct */
    ec_mbxqueuet mbxtxqueue;
+   /** frames holding the processdata in zero copy mode, 0 if in IOmap */
+   uint16 zcframes;
+   /** frame index of each IO segment in zero copy mode */
+   uint8 zcidx[EC_MAXIOSEGMENTS];
+   /** scheduler cycle divider, the group is sent every divider ticks of
+    * ecx_send_processdata_tick(), 0 if not scheduled */
+   uint16 divider;
+   /** scheduler phase, the group is sent in the ticks where
+    * tick % divider == phase */
+   uint16 phase;
+   /** work counter of the group in the last cycle received, EC_NOFRAME if
+    * no frame arrived */
+   int lastwkc;
+   /** last DC time from slaves received with the processdata of the group */
+   int64 DCtime;
+   /** NIC timestamp of first processdata frame sent of the last cycle of
+    * the group received, zero if not available */
+   ec_timet pdtxtime;
+   /** NIC timestamp of last processdata frame received of the last cycle of
+    * the group received, zero if not available */
+   ec_timet pdrxtime;
+   /** register subscriptions, see ecx_regsubscribe() */
+   ec_regsubT regsub[EC_MAXREGSUB];
+   /** internal, mailbox datagrams sent with the processdata */
+   ec_mbxdgT mbxdg[EC_MAXMBXDG];
+   /** internal, number of processdata cycles sent */
+   uint32 pdcycle;
+   /** internal, processdata cycle the mailbox status was last received
+    * with */
+   uint32 mbxstatuscycle;
+   /** internal, processdata stack buffer info */
+   ec_idxstackT idxstack;
+   /** internal, frame template of cyclic processdata */
+   ec_pdtemplateT pdtemplate;
 } ec_groupt;
 
 #define ECT_ESMTRANS_IP 0x0001
@@ -453,18 +624,6 @@ typedef struct OSAL_PACKED ec_alstatus
 } ec_alstatust;
 OSAL_PACKED_END
 
-/** stack structure to store segmented LRD/LWR/LRW constructs */
-typedef struct ec_idxstack
-{
-   uint8 pushed;
-   uint8 pulled;
-   uint8 idx[EC_MAXBUF];
-   void *data[EC_MAXBUF];
-   uint16 length[EC_MAXBUF];
-   uint16 dcoffset[EC_MAXBUF];
-   uint8 type[EC_MAXBUF];
-} ec_idxstackT;
-
 /** ringbuf for error storage */
 typedef struct ec_ering
 {
@@ -519,8 +678,19 @@ struct ecx_context
    ec_groupt grouplist[EC_MAXGROUP];
    /** ecaterror state */
    boolean ecaterror;
-   /** last DC time from slaves */
+   /** last DC time from slaves. With groups exchanged from different
+    * threads use ec_groupt.DCtime of the group instead */
    int64 DCtime;
+   /** NIC timestamp of first processdata frame sent of the last cycle
+    * received, zero if not available. With groups exchanged from different
+    * threads use ec_groupt.pdtxtime of the group instead */
+   ec_timet pdtxtime;
+   /** NIC timestamp of last processdata frame received of the last cycle
+    * received, zero if not available. With groups exchanged from different
+    * threads use ec_groupt.pdrxtime of the group instead */
+   ec_timet pdrxtime;
+   /** scheduler tick, counted by ecx_send_processdata_tick() */
+   uint32 schedtick;
 
    /** @privatesection */
    /* Internal state */
@@ -533,8 +703,18 @@ struct ecx_context
    uint16 esislave;
    /** internal, error list */
    ec_eringt elist;
-   /** internal, processdata stack buffer info */
-   ec_idxstackT idxstack;
+   /** internal, TRUE if frame index is reserved for processdata */
+   boolean pdreserved[EC_MAXBUF];
+   /** internal, lock of pdreserved, frame templates of groups are kept and
+    * released by the threads exchanging them */
+   osal_mutext *pdmutex;
+   /** internal, groups sent in the last scheduler tick */
+   uint32 schedmask;
+   /** internal, TRUE if DCsettime is written to the reference clock with
+    * the processdata, see ecx_dcsync_init() */
+   boolean DCbusshift;
+   /** internal, system time written to the reference clock, little endian */
+   uint32 DCsettime;
    /** internal, SM buffer */
    ec_SMcommtypet SMcommtype[EC_MAX_MAPT];
    /** internal, PDO assign list */
@@ -568,6 +748,25 @@ struct ecx_context
    /** Do not map each slave on a byte boundary. May result in smaller
     * frame sizes. Has no effect in overlapped mode. */
    boolean packedMode;
+   /** In pipelined mode the frames of the next cycle can be transmitted
+    * before the frames of the current cycle are received. Each call to
+    * ecx_receive_processdata_group() collects the frames of the oldest
+    * transmitted cycle only. Returning frames do not overwrite outputs.
+    * Two cycles share the index stack, a cycle needing more than
+    * EC_MAXBUF / 2 datagrams is refused by the send call. */
+   boolean pipelinedMode;
+   /** In zero copy mode ecx_config_map_group() places the processdata of
+    * LRW groups in the frame buffers instead of the IOmap. Slave outputs
+    * point into the tx frames, inputs and mailbox status into the rx
+    * frames, nothing is copied per cycle. Group and slave 0 pointers only
+    * cover the first frame. Not for overlapped or pipelined mode. */
+   boolean zerocopyMode;
+   /** In mailbox piggyback mode the cyclic mailbox handler does not read
+    * and write the mailboxes itself. Its datagrams are queued and sent in
+    * the frames of the next processdata of the group, and completed when
+    * the processdata is received. Run the mailbox handler in the thread
+    * that sends and receives the processdata. */
+   boolean mbxpiggybackMode;
 };
 
 ec_adaptert *ec_find_adapters(void);
@@ -608,9 +807,19 @@ int ecx_writeeepromFP(ecx_contextt *context, uint16 configadr, uint16 eeproma, u
 void ecx_readeeprom1(ecx_contextt *context, uint16 slave, uint16 eeproma);
 uint32 ecx_readeeprom2(ecx_contextt *context, uint16 slave, int timeout);
 int ecx_receive_processdata_group(ecx_contextt *context, uint8 group, int timeout);
+int ecx_poll_processdata_group(ecx_contextt *context, uint8 group, int *wkc);
 int ecx_send_processdata(ecx_contextt *context);
 int ecx_receive_processdata(ecx_contextt *context, int timeout);
+int ecx_poll_processdata(ecx_contextt *context, int *wkc);
 int ecx_send_processdata_group(ecx_contextt *context, uint8 group);
+int ecx_send_processdata_groups(ecx_contextt *context, uint32 groupmask);
+uint32 ecx_duegroups(ecx_contextt *context, uint32 tick);
+int ecx_send_processdata_tick(ecx_contextt *context);
+int ecx_receive_processdata_tick(ecx_contextt *context, int timeout);
+void ecx_clearpdtemplate(ecx_contextt *context);
+void ecx_releasembxdg(ecx_contextt *context, uint8 group);
+int ecx_regsubscribe(ecx_contextt *context, uint8 group, uint16 slave, uint16 ADO, uint16 length, uint16 divider, void *data);
+int ecx_regunsubscribe(ecx_contextt *context, uint8 group, int sub);
 ec_mbxbuft *ecx_getmbx(ecx_contextt *context);
 int ecx_dropmbx(ecx_contextt *context, ec_mbxbuft *mbx);
 int ecx_initmbxpool(ecx_contextt *context);
@@ -52,6 +52,8 @@ extern "C" {
 #define EC_MAXECATFRAME       1518
 /** size of DC datagram used in first LRW frame */
 #define EC_FIRSTDCDATAGRAM    20
+/** size of system time write in front of the DC datagram in bus shift mode */
+#define EC_BUSSHIFTDATAGRAM   16
 /** datagram type EtherCAT */
 #define EC_ECATTYPE           0x1000
 /** maximum EtherCAT LRW frame length in bytes */
@@ -23,6 +23,7 @@
 #include "soem/ec_soe.h"
 #include "soem/ec_eoe.h"
 #include "soem/ec_config.h"
+#include "soem/ec_cycle.h"
 #include "soem/ec_print.h"
 
 #endif /* _SOEM_H */
@@ -3,9 +3,12 @@
  * license. See the file LICENSE.md distributed with this software for
  * full license information.
  */
+#define _GNU_SOURCE
+
 #include <osal.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sched.h>
 
 /* Returns time from some unspecified moment in past,
  * strictly increasing, used for time intervals measurement. */
@@ -123,6 +126,24 @@ int osal_thread_create_rt(void *thandle, int stacksize, void *func, void *param)
    return 1;
 }
 
+int osal_thread_setaffinity(int cpu)
+{
+   cpu_set_t cpuset;
+
+   if ((cpu < 0) || (cpu >= CPU_SETSIZE))
+   {
+      return -1;
+   }
+   CPU_ZERO(&cpuset);
+   CPU_SET(cpu, &cpuset);
+   if (pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset))
+   {
+      return -1;
+   }
+
+   return 0;
+}
+
 void *osal_mutex_create(void)
 {
    pthread_mutexattr_t mutexattr;
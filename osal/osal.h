@@ -143,6 +143,14 @@ int osal_thread_create(void *thandle, int stacksize, void *func, void *param);
  */
 int osal_thread_create_rt(void *thandle, int stacksize, void *func, void *param);
 
+/**
+ * @brief Pins the calling thread to one CPU.
+ *
+ * @param cpu Number of the CPU, starting at 0.
+ * @return 0 on success, -1 on failure or if not supported.
+ */
+int osal_thread_setaffinity(int cpu);
+
 /**
  * @brief Creates a mutex.
  *
@@ -187,6 +195,11 @@ void osal_mutex_unlock(void *mutex);
         : ((a)->tv_sec CMP(b)->tv_sec))
 #endif
 
+#ifndef osal_timespecisset
+#define osal_timespecisset(a) \
+   (((a)->tv_sec != 0) || ((a)->tv_nsec != 0))
+#endif
+
 #ifndef osal_timespecadd
 #define osal_timespecadd(a, b, result)                 \
    do                                                  \
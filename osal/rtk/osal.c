@@ -88,6 +88,12 @@ int osal_thread_create_rt(void *thandle, int stacksize, void *func, void *param)
    return 1;
 }
 
+int osal_thread_setaffinity(int cpu)
+{
+   /* single core, nothing to pin */
+   return (cpu == 0) ? 0 : -1;
+}
+
 void *osal_mutex_create(void)
 {
    return (void *)mtx_create();
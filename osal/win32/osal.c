@@ -151,6 +151,15 @@ int osal_thread_create_rt(void *thandle, int stacksize, void *func, void *param)
    return ret;
 }
 
+int osal_thread_setaffinity(int cpu)
+{
+   if ((cpu < 0) || (cpu >= (int)(sizeof(DWORD_PTR) * 8)))
+   {
+      return -1;
+   }
+   return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) ? 0 : -1;
+}
+
 void *osal_mutex_create(void)
 {
    return CreateMutex(NULL, FALSE, NULL);
@@ -29,6 +29,43 @@
  * packets. The software layer will detect the possible failure modes and
  * compensate. If needed the packets from interface A are resent through interface B.
  * This layer if fully transparent for the higher layers.
+ *
+ * Frames are moved to and from the wire by a NIC backend (ecx_nicopst)
+ * selected per port at setup. The default raw socket backend is called
+ * directly, other backends through the ops table.
+ *
+ * In ECT_NIC_MMAP mode the socket gets PACKET_MMAP rx and tx rings shared
+ * with the kernel. Received frames are taken from the rx ring without a
+ * system call and copied once, directly into their indexed buffer. Frames to
+ * send are placed in the tx ring and handed to the NIC driver bypassing the
+ * queueing discipline. They are still built in txbuf[idx] and copied into
+ * the ring slot: a slot is handed back to the kernel and reused by later
+ * frames, while txbuf[idx] must stay valid as long as its index is in use,
+ * for redundancy resends, frame templates and zero copy processdata. The
+ * kernel only walks the tx ring on send(), so each call to ecx_outframe()
+ * costs one system call. ecx_outframes_red() puts a whole list of frames
+ * in the ring first and kicks it with a single send().
+ *
+ * In ECT_NIC_XDP mode frames are exchanged through an AF_XDP socket, see
+ * nicdrv_xdp.c. The raw socket is then only used to set up the interface.
+ *
+ * The "sim" backend replaces NIC and slaves by a simulated segment, see
+ * nicdrv_sim.c. The interface name then describes the segment. The "replay"
+ * backend answers frames from a recorded trace, see nicdrv_replay.c. The
+ * interface name then is the pcap or pcapng file.
+ *
+ * ecx_capture_start() records all frames sent and received on the port in a
+ * pcapng file, see nicdrv_pcap.c.
+ *
+ * How the blocking receive functions wait for frames is selected per port
+ * with ecx_setwaitmode(). Blocking waits are done in short slices, another
+ * thread might read the frame we are waiting for from the socket.
+ *
+ * With ecx_portt.timestamping set the socket reports when each frame left
+ * and arrived at the NIC (SO_TIMESTAMPING). Hardware timestamps are used if
+ * the NIC supports them, they are in the time base of the NIC clock. Software
+ * timestamps are CLOCK_REALTIME. Timestamps are not available in ECT_NIC_XDP
+ * mode.
  */
 
 #define _GNU_SOURCE
@@ -42,13 +79,25 @@
 #include <time.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <string.h>
-#include <netpacket/packet.h>
+#include <linux/if_packet.h>
+#include <sys/mman.h>
 #include <pthread.h>
 #include <poll.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <linux/time_types.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+#include <linux/sockios.h>
 
 #include "oshw.h"
 #include "osal.h"
+#include "nicdrv_xdp.h"
+#include "nicdrv_sim.h"
+#include "nicdrv_pcap.h"
+#include "nicdrv_replay.h"
 
 /** Redundancy modes */
 enum
@@ -74,6 +123,52 @@ const uint16 secMAC[3] = EC_SECONDARY_MAC_ARRAY;
 /** second MAC word is used for identification */
 #define RX_SEC  secMAC[1]
 
+/** default blocking wait slice in us */
+#define EC_WAITSLICE   50
+/** default spin time in us before blocking in ECT_WAIT_ADAPTIVE mode */
+#define EC_WAITSPIN    50
+
+/** number of frames in each of the rx and tx rings */
+#define EC_RINGFRAMES  (4 * EC_MAXBUF)
+/** smallest ring frame size, a power of two */
+#define EC_RINGMINSIZE 2048
+/** control message buffer size per received frame */
+#define EC_CMSGSIZE    256
+
+/** Read rx buffer status. Buffer contents written before the status was set
+ * are visible after this call.
+ * @param[in] bufstat  = status field
+ * @return status
+ */
+static inline int ecx_getbufstat(int *bufstat)
+{
+   return __atomic_load_n(bufstat, __ATOMIC_ACQUIRE);
+}
+
+/** Set rx buffer status. Buffer contents written before this call are
+ * visible to whoever reads the new status.
+ * @param[in] bufstat  = status field
+ * @param[in] state    = status to set
+ */
+static inline void ecx_putbufstat(int *bufstat, int state)
+{
+   __atomic_store_n(bufstat, state, __ATOMIC_RELEASE);
+}
+
+/** Mark rx buffer as waiting for its frame and note the send order. The
+ * timestamps of the index are cleared, frame templates and zero copy
+ * frames are sent again with the same index without ecx_getindex().
+ * @param[in] stack    = stack the frame is sent on
+ * @param[in] idx      = index of frame
+ */
+static inline void ecx_marktx(ec_stackT *stack, uint8 idx)
+{
+   memset(&((*stack->txtime)[idx]), 0, sizeof(ec_timet));
+   memset(&((*stack->rxtime)[idx]), 0, sizeof(ec_timet));
+   stack->txseq[idx] = __atomic_fetch_add(&(stack->txcnt), 1, __ATOMIC_RELAXED);
+   ecx_putbufstat(&(*stack->rxbufstat)[idx], EC_BUF_TX);
+}
+
 static void ecx_clear_rxbufstat(int *rxbufstat)
 {
    int i;
@@ -83,7 +178,327 @@ static void ecx_clear_rxbufstat(int *rxbufstat)
    }
 }
 
-/** Basic setup to connect NIC to socket.
+/** Setup PACKET_MMAP rx and tx rings on socket.
+ * Frame size and block size are powers of two so frame n of a ring is
+ * always located at n * framesize.
+ * @param[in]  sock     = socket handle
+ * @param[out] ring     = ring state
+ * @return 0 if succeeded
+ */
+static int ecx_setupring(int sock, ec_ringT *ring)
+{
+   struct tpacket_req req;
+   size_t framesize, blocksize, ringsize;
+   int i, r;
+
+   memset(ring, 0, sizeof(*ring));
+   framesize = EC_RINGMINSIZE;
+   while (framesize < (TPACKET_ALIGN(TPACKET2_HDRLEN) + 16 + EC_BUFSIZE))
+   {
+      framesize <<= 1;
+   }
+   blocksize = (size_t)getpagesize();
+   if (blocksize < framesize)
+   {
+      blocksize = framesize;
+   }
+   memset(&req, 0, sizeof(req));
+   req.tp_frame_size = framesize;
+   req.tp_block_size = blocksize;
+   req.tp_block_nr = (EC_RINGFRAMES * framesize + blocksize - 1) / blocksize;
+   req.tp_frame_nr = req.tp_block_nr * (blocksize / framesize);
+   ringsize = (size_t)req.tp_block_nr * blocksize;
+
+   /* TPACKET_V3 only hands over complete rx blocks, V2 signals each frame */
+   i = TPACKET_V2;
+   r = setsockopt(sock, SOL_PACKET, PACKET_VERSION, &i, sizeof(i));
+   r |= setsockopt(sock, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req));
+   r |= setsockopt(sock, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req));
+   /* hand tx frames directly to the NIC driver */
+   i = 1;
+   r |= setsockopt(sock, SOL_PACKET, PACKET_QDISC_BYPASS, &i, sizeof(i));
+   if (r)
+      return -1;
+
+   /* rx ring is mapped first, followed by tx ring */
+   ring->map = mmap(NULL, 2 * ringsize, PROT_READ | PROT_WRITE, MAP_SHARED, sock, 0);
+   if (ring->map == MAP_FAILED)
+   {
+      ring->map = NULL;
+      return -1;
+   }
+   ring->maplen = 2 * ringsize;
+   ring->rx = ring->map;
+   ring->tx = ring->map + ringsize;
+   ring->framesize = (int)framesize;
+   ring->frames = (int)req.tp_frame_nr;
+
+   return 0;
+}
+
+/** Release PACKET_MMAP rings.
+ * @param[in] ring     = ring state
+ */
+static void ecx_closering(ec_ringT *ring)
+{
+   if (ring->map)
+   {
+      munmap(ring->map, ring->maplen);
+      ring->map = NULL;
+   }
+}
+
+/** Enable SO_TIMESTAMPING on socket. Hardware timestamping is switched on
+ * in the NIC if supported, software timestamps are used otherwise.
+ * @param[in] sock     = socket handle
+ * @param[in] ifname   = Name of NIC device
+ * @param[in] ring     = TRUE if socket has PACKET_MMAP rings
+ * @return 0 if succeeded
+ */
+static int ecx_setuptimestamping(int sock, const char *ifname, int ring)
+{
+   struct hwtstamp_config hwcfg;
+   struct ifreq ifr;
+   int i, r;
+
+   /* not fatal, many NICs lack hardware timestamps */
+   memset(&hwcfg, 0, sizeof(hwcfg));
+   hwcfg.tx_type = HWTSTAMP_TX_ON;
+   hwcfg.rx_filter = HWTSTAMP_FILTER_ALL;
+   memset(&ifr, 0, sizeof(ifr));
+   strncpy(ifr.ifr_name, ifname, sizeof(ifr.ifr_name) - 1);
+   ifr.ifr_data = (void *)&hwcfg;
+   ioctl(sock, SIOCSHWTSTAMP, &ifr);
+
+   i = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_RX_SOFTWARE |
+       SOF_TIMESTAMPING_SOFTWARE |
+       SOF_TIMESTAMPING_TX_HARDWARE | SOF_TIMESTAMPING_RX_HARDWARE |
+       SOF_TIMESTAMPING_RAW_HARDWARE;
+   r = setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, &i, sizeof(i));
+   if (ring)
+   {
+      /* rx ring frame headers carry hardware timestamp if available */
+      i = SOF_TIMESTAMPING_RAW_HARDWARE;
+      r |= setsockopt(sock, SOL_PACKET, PACKET_TIMESTAMP, &i, sizeof(i));
+   }
+
+   return r;
+}
+
+/** Open raw EtherCAT socket on NIC and set the NIC to promiscuous mode.
+ * Shared by the raw socket based backends.
+ * @param[in]  port        = port context struct
+ * @param[in]  stack       = stack to open socket for
+ * @param[in]  ifname      = Name of NIC device, f.e. "eth0"
+ * @param[out] ifindex     = interface index of NIC
+ * @return 0 if succeeded
+ */
+static int ecx_rawopen(ecx_portt *port, ec_stackT *stack, const char *ifname, int *ifindex)
+{
+   struct ifreq ifr;
+   int i, r;
+
+   /* we use RAW packet socket, with packet type ETH_P_ECAT */
+   *stack->sock = socket(PF_PACKET, SOCK_RAW, htons(ETH_P_ECAT));
+   if (*stack->sock < 0)
+      return -1;
+
+   r = 0;
+   i = 1;
+   r |= setsockopt(*stack->sock, SOL_SOCKET, SO_DONTROUTE, &i, sizeof(i));
+
+   /* connect socket to NIC by name */
+   strncpy(ifr.ifr_name, ifname, sizeof(ifr.ifr_name) - 1);
+   ifr.ifr_name[sizeof(ifr.ifr_name) - 1] = '\0';
+   r |= ioctl(*stack->sock, SIOCGIFINDEX, &ifr);
+   *ifindex = ifr.ifr_ifindex;
+
+   /* reset flags of NIC interface */
+   ifr.ifr_flags = 0;
+   r |= ioctl(*stack->sock, SIOCGIFFLAGS, &ifr);
+
+   /* set flags of NIC interface, here promiscuous and broadcast */
+   ifr.ifr_flags = ifr.ifr_flags | IFF_PROMISC | IFF_BROADCAST;
+   r |= ioctl(*stack->sock, SIOCSIFFLAGS, &ifr);
+
+   if (port->timestamping)
+   {
+      r |= ecx_setuptimestamping(*stack->sock, ifname, port->nicops == &ecx_nicops_mmap);
+   }
+
+   return r;
+}
+
+/** Bind raw socket to EtherCAT protocol on NIC.
+ * @param[in] stack       = stack to bind socket of
+ * @param[in] ifindex     = interface index of NIC
+ * @return 0 if succeeded
+ */
+static int ecx_rawbind(ec_stackT *stack, int ifindex)
+{
+   struct sockaddr_ll sll;
+
+   memset((void*)&sll, 0, sizeof(sll));
+   sll.sll_family = AF_PACKET;
+   sll.sll_ifindex = ifindex;
+   sll.sll_protocol = htons(ETH_P_ECAT);
+
+   return bind(*stack->sock, (struct sockaddr *)&sll, sizeof(sll));
+}
+
+/** Open socket backend.
+ * @param[in] port        = port context struct
+ * @param[in] stack       = stack to open
+ * @param[in] ifname      = Name of NIC device, f.e. "eth0"
+ * @return 0 if succeeded
+ */
+static int ecx_socket_open(ecx_portt *port, ec_stackT *stack, const char *ifname)
+{
+   int ifindex;
+
+   if (ecx_rawopen(port, stack, ifname, &ifindex))
+      return -1;
+
+   return ecx_rawbind(stack, ifindex);
+}
+
+/** Close socket backend.
+ * @param[in] port        = port context struct
+ * @param[in] stack       = stack to close
+ */
+static void ecx_socket_close(ecx_portt *port, ec_stackT *stack)
+{
+   (void)port;
+   if (*stack->sock >= 0)
+      close(*stack->sock);
+   *stack->sock = -1;
+}
+
+/** Open PACKET_MMAP ring backend.
+ * @param[in] port        = port context struct
+ * @param[in] stack       = stack to open
+ * @param[in] ifname      = Name of NIC device, f.e. "eth0"
+ * @return 0 if succeeded
+ */
+static int ecx_ring_open(ecx_portt *port, ec_stackT *stack, const char *ifname)
+{
+   int ifindex;
+
+   if (ecx_rawopen(port, stack, ifname, &ifindex))
+      return -1;
+   /* rings must be set up before the socket is bound */
+   if (ecx_setupring(*stack->sock, stack->ring))
+      return -1;
+
+   return ecx_rawbind(stack, ifindex);
+}
+
+/** Close PACKET_MMAP ring backend.
+ * @param[in] port        = port context struct
+ * @param[in] stack       = stack to close
+ */
+static void ecx_ring_close(ecx_portt *port, ec_stackT *stack)
+{
+   ecx_closering(stack->ring);
+   ecx_socket_close(port, stack);
+}
+
+/** Open AF_XDP backend. The raw socket is only used to set up the NIC and
+ * is replaced by the AF_XDP socket. Frame timestamps are not available.
+ * @param[in] port        = port context struct
+ * @param[in] stack       = stack to open
+ * @param[in] ifname      = Name of NIC device, f.e. "eth0"
+ * @return 0 if succeeded
+ */
+static int ecx_afxdp_open(ecx_portt *port, ec_stackT *stack, const char *ifname)
+{
+   int ifindex;
+
+   port->timestamping = FALSE;
+   if (ecx_rawopen(port, stack, ifname, &ifindex))
+      return -1;
+   close(*stack->sock);
+   *stack->sock = ecx_xdp_open(&(stack->xdp), ifindex, port->nicqueue);
+
+   return (*stack->sock < 0) ? -1 : 0;
+}
+
+/** Close AF_XDP backend.
+ * @param[in] port        = port context struct
+ * @param[in] stack       = stack to close
+ */
+static void ecx_afxdp_close(ecx_portt *port, ec_stackT *stack)
+{
+   if (stack->xdp)
+   {
+      ecx_xdp_close(stack->xdp);
+      stack->xdp = NULL;
+   }
+   ecx_socket_close(port, stack);
+}
+
+/** Open simulated segment backend. The socket handle is an eventfd that is
+ * readable while responses are pending. Redundancy is not simulated.
+ * @param[in] port        = port context struct
+ * @param[in] stack       = stack to open
+ * @param[in] ifname      = segment description, f.e. "100:4:2"
+ * @return 0 if succeeded
+ */
+static int ecx_simnic_open(ecx_portt *port, ec_stackT *stack, const char *ifname)
+{
+   if (stack != &(port->stack))
+      return -1;
+   *stack->sock = ecx_sim_open((ec_simT **)&(stack->priv), ifname);
+
+   return (*stack->sock < 0) ? -1 : 0;
+}
+
+/** Close simulated segment backend.
+ * @param[in] port        = port context struct
+ * @param[in] stack       = stack to close
+ */
+static void ecx_simnic_close(ecx_portt *port, ec_stackT *stack)
+{
+   if (stack->priv)
+   {
+      ecx_sim_close((ec_simT *)stack->priv);
+      stack->priv = NULL;
+   }
+   ecx_socket_close(port, stack);
+}
+
+/** Open replay backend. The socket handle is an eventfd that is readable
+ * while responses are pending. Redundancy is not replayed.
+ * @param[in] port        = port context struct
+ * @param[in] stack       = stack to open
+ * @param[in] ifname      = pcap or pcapng file
+ * @return 0 if succeeded
+ */
+static int ecx_replaynic_open(ecx_portt *port, ec_stackT *stack, const char *ifname)
+{
+   if (stack != &(port->stack))
+      return -1;
+   *stack->sock = ecx_replay_open((ec_replayT **)&(stack->priv), ifname);
+
+   return (*stack->sock < 0) ? -1 : 0;
+}
+
+/** Close replay backend.
+ * @param[in] port        = port context struct
+ * @param[in] stack       = stack to close
+ */
+static void ecx_replaynic_close(ecx_portt *port, ec_stackT *stack)
+{
+   if (stack->priv)
+   {
+      ecx_replay_close((ec_replayT *)stack->priv);
+      stack->priv = NULL;
+   }
+   ecx_socket_close(port, stack);
+}
+
+/** Basic setup to connect NIC to socket. The NIC backend is taken from
+ * port->nicops, if not set it is selected by port->nicmode.
  * @param[in] port        = port context struct
  * @param[in] ifname      = Name of NIC device, f.e. "eth0"
  * @param[in] secondary   = if >0 then use secondary stack instead of primary
@@ -92,10 +507,9 @@ static void ecx_clear_rxbufstat(int *rxbufstat)
 int ecx_setupnic(ecx_portt *port, const char *ifname, int secondary)
 {
    int i;
-   int r, rval, ifindex;
-   struct ifreq ifr;
-   struct sockaddr_ll sll;
+   int r, rval;
    int *psock;
+   ec_stackT *stack;
    pthread_mutexattr_t mutexattr;
 
    rval = 0;
@@ -111,11 +525,19 @@ int ecx_setupnic(ecx_portt *port, const char *ifname, int secondary)
          port->redport->stack.sock = &(port->redport->sockhandle);
          port->redport->stack.txbuf = &(port->txbuf);
          port->redport->stack.txbuflength = &(port->txbuflength);
-         port->redport->stack.tempbuf = &(port->redport->tempinbuf);
-         port->redport->stack.rxbuf = &(port->redport->rxbuf);
+         port->redport->stack.rxbatch = &(port->redport->rxbatch);
+         /* the stacks receive into each others buffers, in the normal
+          * redundant case the frame that went through all slaves returns on
+          * the secondary socket and is then already in the primary buffer */
+         port->stack.rxbuf = &(port->redport->rxbuf);
+         port->redport->stack.rxbuf = &(port->rxbuf);
          port->redport->stack.rxbufstat = &(port->redport->rxbufstat);
          port->redport->stack.rxsa = &(port->redport->rxsa);
+         port->redport->stack.txtime = &(port->redport->txtime);
+         port->redport->stack.rxtime = &(port->redport->rxtime);
+         port->redport->stack.ring = &(port->redport->ring);
          ecx_clear_rxbufstat(&(port->redport->rxbufstat[0]));
+         stack = &(port->redport->stack);
       }
       else
       {
@@ -127,247 +549,1191 @@ int ecx_setupnic(ecx_portt *port, const char *ifname, int secondary)
    {
       pthread_mutexattr_init(&mutexattr);
       pthread_mutexattr_setprotocol(&mutexattr, PTHREAD_PRIO_INHERIT);
-      pthread_mutex_init(&(port->getindex_mutex), &mutexattr);
       pthread_mutex_init(&(port->tx_mutex), &mutexattr);
       pthread_mutex_init(&(port->rx_mutex), &mutexattr);
       port->sockhandle = -1;
       port->lastidx = 0;
+      memset(port->idxmap, 0, sizeof(port->idxmap));
       port->redstate = ECT_RED_NONE;
+      port->waitmode = ECT_WAIT_POLL;
+      port->waitslice = EC_WAITSLICE;
+      port->waitspin = EC_WAITSPIN;
+      port->epollfd = -1;
+      port->epollpwait2 = FALSE;
+      port->pcap = NULL;
+      port->pcapbusy = 0;
+      memset(port->rxpinned, 0, sizeof(port->rxpinned));
+      memset(&(port->waitstat), 0, sizeof(port->waitstat));
       port->stack.sock = &(port->sockhandle);
       port->stack.txbuf = &(port->txbuf);
       port->stack.txbuflength = &(port->txbuflength);
-      port->stack.tempbuf = &(port->tempinbuf);
+      port->stack.rxbatch = &(port->rxbatch);
       port->stack.rxbuf = &(port->rxbuf);
       port->stack.rxbufstat = &(port->rxbufstat);
       port->stack.rxsa = &(port->rxsa);
+      port->stack.txtime = &(port->txtime);
+      port->stack.rxtime = &(port->rxtime);
+      port->stack.ring = &(port->ring);
       ecx_clear_rxbufstat(&(port->rxbufstat[0]));
       psock = &(port->sockhandle);
+      stack = &(port->stack);
    }
-   /* we use RAW packet socket, with packet type ETH_P_ECAT */
-   *psock = socket(PF_PACKET, SOCK_RAW, htons(ETH_P_ECAT));
-   if (*psock < 0)
-      return 0;
+   stack->ring->map = NULL;
+   stack->xdp = NULL;
+   stack->priv = NULL;
+   *psock = -1;
+   if (port->nicops == NULL)
+   {
+      if (port->nicmode == ECT_NIC_MMAP)
+         port->nicops = &ecx_nicops_mmap;
+      else if (port->nicmode == ECT_NIC_XDP)
+         port->nicops = &ecx_nicops_xdp;
+      else
+         port->nicops = &ecx_nicops_socket;
+   }
+   r = port->nicops->open(port, stack, ifname);
+   /* setup ethernet headers in tx buffers so we don't have to repeat it */
+   for (i = 0; i < EC_MAXBUF; i++)
+   {
+      ec_setupheader(&(port->txbuf[i]));
+      port->rxbufstat[i] = EC_BUF_EMPTY;
+   }
+   ec_setupheader(&(port->txbuf2));
+   if (r == 0) rval = 1;
+
+   return rval;
+}
+
+/** Close sockets used
+ * @param[in] port        = port context struct
+ * @return 0
+ */
+int ecx_closenic(ecx_portt *port)
+{
+   ecx_capture_stop(port);
+   if (port->epollfd >= 0)
+   {
+      close(port->epollfd);
+      port->epollfd = -1;
+   }
+   if (port->nicops)
+   {
+      port->nicops->close(port, &(port->stack));
+      if (port->redport && port->redport->stack.sock)
+      {
+         port->nicops->close(port, &(port->redport->stack));
+      }
+   }
+
+   return 0;
+}
+
+/** Select how the blocking receive functions wait for frames. Call after
+ * the NIC is set up, in redundant mode after both NICs are set up.
+ *
+ * ECT_WAIT_POLL blocks in ppoll() for at most slice us at a time.
+ * ECT_WAIT_SPIN spins on non blocking reads.
+ * ECT_WAIT_BUSYPOLL spins as well, and lets the kernel busy poll the NIC
+ * queue for up to slice us per read (SO_BUSY_POLL, SO_PREFER_BUSY_POLL).
+ * ECT_WAIT_ADAPTIVE spins for spin us and then blocks like ECT_WAIT_POLL.
+ * ECT_WAIT_EPOLL blocks in epoll for at most slice us at a time.
+ *
+ * @param[in] port        = port context struct
+ * @param[in] mode        = wait mode, ECT_WAIT_POLL etc.
+ * @param[in] slice       = blocking slice or busy poll time in us, 0 = default
+ * @param[in] spin        = spin time in us before blocking, 0 = default
+ * @return >0 if succeeded
+ */
+int ecx_setwaitmode(ecx_portt *port, int mode, int slice, int spin)
+{
+   struct epoll_event ev;
+#ifdef __NR_epoll_pwait2
+   struct __kernel_timespec ts;
+#endif
+   int i, r, busypoll, prefer;
+   int socks[2];
+   int sockcnt;
 
+   if ((mode < ECT_WAIT_POLL) || (mode > ECT_WAIT_EPOLL))
+      return 0;
+   socks[0] = port->sockhandle;
+   sockcnt = 1;
+   if (port->redstate != ECT_RED_NONE)
+   {
+      socks[1] = port->redport->sockhandle;
+      sockcnt = 2;
+   }
+   if (port->epollfd >= 0)
+   {
+      close(port->epollfd);
+      port->epollfd = -1;
+   }
+   slice = (slice > 0) ? slice : EC_WAITSLICE;
+   spin = (spin > 0) ? spin : EC_WAITSPIN;
    r = 0;
-   i = 1;
-   r |= setsockopt(*psock, SOL_SOCKET, SO_DONTROUTE, &i, sizeof(i));
+   /* enable busy polling, or disable it when leaving ECT_WAIT_BUSYPOLL */
+   if ((mode == ECT_WAIT_BUSYPOLL) || (port->waitmode == ECT_WAIT_BUSYPOLL))
+   {
+      busypoll = (mode == ECT_WAIT_BUSYPOLL) ? slice : 0;
+      prefer = (mode == ECT_WAIT_BUSYPOLL) ? 1 : 0;
+      for (i = 0; i < sockcnt; i++)
+      {
+         r |= setsockopt(socks[i], SOL_SOCKET, SO_BUSY_POLL, &busypoll, sizeof(busypoll));
+         r |= setsockopt(socks[i], SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer));
+      }
+   }
+   if (mode == ECT_WAIT_EPOLL)
+   {
+      port->epollfd = epoll_create1(EPOLL_CLOEXEC);
+      if (port->epollfd < 0)
+         return 0;
+      for (i = 0; i < sockcnt; i++)
+      {
+         memset(&ev, 0, sizeof(ev));
+         ev.events = EPOLLIN;
+         ev.data.fd = socks[i];
+         r |= epoll_ctl(port->epollfd, EPOLL_CTL_ADD, socks[i], &ev);
+      }
+      port->epollpwait2 = FALSE;
+#ifdef __NR_epoll_pwait2
+      /* kernels before 5.11 return ENOSYS, probe once without blocking */
+      ts.tv_sec = 0;
+      ts.tv_nsec = 0;
+      if ((syscall(__NR_epoll_pwait2, port->epollfd, &ev, 1, &ts, NULL, 0) >= 0) || (errno != ENOSYS))
+      {
+         port->epollpwait2 = TRUE;
+      }
+#endif
+   }
+   if (r)
+   {
+      if (port->epollfd >= 0)
+      {
+         close(port->epollfd);
+         port->epollfd = -1;
+      }
+      port->waitmode = ECT_WAIT_POLL;
+      return 0;
+   }
+   port->waitslice = slice;
+   port->waitspin = spin;
+   port->waitmode = mode;
 
-   /* connect socket to NIC by name */
-   strncpy(ifr.ifr_name, ifname, sizeof(ifr.ifr_name) - 1);
-   ifr.ifr_name[sizeof(ifr.ifr_name) - 1] = '\0';
-   r |= ioctl(*psock, SIOCGIFINDEX, &ifr);
-   ifindex = ifr.ifr_ifindex;
+   return 1;
+}
 
-   /* reset flags of NIC interface */
-   ifr.ifr_flags = 0;
-   r |= ioctl(*psock, SIOCGIFFLAGS, &ifr);
+/** Start recording all frames sent and received on the port in a pcapng
+ * file. Frames are copied into a ring of the given size by the sending and
+ * receiving threads, without locking, and written to the file by a
+ * background thread. Frames are dropped if the ring is full. Call after
+ * the NIC is set up, in redundant mode after both NICs are set up.
+ * @param[in] port        = port context struct
+ * @param[in] filename    = pcapng file, overwritten
+ * @param[in] frames      = ring size in frames, 0 = default
+ * @return >0 if succeeded
+ */
+int ecx_capture_start(ecx_portt *port, const char *filename, int frames)
+{
+   ec_pcapT *pcap;
 
-   /* set flags of NIC interface, here promiscuous and broadcast */
-   ifr.ifr_flags = ifr.ifr_flags | IFF_PROMISC | IFF_BROADCAST;
-   r |= ioctl(*psock, SIOCSIFFLAGS, &ifr);
+   if (port->pcap)
+   {
+      return 0;
+   }
+   if (ecx_pcap_open(&pcap, filename, frames, (port->redstate != ECT_RED_NONE) ? 2 : 1))
+   {
+      return 0;
+   }
+   __atomic_store_n(&(port->pcap), pcap, __ATOMIC_SEQ_CST);
 
-   /* bind socket to protocol, in this case RAW EtherCAT */
-   memset((void*)&sll, 0, sizeof(sll));
-   sll.sll_family = AF_PACKET;
-   sll.sll_ifindex = ifindex;
-   sll.sll_protocol = htons(ETH_P_ECAT);
-   r |= bind(*psock, (struct sockaddr *)&sll, sizeof(sll));
-   /* setup ethernet headers in tx buffers so we don't have to repeat it */
-   for (i = 0; i < EC_MAXBUF; i++)
+   return 1;
+}
+
+/** Stop recording frames. Waits until all captured frames are written and
+ * closes the file.
+ * @param[in] port        = port context struct
+ * @return >0 if capture was running
+ */
+int ecx_capture_stop(ecx_portt *port)
+{
+   ec_pcapT *pcap;
+
+   pcap = __atomic_exchange_n(&(port->pcap), NULL, __ATOMIC_SEQ_CST);
+   if (pcap == NULL)
    {
-      ec_setupheader(&(port->txbuf[i]));
-      port->rxbufstat[i] = EC_BUF_EMPTY;
+      return 0;
+   }
+   /* threads that saw the ring before it was cleared are still copying */
+   while (__atomic_load_n(&(port->pcapbusy), __ATOMIC_SEQ_CST))
+   {
+      osal_usleep(1);
+   }
+   ecx_pcap_close(pcap);
+
+   return 1;
+}
+
+/** Get capture counters of the port.
+ * @param[in]  port        = port context struct
+ * @param[out] captured    = frames captured
+ * @param[out] dropped     = frames dropped because the ring was full
+ * @return >0 if capture is running
+ */
+int ecx_capture_stats(ecx_portt *port, uint64 *captured, uint64 *dropped)
+{
+   *captured = 0;
+   *dropped = 0;
+   if (port->pcap == NULL)
+   {
+      return 0;
+   }
+   ecx_pcap_stats(port->pcap, captured, dropped);
+
+   return 1;
+}
+
+/** Fill buffer with ethernet header structure.
+ * Destination MAC is always broadcast.
+ * Ethertype is always ETH_P_ECAT.
+ * @param[out] p = buffer
+ */
+void ec_setupheader(void *p)
+{
+   ec_etherheadert *bp;
+   bp = p;
+   bp->da0 = htons(0xffff);
+   bp->da1 = htons(0xffff);
+   bp->da2 = htons(0xffff);
+   bp->sa0 = htons(priMAC[0]);
+   bp->sa1 = htons(priMAC[1]);
+   bp->sa2 = htons(priMAC[2]);
+   bp->etype = htons(ETH_P_ECAT);
+}
+
+/** Get new frame identifier index and allocate corresponding rx buffer.
+ * Lock free, an index is owned by the caller that atomically sets its bit in
+ * the allocation bitmap. The search starts after the last allocated index so
+ * indexes are used round robin.
+ * @param[in] port        = port context struct
+ * @return new index.
+ */
+uint8 ecx_getindex(ecx_portt *port)
+{
+   uint32 *word;
+   uint32 bit;
+   uint8 idx;
+   int cnt;
+
+   idx = __atomic_load_n(&(port->lastidx), __ATOMIC_RELAXED) + 1;
+   /* index can't be larger than buffer array */
+   if (idx >= EC_MAXBUF)
+   {
+      idx = 0;
+   }
+   /* try to find unused index */
+   for (cnt = 0; cnt < EC_MAXBUF; cnt++)
+   {
+      word = &(port->idxmap[idx >> 5]);
+      bit = (uint32)1 << (idx & 31);
+      if (!(__atomic_load_n(word, __ATOMIC_RELAXED) & bit) &&
+          !(__atomic_fetch_or(word, bit, __ATOMIC_ACQUIRE) & bit))
+      {
+         break;
+      }
+      idx++;
+      if (idx >= EC_MAXBUF)
+      {
+         idx = 0;
+      }
+   }
+   /* if all indexes are in use the first one tried is shared, as before */
+   ecx_putbufstat(&(port->rxbufstat[idx]), EC_BUF_ALLOC);
+   memset(&(port->txtime[idx]), 0, sizeof(ec_timet));
+   memset(&(port->rxtime[idx]), 0, sizeof(ec_timet));
+   if (port->redstate != ECT_RED_NONE)
+   {
+      ecx_putbufstat(&(port->redport->rxbufstat[idx]), EC_BUF_ALLOC);
+      memset(&(port->redport->txtime[idx]), 0, sizeof(ec_timet));
+      memset(&(port->redport->rxtime[idx]), 0, sizeof(ec_timet));
+   }
+   __atomic_store_n(&(port->lastidx), idx, __ATOMIC_RELAXED);
+
+   return idx;
+}
+
+/** Set rx buffer status. Setting EC_BUF_EMPTY releases the index.
+ * @param[in] port        = port context struct
+ * @param[in] idx      = index in buffer array
+ * @param[in] bufstat  = status to set
+ */
+void ecx_setbufstat(ecx_portt *port, uint8 idx, int bufstat)
+{
+   ecx_putbufstat(&(port->rxbufstat[idx]), bufstat);
+   if (port->redstate != ECT_RED_NONE)
+      ecx_putbufstat(&(port->redport->rxbufstat[idx]), bufstat);
+   if (bufstat == EC_BUF_EMPTY)
+   {
+      __atomic_fetch_and(&(port->idxmap[idx >> 5]), ~((uint32)1 << (idx & 31)), __ATOMIC_RELEASE);
+   }
+}
+
+/** Pin or unpin the rx buffer of an index. A pinned rx buffer only changes
+ * when the frame of its index is received, the socket backend does not
+ * receive other frames into it on the way. Used for zero copy processdata,
+ * whose inputs stay in the rx buffer while the next frame is in flight.
+ * @param[in] port        = port context struct
+ * @param[in] idx         = index in buffer array
+ * @param[in] pinned      = TRUE to pin, FALSE to unpin
+ */
+void ecx_pinrxbuf(ecx_portt *port, uint8 idx, int pinned)
+{
+   if (idx < EC_MAXBUF)
+   {
+      port->rxpinned[idx] = (uint8)(pinned ? 1 : 0);
+   }
+}
+
+/** Copy frame into tx ring. Transmission is triggered by ecx_ring_send().
+ * The frame stays in its tx buffer, see the ECT_NIC_MMAP notes above.
+ * Caller must hold tx_mutex.
+ * @param[in] stack       = stack to send frame on
+ * @param[in] buf         = frame to send
+ * @param[in] len         = length of frame
+ * @return length of frame or -1 if no free ring frame
+ */
+static int ecx_ringput(ec_stackT *stack, const void *buf, int len)
+{
+   ec_ringT *ring = stack->ring;
+   struct tpacket2_hdr *hdr;
+
+   hdr = (struct tpacket2_hdr *)(ring->tx + (size_t)ring->txhead * ring->framesize);
+   if (__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) & (TP_STATUS_SEND_REQUEST | TP_STATUS_SENDING))
+   {
+      /* ring full, kick kernel to drain it */
+      send(*stack->sock, NULL, 0, MSG_DONTWAIT);
+      return -1;
+   }
+   /* without PACKET_TX_HAS_OFF frame data starts after the tpacket2 header */
+   memcpy((uint8 *)hdr + TPACKET2_HDRLEN - sizeof(struct sockaddr_ll), buf, len);
+   hdr->tp_len = len;
+   __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+   ring->txhead++;
+   if (ring->txhead >= ring->frames)
+   {
+      ring->txhead = 0;
+   }
+
+   return len;
+}
+
+/** Get frame to send for an entry of an index list.
+ * @param[in]  port        = port context struct
+ * @param[in]  stack       = stack to send frame on
+ * @param[in]  idx         = index of frame
+ * @param[in]  dummy       = if TRUE get dummy frame txbuf2 with index idx
+ * @param[out] len         = length of frame
+ * @return frame to send
+ */
+static uint8 *ecx_txframe(ecx_portt *port, ec_stackT *stack, uint8 idx, int dummy, int *len)
+{
+   ec_comt *datagramP;
+
+   if (dummy)
+   {
+      datagramP = (ec_comt *)&(port->txbuf2[ETH_HEADERSIZE]);
+      datagramP->index = idx;
+      *len = port->txbuflength2;
+      return port->txbuf2;
+   }
+   *len = (*stack->txbuflength)[idx];
+
+   return (*stack->txbuf)[idx];
+}
+
+/** Copy frame into the capture ring if capture is on. The ring is only
+ * released by ecx_capture_stop() when no thread is in here.
+ * @param[in] port        = port context struct
+ * @param[in] stack       = stack of frame
+ * @param[in] dir         = 1 = received, 2 = sent
+ * @param[in] hdr         = ethernet header, or whole frame if data is NULL
+ * @param[in] hlen        = length of hdr
+ * @param[in] data        = frame data following the header, or NULL
+ * @param[in] len         = length of data
+ */
+static inline void ecx_capture(ecx_portt *port, ec_stackT *stack, int dir,
+                               const void *hdr, int hlen, const void *data, int len)
+{
+   ec_pcapT *pcap;
+
+   if (__atomic_load_n(&(port->pcap), __ATOMIC_RELAXED) == NULL)
+   {
+      return;
+   }
+   __atomic_add_fetch(&(port->pcapbusy), 1, __ATOMIC_SEQ_CST);
+   pcap = __atomic_load_n(&(port->pcap), __ATOMIC_SEQ_CST);
+   if (pcap)
+   {
+      ecx_pcap_put(pcap, (stack == &(port->stack)) ? 0 : 1, dir, hdr, hlen, data, len);
+   }
+   __atomic_sub_fetch(&(port->pcapbusy), 1, __ATOMIC_RELEASE);
+}
+
+/** Send list of frames with socket backend, multiple frames with a single
+ * system call.
+ * @param[in] port        = port context struct
+ * @param[in] stack       = stack to send frames on
+ * @param[in] idxlist     = indexes in tx buffer array
+ * @param[in] cnt         = number of indexes in list, max EC_MAXBUF
+ * @param[in] dummy       = if TRUE send dummy frame txbuf2 with index from list
+ * @return number of frames sent
+ */
+static int ecx_socket_send(ecx_portt *port, ec_stackT *stack, const uint8 *idxlist, int cnt, int dummy)
+{
+   struct mmsghdr msg[EC_MAXBUF];
+   struct iovec iov[EC_MAXBUF][3];
+   int i, r, sent;
+   /* index byte of the dummy frame */
+   const int idxpos = ETH_HEADERSIZE + offsetof(ec_comt, index);
+
+   if ((cnt == 1) && !dummy)
+   {
+      r = send(*stack->sock, (*stack->txbuf)[idxlist[0]], (*stack->txbuflength)[idxlist[0]], 0);
+      return (r == -1) ? 0 : 1;
+   }
+   memset(msg, 0, sizeof(msg[0]) * cnt);
+   for (i = 0; i < cnt; i++)
+   {
+      if (dummy)
+      {
+         /* all dummy frames share txbuf2, only the index differs */
+         iov[i][0].iov_base = &(port->txbuf2);
+         iov[i][0].iov_len = idxpos;
+         iov[i][1].iov_base = (void *)&idxlist[i];
+         iov[i][1].iov_len = 1;
+         iov[i][2].iov_base = &(port->txbuf2[idxpos + 1]);
+         iov[i][2].iov_len = port->txbuflength2 - idxpos - 1;
+         msg[i].msg_hdr.msg_iovlen = 3;
+      }
+      else
+      {
+         iov[i][0].iov_base = (*stack->txbuf)[idxlist[i]];
+         iov[i][0].iov_len = (*stack->txbuflength)[idxlist[i]];
+         msg[i].msg_hdr.msg_iovlen = 1;
+      }
+      msg[i].msg_hdr.msg_iov = iov[i];
+   }
+   sent = 0;
+   while (sent < cnt)
+   {
+      r = sendmmsg(*stack->sock, &msg[sent], cnt - sent, 0);
+      if (r <= 0)
+         break;
+      sent += r;
+   }
+
+   return sent;
+}
+
+/** Send list of frames with PACKET_MMAP ring backend. All frames are put in
+ * the tx ring before the kernel is kicked. Caller must hold tx_mutex.
+ * @param[in] port        = port context struct
+ * @param[in] stack       = stack to send frames on
+ * @param[in] idxlist     = indexes in tx buffer array
+ * @param[in] cnt         = number of indexes in list, max EC_MAXBUF
+ * @param[in] dummy       = if TRUE send dummy frame txbuf2 with index from list
+ * @return number of frames sent
+ */
+static int ecx_ring_send(ecx_portt *port, ec_stackT *stack, const uint8 *idxlist, int cnt, int dummy)
+{
+   uint8 *frame;
+   int len, sent;
+
+   for (sent = 0; sent < cnt; sent++)
+   {
+      frame = ecx_txframe(port, stack, idxlist[sent], dummy, &len);
+      if (ecx_ringput(stack, frame, len) == -1)
+         break;
+   }
+   /* let the kernel transmit all frames put in the tx ring */
+   if (sent && (send(*stack->sock, NULL, 0, MSG_DONTWAIT) == -1))
+   {
+      sent = 0;
+   }
+
+   return sent;
+}
+
+/** Send list of frames with AF_XDP backend. Caller must hold tx_mutex.
+ * @param[in] port        = port context struct
+ * @param[in] stack       = stack to send frames on
+ * @param[in] idxlist     = indexes in tx buffer array
+ * @param[in] cnt         = number of indexes in list, max EC_MAXBUF
+ * @param[in] dummy       = if TRUE send dummy frame txbuf2 with index from list
+ * @return number of frames sent
+ */
+static int ecx_afxdp_send(ecx_portt *port, ec_stackT *stack, const uint8 *idxlist, int cnt, int dummy)
+{
+   uint8 *frame;
+   int len, sent;
+
+   for (sent = 0; sent < cnt; sent++)
+   {
+      frame = ecx_txframe(port, stack, idxlist[sent], dummy, &len);
+      if (ecx_xdp_put(stack->xdp, frame, len) == -1)
+         break;
+   }
+   if (sent && (ecx_xdp_kick(stack->xdp) == -1))
+   {
+      sent = 0;
+   }
+
+   return sent;
+}
+
+/** Send list of frames through the simulated segment. Caller must hold
+ * tx_mutex.
+ * @param[in] port        = port context struct
+ * @param[in] stack       = stack to send frames on
+ * @param[in] idxlist     = indexes in tx buffer array
+ * @param[in] cnt         = number of indexes in list, max EC_MAXBUF
+ * @param[in] dummy       = if TRUE send dummy frame txbuf2 with index from list
+ * @return number of frames sent
+ */
+static int ecx_simnic_send(ecx_portt *port, ec_stackT *stack, const uint8 *idxlist, int cnt, int dummy)
+{
+   ec_timet ts;
+   uint8 *frame;
+   int len, sent;
+
+   for (sent = 0; sent < cnt; sent++)
+   {
+      frame = ecx_txframe(port, stack, idxlist[sent], dummy, &len);
+      if (ecx_sim_put((ec_simT *)stack->priv, frame, len, &ts) == -1)
+         break;
+      if (port->timestamping)
+      {
+         (*stack->txtime)[idxlist[sent]] = ts;
+      }
+   }
+
+   return sent;
+}
+
+/** Send list of frames to the replay backend. Caller must hold tx_mutex.
+ * @param[in] port        = port context struct
+ * @param[in] stack       = stack to send frames on
+ * @param[in] idxlist     = indexes in tx buffer array
+ * @param[in] cnt         = number of indexes in list, max EC_MAXBUF
+ * @param[in] dummy       = if TRUE send dummy frame txbuf2 with index from list
+ * @return number of frames sent
+ */
+static int ecx_replaynic_send(ecx_portt *port, ec_stackT *stack, const uint8 *idxlist, int cnt, int dummy)
+{
+   ec_timet ts;
+   uint8 *frame;
+   int len, sent;
+
+   for (sent = 0; sent < cnt; sent++)
+   {
+      frame = ecx_txframe(port, stack, idxlist[sent], dummy, &len);
+      if (ecx_replay_put((ec_replayT *)stack->priv, frame, len, &ts) == -1)
+         break;
+      if (port->timestamping)
+      {
+         (*stack->txtime)[idxlist[sent]] = ts;
+      }
+   }
+
+   return sent;
+}
+
+/** Send list of frames with the NIC backend of the port. The default socket
+ * backend is called directly.
+ * @param[in] port        = port context struct
+ * @param[in] stack       = stack to send frames on
+ * @param[in] idxlist     = indexes in tx buffer array
+ * @param[in] cnt         = number of indexes in list, max EC_MAXBUF
+ * @param[in] dummy       = if TRUE send dummy frame txbuf2 with index from list
+ * @return number of frames sent
+ */
+static inline int ecx_nicsend(ecx_portt *port, ec_stackT *stack, const uint8 *idxlist, int cnt, int dummy)
+{
+   uint8 *frame;
+   int i, len, sent;
+
+   if (port->nicops == &ecx_nicops_socket)
+   {
+      sent = ecx_socket_send(port, stack, idxlist, cnt, dummy);
+   }
+   else
+   {
+      sent = port->nicops->send(port, stack, idxlist, cnt, dummy);
+   }
+   if (__atomic_load_n(&(port->pcap), __ATOMIC_RELAXED))
+   {
+      for (i = 0; i < sent; i++)
+      {
+         frame = ecx_txframe(port, stack, idxlist[i], dummy, &len);
+         ecx_capture(port, stack, 2, frame, len, NULL, 0);
+      }
+   }
+
+   return sent;
+}
+
+/** Transmit buffer over socket (non blocking).
+ * @param[in] port        = port context struct
+ * @param[in] idx         = index in tx buffer array
+ * @param[in] stacknumber  = 0=Primary 1=Secondary stack
+ * @return socket send result
+ */
+int ecx_outframe(ecx_portt *port, uint8 idx, int stacknumber)
+{
+   int lp, rval;
+   ec_stackT *stack;
+
+   if (!stacknumber)
+   {
+      stack = &(port->stack);
+   }
+   else
+   {
+      stack = &(port->redport->stack);
+   }
+   lp = (*stack->txbuflength)[idx];
+   ecx_marktx(stack, idx);
+   if (port->nicops->txlock)
+   {
+      /* tx rings have a single producer */
+      pthread_mutex_lock(&(port->tx_mutex));
+      rval = ecx_nicsend(port, stack, &idx, 1, FALSE);
+      pthread_mutex_unlock(&(port->tx_mutex));
+   }
+   else
+   {
+      rval = ecx_nicsend(port, stack, &idx, 1, FALSE);
+   }
+   if (rval < 1)
+   {
+      ecx_putbufstat(&(*stack->rxbufstat)[idx], EC_BUF_EMPTY);
+      return -1;
+   }
+
+   return lp;
+}
+
+/** Transmit buffer over socket (non blocking).
+ * @param[in] port        = port context struct
+ * @param[in] idx = index in tx buffer array
+ * @return socket send result
+ */
+int ecx_outframe_red(ecx_portt *port, uint8 idx)
+{
+   ec_comt *datagramP;
+   ec_etherheadert *ehp;
+   int rval;
+
+   ehp = (ec_etherheadert *)&(port->txbuf[idx]);
+   /* rewrite MAC source address 1 to primary */
+   ehp->sa1 = htons(priMAC[1]);
+   /* transmit over primary socket*/
+   rval = ecx_outframe(port, idx, 0);
+   if (port->redstate != ECT_RED_NONE)
+   {
+      pthread_mutex_lock(&(port->tx_mutex));
+      ehp = (ec_etherheadert *)&(port->txbuf2);
+      /* use dummy frame for secondary socket transmit (BRD) */
+      datagramP = (ec_comt *)&(port->txbuf2[ETH_HEADERSIZE]);
+      /* write index to frame */
+      datagramP->index = idx;
+      /* rewrite MAC source address 1 to secondary */
+      ehp->sa1 = htons(secMAC[1]);
+      /* transmit over secondary socket */
+      ecx_marktx(&(port->redport->stack), idx);
+      if (ecx_nicsend(port, &(port->redport->stack), &idx, 1, TRUE) < 1)
+      {
+         ecx_putbufstat(&(port->redport->rxbufstat[idx]), EC_BUF_EMPTY);
+      }
+      pthread_mutex_unlock(&(port->tx_mutex));
+   }
+
+   return rval;
+}
+
+/** Transmit list of buffers with a single system call per socket (non blocking).
+ * In redundant mode a dummy frame is sent over the secondary socket for every
+ * index in the list, as ecx_outframe_red() does.
+ * @param[in] port        = port context struct
+ * @param[in] idxlist     = indexes in tx buffer array
+ * @param[in] cnt         = number of indexes in list, max EC_MAXBUF
+ * @return number of frames sent over primary socket
+ */
+int ecx_outframes_red(ecx_portt *port, const uint8 *idxlist, int cnt)
+{
+   ec_etherheadert *ehp;
+   int i, rval, sent;
+
+   if (cnt > EC_MAXBUF)
+   {
+      cnt = EC_MAXBUF;
+   }
+   pthread_mutex_lock(&(port->tx_mutex));
+   for (i = 0; i < cnt; i++)
+   {
+      ehp = (ec_etherheadert *)&(port->txbuf[idxlist[i]]);
+      /* rewrite MAC source address 1 to primary */
+      ehp->sa1 = htons(priMAC[1]);
+      ecx_marktx(&(port->stack), idxlist[i]);
+   }
+   /* transmit over primary socket */
+   rval = ecx_nicsend(port, &(port->stack), idxlist, cnt, FALSE);
+   for (i = rval; i < cnt; i++)
+   {
+      ecx_putbufstat(&(port->rxbufstat[idxlist[i]]), EC_BUF_EMPTY);
+   }
+   if (port->redstate != ECT_RED_NONE)
+   {
+      ehp = (ec_etherheadert *)&(port->txbuf2);
+      /* rewrite MAC source address 1 to secondary */
+      ehp->sa1 = htons(secMAC[1]);
+      for (i = 0; i < cnt; i++)
+      {
+         ecx_marktx(&(port->redport->stack), idxlist[i]);
+      }
+      /* transmit dummy frames over secondary socket */
+      sent = ecx_nicsend(port, &(port->redport->stack), idxlist, cnt, TRUE);
+      for (i = sent; i < cnt; i++)
+      {
+         ecx_putbufstat(&(port->redport->rxbufstat[idxlist[i]]), EC_BUF_EMPTY);
+      }
+   }
+   pthread_mutex_unlock(&(port->tx_mutex));
+
+   return rval;
+}
+
+/** Get SO_TIMESTAMPING timestamp from control messages of received frame.
+ * A hardware timestamp is preferred over a software timestamp.
+ * @param[in]  msg        = received message
+ * @param[out] ts         = timestamp, zero if not available
+ */
+static void ecx_cmsgtime(struct msghdr *msg, ec_timet *ts)
+{
+   struct cmsghdr *cmsg;
+   struct scm_timestamping tss;
+
+   ts->tv_sec = 0;
+   ts->tv_nsec = 0;
+   for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg))
+   {
+      if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_TIMESTAMPING))
+      {
+         memcpy(&tss, CMSG_DATA(cmsg), sizeof(tss));
+         if (tss.ts[2].tv_sec || tss.ts[2].tv_nsec)
+         {
+            *ts = tss.ts[2];
+         }
+         else
+         {
+            *ts = tss.ts[0];
+         }
+      }
+   }
+}
+
+/** Non blocking read of tx timestamps from socket error queue. The kernel
+ * returns a copy of each sent frame with its timestamp, the frame index is
+ * taken from the EtherCAT header. Caller must hold rx_mutex.
+ * @param[in] stack       = stack to read tx timestamps for
+ */
+static void ecx_draintxtime(ec_stackT *stack)
+{
+   struct mmsghdr msg[EC_MAXBUF];
+   struct iovec iov[EC_MAXBUF];
+   uint8 hdr[EC_MAXBUF][ETH_HEADERSIZE + EC_HEADERSIZE];
+   uint8 ctrl[EC_MAXBUF][EC_CMSGSIZE];
+   ec_etherheadert *ehp;
+   ec_comt *ecp;
+   ec_timet ts;
+   int i, cnt;
+
+   do
+   {
+      memset(msg, 0, sizeof(msg));
+      for (i = 0; i < EC_MAXBUF; i++)
+      {
+         iov[i].iov_base = hdr[i];
+         iov[i].iov_len = sizeof(hdr[i]);
+         msg[i].msg_hdr.msg_iov = &iov[i];
+         msg[i].msg_hdr.msg_iovlen = 1;
+         msg[i].msg_hdr.msg_control = ctrl[i];
+         msg[i].msg_hdr.msg_controllen = sizeof(ctrl[i]);
+      }
+      cnt = recvmmsg(*stack->sock, msg, EC_MAXBUF, MSG_ERRQUEUE | MSG_DONTWAIT, NULL);
+      for (i = 0; i < cnt; i++)
+      {
+         ehp = (ec_etherheadert *)hdr[i];
+         if ((msg[i].msg_len < sizeof(hdr[i])) || (ehp->etype != htons(ETH_P_ECAT)))
+         {
+            continue;
+         }
+         ecp = (ec_comt *)&hdr[i][ETH_HEADERSIZE];
+         /* a late timestamp of a released buffer is dropped */
+         if ((ecp->index < EC_MAXBUF) && (ecx_getbufstat(&(*stack->rxbufstat)[ecp->index]) >= EC_BUF_TX))
+         {
+            ecx_cmsgtime(&msg[i].msg_hdr, &ts);
+            (*stack->txtime)[ecp->index] = ts;
+         }
+      }
+   } while (cnt == EC_MAXBUF);
+}
+
+/** Mark frame in its indexed rx buffer as received.
+ * @param[in] port        = port context struct
+ * @param[in] stack       = stack the frame was received on
+ * @param[in] idx         = index of frame
+ * @param[in] ehp         = ethernet header of frame
+ * @param[in] ts          = receive timestamp of frame
+ */
+static void ecx_markrcvd(ecx_portt *port, ec_stackT *stack, uint8 idx, ec_etherheadert *ehp, const ec_timet *ts)
+{
+   int bufstat;
+
+   ecx_capture(port, stack, 1, ehp, ETH_HEADERSIZE, &(*stack->rxbuf)[idx], (*stack->txbuflength)[idx] - ETH_HEADERSIZE);
+
+   /* store MAC source word 1 for redundant routing info */
+   (*stack->rxsa)[idx] = ntohs(ehp->sa1);
+   (*stack->rxtime)[idx] = *ts;
+   /* mark as received, unless the owner gave up on it meanwhile */
+   bufstat = EC_BUF_TX;
+   __atomic_compare_exchange_n(&(*stack->rxbufstat)[idx], &bufstat, EC_BUF_RCVD,
+                               FALSE, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+/** Store received frame in the indexed rx buffer it belongs to, if someone
+ * is waiting for that index.
+ * @param[in] port        = port context struct
+ * @param[in] stack       = stack the frame was received on
+ * @param[in] frame       = received frame including ethernet header
+ * @param[in] len         = length of received frame
+ * @param[in] ts          = receive timestamp of frame
+ */
+static void ecx_dispatchpkt(ecx_portt *port, ec_stackT *stack, uint8 *frame, int len, const ec_timet *ts)
+{
+   ec_etherheadert *ehp;
+   ec_comt *ecp;
+   uint8 idxf;
+
+   ehp = (ec_etherheadert *)frame;
+   /* check if it is an EtherCAT frame */
+   if (ehp->etype == htons(ETH_P_ECAT))
+   {
+      stack->rxcnt++;
+      ecp = (ec_comt *)(&frame[ETH_HEADERSIZE]);
+      idxf = ecp->index;
+      /* check if index exist and someone is waiting for it */
+      if (idxf < EC_MAXBUF && ecx_getbufstat(&(*stack->rxbufstat)[idxf]) == EC_BUF_TX)
+      {
+         /* put it in the buffer array (strip ethernet header) */
+         memcpy(&(*stack->rxbuf)[idxf], &frame[ETH_HEADERSIZE], (*stack->txbuflength)[idxf] - ETH_HEADERSIZE);
+         ecx_markrcvd(port, stack, idxf, ehp, ts);
+      }
+      else
+      {
+         /* strange things happened */
+         ecx_capture(port, stack, 1, frame, len, NULL, 0);
+      }
+   }
+}
+
+/** Predict in which order waiting frames return, oldest sent first. Pinned
+ * rx buffers are left out, see ecx_pinrxbuf().
+ * @param[in]  port        = port context struct
+ * @param[in]  stack       = stack to predict for
+ * @param[out] pred        = indexes in expected receive order
+ * @return number of waiting frames
+ */
+static int ecx_predictrx(ecx_portt *port, ec_stackT *stack, uint8 *pred)
+{
+   uint32 age[EC_MAXBUF];
+   uint32 a;
+   int i, j, n;
+
+   n = 0;
+   for (i = 0; i < EC_MAXBUF; i++)
+   {
+      if (port->rxpinned[i] || (ecx_getbufstat(&(*stack->rxbufstat)[i]) != EC_BUF_TX))
+      {
+         continue;
+      }
+      /* insertion sort, wrap safe */
+      a = stack->txcnt - stack->txseq[i];
+      for (j = n; (j > 0) && (age[j - 1] < a); j--)
+      {
+         age[j] = age[j - 1];
+         pred[j] = pred[j - 1];
+      }
+      age[j] = a;
+      pred[j] = (uint8)i;
+      n++;
    }
-   ec_setupheader(&(port->txbuf2));
-   if (r == 0) rval = 1;
 
-   return rval;
+   return n;
 }
 
-/** Close sockets used
+/** Non blocking read of all frames pending on socket with socket backend.
+ * Every frame is stored in its indexed rx buffer. All frames are read with a
+ * single recvmmsg() call.
+ *
+ * Frames are received directly into the rx buffers of the frames that are
+ * expected to return first, only the ethernet header goes to a scratch
+ * buffer. A frame that returns out of the predicted order is moved to its
+ * own rx buffer afterwards. Pinned rx buffers of zero copy frames are never
+ * borrowed, they hold the inputs of a frame that may still be lost. Their
+ * frames and frames beyond the prediction go to the batch buffers and are
+ * copied.
+ * Caller must hold rx_mutex.
  * @param[in] port        = port context struct
- * @return 0
+ * @param[in] stack       = stack to read frames from
+ * @return number of frames read
  */
-int ecx_closenic(ecx_portt *port)
+static int ecx_socket_recv(ecx_portt *port, ec_stackT *stack)
 {
-   if (port->sockhandle >= 0)
-      close(port->sockhandle);
-   if ((port->redport) && (port->redport->sockhandle >= 0))
-      close(port->redport->sockhandle);
+   struct mmsghdr msg[EC_MAXBUF];
+   struct iovec iov[EC_MAXBUF][2];
+   uint8 ctrl[EC_MAXBUF][EC_CMSGSIZE];
+   uint8 pred[EC_MAXBUF];
+   boolean hit[EC_MAXBUF];
+   ec_etherheadert *ehp;
+   ec_timet ts;
+   int i, cnt, npred, len;
 
-   return 0;
-}
+   /* tx timestamps first, the frames might already be back */
+   if (port->timestamping)
+   {
+      ecx_draintxtime(stack);
+   }
+   /* no more frames than indexes can be in flight */
+   npred = ecx_predictrx(port, stack, pred);
+   memset(msg, 0, sizeof(msg));
+   for (i = 0; i < EC_MAXBUF; i++)
+   {
+      iov[i][0].iov_base = &(*stack->rxbatch)[i];
+      iov[i][0].iov_len = ETH_HEADERSIZE;
+      if (i < npred)
+      {
+         iov[i][1].iov_base = &(*stack->rxbuf)[pred[i]];
+      }
+      else
+      {
+         iov[i][1].iov_base = &(*stack->rxbatch)[i][ETH_HEADERSIZE];
+      }
+      iov[i][1].iov_len = sizeof(ec_bufT) - ETH_HEADERSIZE;
+      msg[i].msg_hdr.msg_iov = iov[i];
+      msg[i].msg_hdr.msg_iovlen = 2;
+      if (port->timestamping)
+      {
+         msg[i].msg_hdr.msg_control = ctrl[i];
+         msg[i].msg_hdr.msg_controllen = sizeof(ctrl[i]);
+      }
+   }
+   cnt = recvmmsg(*stack->sock, msg, EC_MAXBUF, MSG_DONTWAIT, NULL);
+   /* move all mispredicted frames out of the way before storing any */
+   for (i = 0; i < cnt; i++)
+   {
+      hit[i] = FALSE;
+      if (i >= npred)
+      {
+         continue;
+      }
+      ehp = (ec_etherheadert *)&(*stack->rxbatch)[i];
+      len = (int)msg[i].msg_len - ETH_HEADERSIZE;
+      if ((len >= (int)EC_HEADERSIZE) && (ehp->etype == htons(ETH_P_ECAT)) &&
+          (((ec_comt *)iov[i][1].iov_base)->index == pred[i]))
+      {
+         hit[i] = TRUE;
+      }
+      else if (len > 0)
+      {
+         memcpy(&(*stack->rxbatch)[i][ETH_HEADERSIZE], iov[i][1].iov_base, len);
+      }
+   }
+   for (i = 0; i < cnt; i++)
+   {
+      ecx_cmsgtime(&msg[i].msg_hdr, &ts);
+      if (hit[i])
+      {
+         stack->rxcnt++;
+         ecx_markrcvd(port, stack, pred[i], (ec_etherheadert *)&(*stack->rxbatch)[i], &ts);
+      }
+      else
+      {
+         ecx_dispatchpkt(port, stack, (*stack->rxbatch)[i], (int)msg[i].msg_len, &ts);
+      }
+   }
 
-/** Fill buffer with ethernet header structure.
- * Destination MAC is always broadcast.
- * Ethertype is always ETH_P_ECAT.
- * @param[out] p = buffer
- */
-void ec_setupheader(void *p)
-{
-   ec_etherheadert *bp;
-   bp = p;
-   bp->da0 = htons(0xffff);
-   bp->da1 = htons(0xffff);
-   bp->da2 = htons(0xffff);
-   bp->sa0 = htons(priMAC[0]);
-   bp->sa1 = htons(priMAC[1]);
-   bp->sa2 = htons(priMAC[2]);
-   bp->etype = htons(ETH_P_ECAT);
+   return (cnt > 0) ? cnt : 0;
 }
 
-/** Get new frame identifier index and allocate corresponding rx buffer.
+/** Non blocking read of all frames in rx ring with PACKET_MMAP ring backend.
+ * Every frame is copied from the ring to its indexed rx buffer without a
+ * system call. Caller must hold rx_mutex.
  * @param[in] port        = port context struct
- * @return new index.
+ * @param[in] stack       = stack to read frames from
+ * @return number of frames read
  */
-uint8 ecx_getindex(ecx_portt *port)
+static int ecx_ring_recv(ecx_portt *port, ec_stackT *stack)
 {
-   uint8 idx;
-   uint8 cnt;
+   ec_ringT *ring = stack->ring;
+   struct tpacket2_hdr *hdr;
+   ec_timet ts;
+   int cnt;
 
-   pthread_mutex_lock(&(port->getindex_mutex));
-
-   idx = port->lastidx + 1;
-   /* index can't be larger than buffer array */
-   if (idx >= EC_MAXBUF)
+   if (port->timestamping)
    {
-      idx = 0;
+      ecx_draintxtime(stack);
    }
    cnt = 0;
-   /* try to find unused index */
-   while ((port->rxbufstat[idx] != EC_BUF_EMPTY) && (cnt < EC_MAXBUF))
+   for (;;)
    {
-      idx++;
-      cnt++;
-      if (idx >= EC_MAXBUF)
+      hdr = (struct tpacket2_hdr *)(ring->rx + (size_t)ring->rxhead * ring->framesize);
+      if (!(__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER))
       {
-         idx = 0;
+         break;
+      }
+      ts.tv_sec = hdr->tp_sec;
+      ts.tv_nsec = hdr->tp_nsec;
+      ecx_dispatchpkt(port, stack, (uint8 *)hdr + hdr->tp_mac, (int)hdr->tp_snaplen, &ts);
+      /* hand ring frame back to the kernel */
+      __atomic_store_n(&hdr->tp_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+      ring->rxhead++;
+      if (ring->rxhead >= ring->frames)
+      {
+         ring->rxhead = 0;
       }
+      cnt++;
    }
-   port->rxbufstat[idx] = EC_BUF_ALLOC;
-   if (port->redstate != ECT_RED_NONE)
-      port->redport->rxbufstat[idx] = EC_BUF_ALLOC;
-   port->lastidx = idx;
-
-   pthread_mutex_unlock(&(port->getindex_mutex));
 
-   return idx;
+   return cnt;
 }
 
-/** Set rx buffer status.
+/** Non blocking read of all frames in rx ring with AF_XDP backend.
+ * Caller must hold rx_mutex.
  * @param[in] port        = port context struct
- * @param[in] idx      = index in buffer array
- * @param[in] bufstat  = status to set
+ * @param[in] stack       = stack to read frames from
+ * @return number of frames read
  */
-void ecx_setbufstat(ecx_portt *port, uint8 idx, int bufstat)
+static int ecx_afxdp_recv(ecx_portt *port, ec_stackT *stack)
 {
-   port->rxbufstat[idx] = bufstat;
-   if (port->redstate != ECT_RED_NONE)
-      port->redport->rxbufstat[idx] = bufstat;
+   ec_timet ts;
+   uint8 *frame;
+   int cnt, len;
+
+   ts.tv_sec = 0;
+   ts.tv_nsec = 0;
+   cnt = 0;
+   while ((frame = ecx_xdp_recv(stack->xdp, &len)) != NULL)
+   {
+      ecx_dispatchpkt(port, stack, frame, len, &ts);
+      ecx_xdp_release(stack->xdp);
+      cnt++;
+   }
+
+   return cnt;
 }
 
-/** Transmit buffer over socket (non blocking).
+/** Non blocking read of all responses of the simulated segment.
+ * Caller must hold rx_mutex.
  * @param[in] port        = port context struct
- * @param[in] idx         = index in tx buffer array
- * @param[in] stacknumber  = 0=Primary 1=Secondary stack
- * @return socket send result
+ * @param[in] stack       = stack to read frames from
+ * @return number of frames read
  */
-int ecx_outframe(ecx_portt *port, uint8 idx, int stacknumber)
+static int ecx_simnic_recv(ecx_portt *port, ec_stackT *stack)
 {
-   int lp, rval;
-   ec_stackT *stack;
+   ec_simT *sim = (ec_simT *)stack->priv;
+   ec_timet ts;
+   uint8 *frame;
+   int cnt, len;
 
-   if (!stacknumber)
-   {
-      stack = &(port->stack);
-   }
-   else
-   {
-      stack = &(port->redport->stack);
-   }
-   lp = (*stack->txbuflength)[idx];
-   (*stack->rxbufstat)[idx] = EC_BUF_TX;
-   rval = send(*stack->sock, (*stack->txbuf)[idx], lp, 0);
-   if (rval == -1)
+   cnt = 0;
+   while ((frame = ecx_sim_recv(sim, &len, &ts)) != NULL)
    {
-      (*stack->rxbufstat)[idx] = EC_BUF_EMPTY;
+      ecx_dispatchpkt(port, stack, frame, len, &ts);
+      ecx_sim_release(sim);
+      cnt++;
    }
 
-   return rval;
+   return cnt;
 }
 
-/** Transmit buffer over socket (non blocking).
+/** Non blocking read of all answers of the replay backend.
+ * Caller must hold rx_mutex.
  * @param[in] port        = port context struct
- * @param[in] idx = index in tx buffer array
- * @return socket send result
+ * @param[in] stack       = stack to read frames from
+ * @return number of frames read
  */
-int ecx_outframe_red(ecx_portt *port, uint8 idx)
+static int ecx_replaynic_recv(ecx_portt *port, ec_stackT *stack)
 {
-   ec_comt *datagramP;
-   ec_etherheadert *ehp;
-   int rval;
+   ec_replayT *replay = (ec_replayT *)stack->priv;
+   ec_timet ts;
+   uint8 *frame;
+   int cnt, len;
 
-   ehp = (ec_etherheadert *)&(port->txbuf[idx]);
-   /* rewrite MAC source address 1 to primary */
-   ehp->sa1 = htons(priMAC[1]);
-   /* transmit over primary socket*/
-   rval = ecx_outframe(port, idx, 0);
-   if (port->redstate != ECT_RED_NONE)
+   cnt = 0;
+   while ((frame = ecx_replay_recv(replay, &len, &ts)) != NULL)
    {
-      pthread_mutex_lock(&(port->tx_mutex));
-      ehp = (ec_etherheadert *)&(port->txbuf2);
-      /* use dummy frame for secondary socket transmit (BRD) */
-      datagramP = (ec_comt *)&(port->txbuf2[ETH_HEADERSIZE]);
-      /* write index to frame */
-      datagramP->index = idx;
-      /* rewrite MAC source address 1 to secondary */
-      ehp->sa1 = htons(secMAC[1]);
-      /* transmit over secondary socket */
-      port->redport->rxbufstat[idx] = EC_BUF_TX;
-      if (send(port->redport->sockhandle, &(port->txbuf2), port->txbuflength2, 0) == -1)
-      {
-         port->redport->rxbufstat[idx] = EC_BUF_EMPTY;
-      }
-      pthread_mutex_unlock(&(port->tx_mutex));
+      ecx_dispatchpkt(port, stack, frame, len, &ts);
+      ecx_replay_release(replay);
+      cnt++;
    }
 
-   return rval;
+   return cnt;
 }
 
-/** Non blocking read of socket. Put frame in temporary buffer.
+/** Non blocking read of all pending frames with the NIC backend of the port.
+ * The default socket backend is called directly. Caller must hold rx_mutex.
  * @param[in] port        = port context struct
- * @param[in] stacknumber = 0=primary 1=secondary stack
- * @return >0 if frame is available and read
+ * @param[in] stack       = stack to read frames from
+ * @return number of frames read
  */
-static int ecx_recvpkt(ecx_portt *port, int stacknumber)
+static inline int ecx_nicrecv(ecx_portt *port, ec_stackT *stack)
 {
-   int lp, bytesrx;
-   ec_stackT *stack;
-
-   if (!stacknumber)
-   {
-      stack = &(port->stack);
-   }
-   else
+   if (port->nicops == &ecx_nicops_socket)
    {
-      stack = &(port->redport->stack);
+      return ecx_socket_recv(port, stack);
    }
-   lp = sizeof(port->tempinbuf);
-   bytesrx = recv(*stack->sock, (*stack->tempbuf), lp, MSG_DONTWAIT);
-   port->tempinbufs = bytesrx;
 
-   return (bytesrx > 0);
+   return port->nicops->recv(port, stack);
+}
+
+/** Get workcounter of received frame and mark its buffer completed.
+ * @param[in] stack       = stack the frame was received on
+ * @param[in] idx         = index of frame
+ * @return workcounter
+ */
+static int ecx_completeframe(ec_stackT *stack, uint8 idx)
+{
+   ec_bufT *rxbuf;
+   uint16 l;
+
+   rxbuf = &(*stack->rxbuf)[idx];
+   l = (*rxbuf)[0] + ((uint16)((*rxbuf)[1] & 0x0f) << 8);
+   /* mark as completed */
+   ecx_putbufstat(&(*stack->rxbufstat)[idx], EC_BUF_COMPLETE);
+   /* return WKC */
+   return ((*rxbuf)[l] + ((uint16)(*rxbuf)[l + 1] << 8));
 }
 
 /** Non blocking receive frame function. Uses RX buffer and index to combine
  * read frame with transmitted frame. To compensate for received frames that
  * are out-of-order all frames are stored in their respective indexed buffer.
  * If a frame was placed in the buffer previously, the function retrieves it
- * from that buffer index without calling ec_recvpkt. If the requested index
- * is not already in the buffer it calls ec_recvpkt to fetch it. There are
- * three options now, 1 no frame read, so exit. 2 frame read but other
- * than requested index, store in buffer and exit. 3 frame read with matching
- * index, store in buffer, set completed flag in buffer status and exit.
+ * from that buffer index without reading the socket. If the requested index
+ * is not already in the buffer all frames pending on the socket are read and
+ * stored in their indexed buffers. There are three options now, 1 no frame
+ * read, so exit. 2 frames read but not the requested index, exit.
+ * 3 frame with matching index read, set completed flag in buffer status and
+ * exit.
  *
  * @param[in] port        = port context struct
  * @param[in] idx         = requested index of frame
@@ -377,13 +1743,8 @@ static int ecx_recvpkt(ecx_portt *port, int stacknumber)
  */
 int ecx_inframe(ecx_portt *port, uint8 idx, int stacknumber)
 {
-   uint16 l;
    int rval;
-   uint8 idxf;
-   ec_etherheadert *ehp;
-   ec_comt *ecp;
    ec_stackT *stack;
-   ec_bufT *rxbuf;
 
    if (!stacknumber)
    {
@@ -394,70 +1755,28 @@ int ecx_inframe(ecx_portt *port, uint8 idx, int stacknumber)
       stack = &(port->redport->stack);
    }
    rval = EC_NOFRAME;
-   rxbuf = &(*stack->rxbuf)[idx];
    /* check if requested index is already in buffer ? */
-   if ((idx < EC_MAXBUF) && ((*stack->rxbufstat)[idx] == EC_BUF_RCVD))
+   if ((idx < EC_MAXBUF) && (ecx_getbufstat(&(*stack->rxbufstat)[idx]) == EC_BUF_RCVD))
    {
-      l = (*rxbuf)[0] + ((uint16)((*rxbuf)[1] & 0x0f) << 8);
-      /* return WKC */
-      rval = ((*rxbuf)[l] + ((uint16)(*rxbuf)[l + 1] << 8));
-      /* mark as completed */
-      (*stack->rxbufstat)[idx] = EC_BUF_COMPLETE;
+      rval = ecx_completeframe(stack, idx);
    }
    else
    {
       pthread_mutex_lock(&(port->rx_mutex));
       /* check again if requested index is already in buffer ?
        * other task might have reveived it befor we grabbed mutex */
-      if ((idx < EC_MAXBUF) && ((*stack->rxbufstat)[idx] == EC_BUF_RCVD))
+      if ((idx < EC_MAXBUF) && (ecx_getbufstat(&(*stack->rxbufstat)[idx]) == EC_BUF_RCVD))
       {
-         l = (*rxbuf)[0] + ((uint16)((*rxbuf)[1] & 0x0f) << 8);
-         /* return WKC */
-         rval = ((*rxbuf)[l] + ((uint16)(*rxbuf)[l + 1] << 8));
-         /* mark as completed */
-         (*stack->rxbufstat)[idx] = EC_BUF_COMPLETE;
+         rval = ecx_completeframe(stack, idx);
       }
-      /* non blocking call to retrieve frame from socket */
-      else if (ecx_recvpkt(port, stacknumber))
+      /* non blocking call to retrieve all pending frames from socket */
+      else if (ecx_nicrecv(port, stack))
       {
          rval = EC_OTHERFRAME;
-         ehp = (ec_etherheadert *)(stack->tempbuf);
-         /* check if it is an EtherCAT frame */
-         if (ehp->etype == htons(ETH_P_ECAT))
+         /* found requested index ? */
+         if ((idx < EC_MAXBUF) && (ecx_getbufstat(&(*stack->rxbufstat)[idx]) == EC_BUF_RCVD))
          {
-            stack->rxcnt++;
-            ecp = (ec_comt *)(&(*stack->tempbuf)[ETH_HEADERSIZE]);
-            l = etohs(ecp->elength) & 0x0fff;
-            idxf = ecp->index;
-            /* found index equals requested index ? */
-            if (idxf == idx)
-            {
-               /* yes, put it in the buffer array (strip ethernet header) */
-               memcpy(rxbuf, &(*stack->tempbuf)[ETH_HEADERSIZE], (*stack->txbuflength)[idx] - ETH_HEADERSIZE);
-               /* return WKC */
-               rval = ((*rxbuf)[l] + ((uint16)((*rxbuf)[l + 1]) << 8));
-               /* mark as completed */
-               (*stack->rxbufstat)[idx] = EC_BUF_COMPLETE;
-               /* store MAC source word 1 for redundant routing info */
-               (*stack->rxsa)[idx] = ntohs(ehp->sa1);
-            }
-            else
-            {
-               /* check if index exist and someone is waiting for it */
-               if (idxf < EC_MAXBUF && (*stack->rxbufstat)[idxf] == EC_BUF_TX)
-               {
-                  rxbuf = &(*stack->rxbuf)[idxf];
-                  /* put it in the buffer array (strip ethernet header) */
-                  memcpy(rxbuf, &(*stack->tempbuf)[ETH_HEADERSIZE], (*stack->txbuflength)[idxf] - ETH_HEADERSIZE);
-                  /* mark as received */
-                  (*stack->rxbufstat)[idxf] = EC_BUF_RCVD;
-                  (*stack->rxsa)[idxf] = ntohs(ehp->sa1);
-               }
-               else
-               {
-                  /* strange things happened */
-               }
-            }
+            rval = ecx_completeframe(stack, idx);
          }
       }
       pthread_mutex_unlock(&(port->rx_mutex));
@@ -467,6 +1786,55 @@ int ecx_inframe(ecx_portt *port, uint8 idx, int stacknumber)
    return rval;
 }
 
+/** Block in ppoll() until a socket is readable or the slice expires.
+ * @param[in] port        = port context struct
+ * @param[in] fds         = sockets to wait for
+ * @param[in] pollcnt     = number of sockets
+ * @param[in] slice       = maximum time to block
+ */
+static void ecx_waitsleep(ecx_portt *port, struct pollfd *fds, int pollcnt, struct timespec *slice)
+{
+   ec_timet tstart, tend, tdiff;
+
+   port->waitstat.sleeps++;
+   osal_get_monotonic_time(&tstart);
+   ppoll(fds, pollcnt, slice, NULL);
+   osal_get_monotonic_time(&tend);
+   osal_time_diff(&tstart, &tend, &tdiff);
+   port->waitstat.sleepns += (uint64)tdiff.tv_sec * 1000000000 + tdiff.tv_nsec;
+}
+
+/** Block in epoll until a socket is readable or the slice expires.
+ * @param[in] port        = port context struct
+ * @param[in] events      = event buffer
+ * @param[in] maxevents   = size of event buffer
+ */
+static void ecx_waitepoll(ecx_portt *port, struct epoll_event *events, int maxevents)
+{
+   ec_timet tstart, tend, tdiff;
+
+   port->waitstat.sleeps++;
+   osal_get_monotonic_time(&tstart);
+#ifdef __NR_epoll_pwait2
+   struct __kernel_timespec ts;
+
+   if (port->epollpwait2)
+   {
+      ts.tv_sec = port->waitslice / 1000000;
+      ts.tv_nsec = (port->waitslice % 1000000) * 1000;
+      syscall(__NR_epoll_pwait2, port->epollfd, events, maxevents, &ts, NULL, 0);
+   }
+   else
+#endif
+   {
+      /* no sub millisecond timeout available */
+      epoll_wait(port->epollfd, events, maxevents, port->waitslice / 1000 + ((port->waitslice % 1000) ? 1 : 0));
+   }
+   osal_get_monotonic_time(&tend);
+   osal_time_diff(&tstart, &tend, &tdiff);
+   port->waitstat.sleepns += (uint64)tdiff.tv_sec * 1000000000 + tdiff.tv_nsec;
+}
+
 /** Blocking redundant receive frame function. If redundant mode is not active then
  * it skips the secondary stack and redundancy functions. In redundant mode it waits
  * for both (primary and secondary) frames to come in. The result goes in an decision
@@ -481,20 +1849,20 @@ int ecx_inframe(ecx_portt *port, uint8 idx, int stacknumber)
  */
 static int ecx_waitinframe_red(ecx_portt *port, uint8 idx, osal_timert *timer)
 {
-   osal_timert timer2;
+   osal_timert timer2, spintimer;
    int wkc = EC_NOFRAME;
    int wkc2 = EC_NOFRAME;
    int primrx, secrx;
+   ec_timet tstart, tend, tdiff;
 
    /* if not in redundant mode then always assume secondary is OK */
    if (port->redstate == ECT_RED_NONE)
       wkc2 = 0;
-   /* use ppoll to reduce busy_polling */
    struct pollfd fds[2];
-   struct pollfd *fdsp;
-   int poll_err = 0;
+   struct epoll_event events[2];
    struct timespec timeout_spec = {0, 0};
-   timeout_spec.tv_nsec = 50 * 1000;
+   timeout_spec.tv_sec = port->waitslice / 1000000;
+   timeout_spec.tv_nsec = (port->waitslice % 1000000) * 1000;
    ec_stackT *stack;
    stack = &(port->stack);
    fds[0].fd = *stack->sock;
@@ -507,25 +1875,70 @@ static int ecx_waitinframe_red(ecx_portt *port, uint8 idx, osal_timert *timer)
       fds[1].fd = *stack->sock;
       fds[1].events = POLLIN;
    }
-   fdsp = &fds[0];
-   do
+   port->waitstat.waits++;
+   osal_get_monotonic_time(&tstart);
+   if (port->waitmode == ECT_WAIT_ADAPTIVE)
    {
-      poll_err = ppoll(fdsp, pollcnt, &timeout_spec, NULL);
-      if (poll_err >= 0)
+      osal_timer_start(&spintimer, port->waitspin);
+   }
+   /* frames read along with an earlier one are already in the rx buffers,
+      block only if the frame is not */
+   wkc = ecx_inframe(port, idx, 0);
+   if (port->redstate != ECT_RED_NONE)
+      wkc2 = ecx_inframe(port, idx, 1);
+   if ((wkc > EC_NOFRAME) && (wkc2 > EC_NOFRAME))
+   {
+      port->waitstat.buffered++;
+   }
+   while (((wkc <= EC_NOFRAME) || (wkc2 <= EC_NOFRAME)) && !osal_timer_is_expired(timer))
+   {
+      switch (port->waitmode)
+      {
+         case ECT_WAIT_SPIN:
+            port->waitstat.spins++;
+            break;
+         case ECT_WAIT_BUSYPOLL:
+            port->waitstat.spins++;
+            /* rings are read without system call, let the kernel busy poll */
+            if ((port->nicops == &ecx_nicops_mmap) || (port->nicops == &ecx_nicops_xdp))
+            {
+               recv(fds[0].fd, NULL, 0, MSG_DONTWAIT);
+            }
+            break;
+         case ECT_WAIT_ADAPTIVE:
+            if (!osal_timer_is_expired(&spintimer))
+            {
+               port->waitstat.spins++;
+               break;
+            }
+            ecx_waitsleep(port, fds, pollcnt, &timeout_spec);
+            break;
+         case ECT_WAIT_EPOLL:
+            ecx_waitepoll(port, events, pollcnt);
+            break;
+         default:
+            ecx_waitsleep(port, fds, pollcnt, &timeout_spec);
+            break;
+      }
+      /* only read frame if not already in */
+      if (wkc <= EC_NOFRAME)
+         wkc = ecx_inframe(port, idx, 0);
+      /* only try secondary if in redundant mode */
+      if (port->redstate != ECT_RED_NONE)
       {
          /* only read frame if not already in */
-         if (wkc <= EC_NOFRAME)
-            wkc = ecx_inframe(port, idx, 0);
-         /* only try secondary if in redundant mode */
-         if (port->redstate != ECT_RED_NONE)
-         {
-            /* only read frame if not already in */
-            if (wkc2 <= EC_NOFRAME)
-               wkc2 = ecx_inframe(port, idx, 1);
-         }
+         if (wkc2 <= EC_NOFRAME)
+            wkc2 = ecx_inframe(port, idx, 1);
       }
       /* wait for both frames to arrive or timeout */
-   } while (((wkc <= EC_NOFRAME) || (wkc2 <= EC_NOFRAME)) && !osal_timer_is_expired(timer));
+   }
+   if ((wkc <= EC_NOFRAME) || (wkc2 <= EC_NOFRAME))
+   {
+      port->waitstat.timeouts++;
+   }
+   osal_get_monotonic_time(&tend);
+   osal_time_diff(&tstart, &tend, &tdiff);
+   port->waitstat.waitns += (uint64)tdiff.tv_sec * 1000000000 + tdiff.tv_nsec;
    /* only do redundant functions when in redundant mode */
    if (port->redstate != ECT_RED_NONE)
    {
@@ -540,22 +1953,21 @@ static int ecx_waitinframe_red(ecx_portt *port, uint8 idx, osal_timert *timer)
       /* normal situation in redundant mode */
       if (((primrx == RX_SEC) && (secrx == RX_PRIM)))
       {
-         /* copy secondary buffer to primary */
-         memcpy(&(port->rxbuf[idx]), &(port->redport->rxbuf[idx]), port->txbuflength[idx] - ETH_HEADERSIZE);
+         /* secondary socket received into primary buffer */
          wkc = wkc2;
       }
       /* primary socket got nothing or primary frame, and secondary socket got secondary frame */
       /* we need to resend TX packet */
-      if (((primrx == 0) && (secrx == RX_SEC)) ||
-          ((primrx == RX_PRIM) && (secrx == RX_SEC)))
+      else if (((primrx == 0) && (secrx == RX_SEC)) ||
+               ((primrx == RX_PRIM) && (secrx == RX_SEC)))
       {
          /* If both primary and secondary have partial connection retransmit the primary received
           * frame over the secondary socket. The result from the secondary received frame is a combined
           * frame that traversed all slaves in standard order. */
          if ((primrx == RX_PRIM) && (secrx == RX_SEC))
          {
-            /* copy primary rx to tx buffer */
-            memcpy(&(port->txbuf[idx][ETH_HEADERSIZE]), &(port->rxbuf[idx]), port->txbuflength[idx] - ETH_HEADERSIZE);
+            /* copy primary rx, received into secondary buffer, to tx buffer */
+            memcpy(&(port->txbuf[idx][ETH_HEADERSIZE]), &(port->redport->rxbuf[idx]), port->txbuflength[idx] - ETH_HEADERSIZE);
          }
          osal_timer_start(&timer2, EC_TIMEOUTRET);
          /* resend secondary tx */
@@ -567,10 +1979,18 @@ static int ecx_waitinframe_red(ecx_portt *port, uint8 idx, osal_timert *timer)
          } while ((wkc2 <= EC_NOFRAME) && !osal_timer_is_expired(&timer2));
          if (wkc2 > EC_NOFRAME)
          {
-            /* copy secondary result to primary rx buffer */
-            memcpy(&(port->rxbuf[idx]), &(port->redport->rxbuf[idx]), port->txbuflength[idx] - ETH_HEADERSIZE);
+            /* secondary result is already in primary rx buffer */
             wkc = wkc2;
          }
+         else if (wkc > EC_NOFRAME)
+         {
+            memcpy(&(port->rxbuf[idx]), &(port->redport->rxbuf[idx]), port->txbuflength[idx] - ETH_HEADERSIZE);
+         }
+      }
+      else if (wkc > EC_NOFRAME)
+      {
+         /* primary socket received into secondary buffer */
+         memcpy(&(port->rxbuf[idx]), &(port->redport->rxbuf[idx]), port->txbuflength[idx] - ETH_HEADERSIZE);
       }
    }
 
@@ -596,6 +2016,27 @@ int ecx_waitinframe(ecx_portt *port, uint8 idx, int timeout)
    return wkc;
 }
 
+/** Non blocking receive frame function. Reads all frames pending on the
+ * socket and returns the work counter if the frame with the requested index
+ * is among them or was received before. Frames are not polled in redundant
+ * mode, they need the decision of ecx_waitinframe() over both stacks.
+ * @param[in] port        = port context struct
+ * @param[in] idx         = requested index of frame
+ * @return Workcounter if the frame is received, otherwise EC_NOFRAME.
+ */
+int ecx_pollinframe(ecx_portt *port, uint8 idx)
+{
+   int wkc;
+
+   if (port->redstate != ECT_RED_NONE)
+   {
+      return EC_NOFRAME;
+   }
+   wkc = ecx_inframe(port, idx, 0);
+
+   return (wkc > EC_NOFRAME) ? wkc : EC_NOFRAME;
+}
+
 /** Blocking send and receive frame function. Used for non processdata frames.
  * A datagram is build into a frame and transmitted via this function. It waits
  * for an answer and returns the workcounter. The function retries if time is
@@ -634,3 +2075,96 @@ int ecx_srconfirm(ecx_portt *port, uint8 idx, int timeout)
 
    return wkc;
 }
+
+/** Get NIC timestamps of frame. Must be called before the buffer is
+ * released. In redundant mode the receive time of the secondary port is
+ * used if the frame did not return on the primary port.
+ * @param[in]  port        = port context struct
+ * @param[in]  idx         = index of frame
+ * @param[out] txtime      = time frame was sent
+ * @param[out] rxtime      = time frame was received
+ * @return 1 if both timestamps are available, otherwise 0
+ */
+int ecx_getframetime(ecx_portt *port, uint8 idx, ec_timet *txtime, ec_timet *rxtime)
+{
+   if ((idx >= EC_MAXBUF) || !port->timestamping)
+   {
+      return 0;
+   }
+   /* hardware tx timestamp can be reported after the frame returned */
+   if (!osal_timespecisset(&(port->txtime[idx])))
+   {
+      pthread_mutex_lock(&(port->rx_mutex));
+      ecx_nicrecv(port, &(port->stack));
+      pthread_mutex_unlock(&(port->rx_mutex));
+   }
+   *txtime = port->txtime[idx];
+   *rxtime = port->rxtime[idx];
+   if (!osal_timespecisset(rxtime) && (port->redstate != ECT_RED_NONE))
+   {
+      *rxtime = port->redport->rxtime[idx];
+   }
+
+   return osal_timespecisset(txtime) && osal_timespecisset(rxtime);
+}
+
+/** Raw socket backend, one system call per batch of frames. Default. */
+const ecx_nicopst ecx_nicops_socket =
+{
+   "socket", FALSE, ecx_socket_open, ecx_socket_close, ecx_socket_send, ecx_socket_recv
+};
+
+/** Raw socket backend with PACKET_MMAP rx and tx rings */
+const ecx_nicopst ecx_nicops_mmap =
+{
+   "mmap", TRUE, ecx_ring_open, ecx_ring_close, ecx_ring_send, ecx_ring_recv
+};
+
+/** AF_XDP backend, see nicdrv_xdp.c */
+const ecx_nicopst ecx_nicops_xdp =
+{
+   "xdp", TRUE, ecx_afxdp_open, ecx_afxdp_close, ecx_afxdp_send, ecx_afxdp_recv
+};
+
+/** Simulated segment backend, see nicdrv_sim.c */
+const ecx_nicopst ecx_nicops_sim =
+{
+   "sim", TRUE, ecx_simnic_open, ecx_simnic_close, ecx_simnic_send, ecx_simnic_recv
+};
+
+/** Replay backend, see nicdrv_replay.c */
+const ecx_nicopst ecx_nicops_replay =
+{
+   "replay", TRUE, ecx_replaynic_open, ecx_replaynic_close, ecx_replaynic_send, ecx_replaynic_recv
+};
+
+/** NIC backends that can be selected by name */
+static const ecx_nicopst *const ecx_nicbackends[] =
+{
+   &ecx_nicops_socket,
+   &ecx_nicops_mmap,
+   &ecx_nicops_xdp,
+   &ecx_nicops_sim,
+   &ecx_nicops_replay,
+   NULL
+};
+
+/** Find NIC backend by name, f.e. to select it from the command line.
+ * Assign the result to port->nicops before ecx_init().
+ * @param[in] name        = backend name, "socket", "mmap", "xdp", "sim" or "replay"
+ * @return backend or NULL if not found
+ */
+const ecx_nicopst *ecx_getnicops(const char *name)
+{
+   int i;
+
+   for (i = 0; ecx_nicbackends[i] != NULL; i++)
+   {
+      if (strcmp(ecx_nicbackends[i]->name, name) == 0)
+      {
+         return ecx_nicbackends[i];
+      }
+   }
+
+   return NULL;
+}
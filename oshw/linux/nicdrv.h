@@ -17,6 +17,93 @@ extern "C" {
 #endif
 
 #include <pthread.h>
+#include <stddef.h>
+
+/** NIC access modes, select with ecx_portt.nicmode before ecx_init.
+ * Shorthand for the built in NIC backends, see ecx_portt.nicops */
+enum
+{
+   /** raw socket, frames sent with sendmmsg() and received with recvmmsg()
+    * in batches */
+   ECT_NIC_SOCKET,
+   /** raw socket with PACKET_MMAP rx and tx rings */
+   ECT_NIC_MMAP,
+   /** AF_XDP socket bound to ecx_portt.nicqueue */
+   ECT_NIC_XDP
+};
+
+/** Receive wait modes, select with ecx_setwaitmode() */
+enum
+{
+   /** block in ppoll() in slices (default) */
+   ECT_WAIT_POLL,
+   /** spin on non blocking reads */
+   ECT_WAIT_SPIN,
+   /** spin with kernel busy polling of the NIC queue */
+   ECT_WAIT_BUSYPOLL,
+   /** spin for a while, then block in ppoll() */
+   ECT_WAIT_ADAPTIVE,
+   /** block in epoll in slices */
+   ECT_WAIT_EPOLL
+};
+
+/** Receive wait statistics of a port */
+typedef struct
+{
+   /** number of blocking receive calls */
+   uint64 waits;
+   /** number of blocking receive calls that found the frame already
+    * received with an earlier one, without spinning or blocking */
+   uint64 buffered;
+   /** number of wait loops without blocking, only counted while no frame
+    * is pending */
+   uint64 spins;
+   /** number of times blocked in the kernel, only counted while no frame
+    * is pending */
+   uint64 sleeps;
+   /** number of blocking receive calls that timed out */
+   uint64 timeouts;
+   /** total time in blocking receive calls in ns */
+   uint64 waitns;
+   /** part of waitns blocked in the kernel */
+   uint64 sleepns;
+} ec_waitstatT;
+
+/** AF_XDP socket state, private to nicdrv_xdp.c */
+typedef struct ec_xdp ec_xdpT;
+
+/** simulated segment state, private to nicdrv_sim.c */
+typedef struct ec_sim ec_simT;
+
+/** replay state, private to nicdrv_replay.c */
+typedef struct ec_replay ec_replayT;
+
+/** frame capture state, private to nicdrv_pcap.c */
+typedef struct ec_pcap ec_pcapT;
+
+/** NIC backend, see ecx_nicopst */
+typedef struct ecx_nicops ecx_nicopst;
+
+/** PACKET_MMAP ring state of one socket */
+typedef struct
+{
+   /** mapped rx and tx ring area, NULL if not used */
+   uint8 *map;
+   /** size of mapped area */
+   size_t maplen;
+   /** first frame of rx ring */
+   uint8 *rx;
+   /** first frame of tx ring */
+   uint8 *tx;
+   /** size of one ring frame */
+   int framesize;
+   /** number of frames per ring */
+   int frames;
+   /** next rx ring frame to read */
+   int rxhead;
+   /** next tx ring frame to fill */
+   int txhead;
+} ec_ringT;
 
 /** pointer structure to Tx and Rx stacks */
 typedef struct
@@ -27,16 +114,30 @@ typedef struct
    ec_bufT (*txbuf)[EC_MAXBUF];
    /** tx buffer lengths */
    int (*txbuflength)[EC_MAXBUF];
-   /** temporary receive buffer */
-   ec_bufT *tempbuf;
+   /** receive buffers for draining the socket */
+   ec_bufT (*rxbatch)[EC_MAXBUF];
    /** rx buffers */
    ec_bufT (*rxbuf)[EC_MAXBUF];
    /** rx buffer status fields */
    int (*rxbufstat)[EC_MAXBUF];
    /** received MAC source address (middle word) */
    int (*rxsa)[EC_MAXBUF];
+   /** transmit timestamps */
+   ec_timet (*txtime)[EC_MAXBUF];
+   /** receive timestamps */
+   ec_timet (*rxtime)[EC_MAXBUF];
    /** number of received frames */
    uint64 rxcnt;
+   /** send sequence number of waiting rx buffers */
+   uint32 txseq[EC_MAXBUF];
+   /** number of sent frames */
+   uint32 txcnt;
+   /** mmap ring, only used in ECT_NIC_MMAP mode */
+   ec_ringT *ring;
+   /** AF_XDP socket, only used in ECT_NIC_XDP mode */
+   ec_xdpT *xdp;
+   /** private state of other NIC backends */
+   void *priv;
 } ec_stackT;
 
 /** pointer structure to buffers for redundant port */
@@ -50,8 +151,14 @@ typedef struct
    int rxbufstat[EC_MAXBUF];
    /** rx MAC source address */
    int rxsa[EC_MAXBUF];
-   /** temporary rx buffer */
-   ec_bufT tempinbuf;
+   /** rx buffers for draining the socket */
+   ec_bufT rxbatch[EC_MAXBUF];
+   /** tx timestamps */
+   ec_timet txtime[EC_MAXBUF];
+   /** rx timestamps */
+   ec_timet rxtime[EC_MAXBUF];
+   /** mmap ring */
+   ec_ringT ring;
 } ecx_redportt;
 
 /** pointer structure to buffers, vars and mutexes for port instantiation */
@@ -65,10 +172,10 @@ typedef struct
    int rxbufstat[EC_MAXBUF];
    /** rx MAC source address */
    int rxsa[EC_MAXBUF];
-   /** temporary rx buffer */
-   ec_bufT tempinbuf;
-   /** temporary rx buffer status */
-   int tempinbufs;
+   /** rx buffers for draining the socket */
+   ec_bufT rxbatch[EC_MAXBUF];
+   /** rx buffers holding data between frames, see ecx_pinrxbuf() */
+   uint8 rxpinned[EC_MAXBUF];
    /** transmit buffers */
    ec_bufT txbuf[EC_MAXBUF];
    /** transmit buffer lengths */
@@ -79,27 +186,96 @@ typedef struct
    int txbuflength2;
    /** last used frame index */
    uint8 lastidx;
+   /** frame index allocation bitmap, bit set if index is in use */
+   uint32 idxmap[(EC_MAXBUF + 31) / 32];
    /** current redundancy state */
    int redstate;
    /** pointer to redundancy port and buffers */
    ecx_redportt *redport;
-   pthread_mutex_t getindex_mutex;
+   /** NIC backend, set before ecx_init, if NULL it is selected by nicmode */
+   const ecx_nicopst *nicops;
+   /** NIC access mode, ECT_NIC_SOCKET (default), ECT_NIC_MMAP or ECT_NIC_XDP */
+   int nicmode;
+   /** NIC queue used in ECT_NIC_XDP mode */
+   int nicqueue;
+   /** enable SO_TIMESTAMPING frame timestamps, set before ecx_init */
+   int timestamping;
+   /** tx timestamps, zero if not available */
+   ec_timet txtime[EC_MAXBUF];
+   /** rx timestamps, zero if not available */
+   ec_timet rxtime[EC_MAXBUF];
+   /** receive wait mode, set with ecx_setwaitmode() */
+   int waitmode;
+   /** blocking wait slice or busy poll time in us */
+   int waitslice;
+   /** spin time before blocking in ECT_WAIT_ADAPTIVE mode in us */
+   int waitspin;
+   /** epoll instance used in ECT_WAIT_EPOLL mode */
+   int epollfd;
+   /** TRUE if the kernel has epoll_pwait2() for slices below 1 ms */
+   int epollpwait2;
+   /** receive wait statistics */
+   ec_waitstatT waitstat;
+   /** mmap ring */
+   ec_ringT ring;
+   /** frame capture, NULL if off, see ecx_capture_start() */
+   ec_pcapT *pcap;
+   /** number of threads using pcap */
+   int pcapbusy;
    pthread_mutex_t tx_mutex;
    pthread_mutex_t rx_mutex;
 } ecx_portt;
 
+/** NIC backend operations. A backend moves frames between the indexed tx
+ * and rx buffers of a stack and the wire, buffer and index handling and
+ * redundancy are done by nicdrv.c. All functions are called per stack.
+ */
+struct ecx_nicops
+{
+   /** backend name */
+   const char *name;
+   /** TRUE if send must be serialized with tx_mutex */
+   boolean txlock;
+   /** open backend on NIC ifname, set *stack->sock to a pollable file
+    * descriptor or -1, return 0 if succeeded */
+   int (*open)(ecx_portt *port, ec_stackT *stack, const char *ifname);
+   /** close backend */
+   void (*close)(ecx_portt *port, ec_stackT *stack);
+   /** send frames of index list, if dummy is TRUE send txbuf2 with the
+    * index from the list instead, return number of frames sent */
+   int (*send)(ecx_portt *port, ec_stackT *stack, const uint8 *idxlist, int cnt, int dummy);
+   /** non blocking read of all pending frames into their indexed rx
+    * buffers, called with rx_mutex held, return number of frames read */
+   int (*recv)(ecx_portt *port, ec_stackT *stack);
+};
+
+extern const ecx_nicopst ecx_nicops_socket;
+extern const ecx_nicopst ecx_nicops_mmap;
+extern const ecx_nicopst ecx_nicops_xdp;
+extern const ecx_nicopst ecx_nicops_sim;
+extern const ecx_nicopst ecx_nicops_replay;
+
 extern const uint16 priMAC[3];
 extern const uint16 secMAC[3];
 
 void ec_setupheader(void *p);
+const ecx_nicopst *ecx_getnicops(const char *name);
 int ecx_setupnic(ecx_portt *port, const char *ifname, int secondary);
 int ecx_closenic(ecx_portt *port);
+int ecx_setwaitmode(ecx_portt *port, int mode, int slice, int spin);
+int ecx_capture_start(ecx_portt *port, const char *filename, int frames);
+int ecx_capture_stop(ecx_portt *port);
+int ecx_capture_stats(ecx_portt *port, uint64 *captured, uint64 *dropped);
 void ecx_setbufstat(ecx_portt *port, uint8 idx, int bufstat);
+void ecx_pinrxbuf(ecx_portt *port, uint8 idx, int pinned);
 uint8 ecx_getindex(ecx_portt *port);
 int ecx_outframe(ecx_portt *port, uint8 idx, int sock);
 int ecx_outframe_red(ecx_portt *port, uint8 idx);
+int ecx_outframes_red(ecx_portt *port, const uint8 *idxlist, int cnt);
 int ecx_waitinframe(ecx_portt *port, uint8 idx, int timeout);
+int ecx_pollinframe(ecx_portt *port, uint8 idx);
 int ecx_srconfirm(ecx_portt *port, uint8 idx, int timeout);
+int ecx_getframetime(ecx_portt *port, uint8 idx, ec_timet *txtime, ec_timet *rxtime);
 
 #ifdef __cplusplus
 }
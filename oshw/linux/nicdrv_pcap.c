@@ -0,0 +1,367 @@
+/*
+ * This software is dual-licensed under GPLv3 and a commercial
+ * license. See the file LICENSE.md distributed with this software for
+ * full license information.
+ */
+
+/** \file
+ * \brief
+ * EtherCAT frame capture.
+ *
+ * Used by nicdrv.c to record every sent and received frame of a port in a
+ * pcapng file, see ecx_capture_start(). The real time path only copies the
+ * frame and a timestamp into a preallocated ring, it takes no lock and makes
+ * no system call. A writer thread empties the ring into the file.
+ *
+ * The ring has multiple producers, frames are sent and received from
+ * different threads. A producer claims a slot by advancing the head and
+ * publishes it through the sequence number of the slot. The writer is the
+ * only consumer. When the ring is full frames are dropped and counted.
+ *
+ * The file has one interface per stack, 0 is primary and 1 secondary, with
+ * nanosecond CLOCK_REALTIME timestamps and the direction in the packet
+ * flags.
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "oshw.h"
+#include "nicdrv_pcap.h"
+
+/** default number of frames in ring */
+#define EC_PCAPFRAMES   1024
+/** writer thread poll interval in ns */
+#define EC_PCAPPOLLNS   1000000
+
+/** pcapng block types */
+#define EC_PCAPNG_SHB   0x0A0D0D0A
+#define EC_PCAPNG_IDB   0x00000001
+#define EC_PCAPNG_EPB   0x00000006
+/** pcapng byte order magic */
+#define EC_PCAPNG_MAGIC 0x1A2B3C4D
+/** pcapng link type ethernet */
+#define EC_PCAPNG_ETHER 1
+
+/** captured frame */
+typedef struct
+{
+   /** slot sequence, position + 1 when filled */
+   uint32 seq;
+   /** interface id */
+   uint8 ifid;
+   /** direction, 1 = inbound, 2 = outbound as in pcapng flags */
+   uint8 dir;
+   /** frame length */
+   uint16 len;
+   /** capture time, CLOCK_REALTIME */
+   ec_timet ts;
+   /** frame including ethernet header */
+   ec_bufT data;
+} ec_pcapslotT;
+
+/** Capture ring and writer state */
+struct ec_pcap
+{
+   /** ring slots */
+   ec_pcapslotT *slot;
+   /** number of slots - 1 */
+   uint32 mask;
+   /** next position to claim by producers */
+   uint32 head;
+   /** next position to write by writer */
+   uint32 tail;
+   /** frames captured */
+   uint64 captured;
+   /** frames dropped because the ring was full */
+   uint64 dropped;
+   /** output file */
+   FILE *file;
+   /** writer thread */
+   pthread_t thread;
+   /** writer thread runs while set */
+   int running;
+};
+
+/** Write pcapng block.
+ * @param[in] file     = output file
+ * @param[in] type     = block type
+ * @param[in] body     = block body, a multiple of 4 bytes
+ * @param[in] len      = length of body
+ * @param[in] data     = data appended to body, padded to 4 bytes, or NULL
+ * @param[in] dlen     = length of data
+ * @param[in] opt      = options appended after data, a multiple of 4 bytes
+ * @param[in] olen     = length of options
+ * @return 0 if succeeded
+ */
+static int ecx_pcap_block(FILE *file, uint32 type, const void *body, int len,
+                          const void *data, int dlen, const void *opt, int olen)
+{
+   static const uint8 pad[4] = {0, 0, 0, 0};
+   uint32 w[2];
+   int padlen;
+
+   padlen = (4 - (dlen & 3)) & 3;
+   w[0] = type;
+   w[1] = (uint32)(12 + len + dlen + padlen + olen);
+   if ((fwrite(w, sizeof(w), 1, file) != 1) ||
+       (fwrite(body, len, 1, file) != 1))
+   {
+      return -1;
+   }
+   if (dlen && ((fwrite(data, dlen, 1, file) != 1) ||
+                (padlen && (fwrite(pad, padlen, 1, file) != 1))))
+   {
+      return -1;
+   }
+   if (olen && (fwrite(opt, olen, 1, file) != 1))
+   {
+      return -1;
+   }
+
+   return (fwrite(&w[1], sizeof(w[1]), 1, file) == 1) ? 0 : -1;
+}
+
+/** Write section header and interface descriptions.
+ * @param[in] file     = output file
+ * @param[in] ifcnt    = number of interfaces
+ * @return 0 if succeeded
+ */
+static int ecx_pcap_header(FILE *file, int ifcnt)
+{
+   static const char *ifname[2] = {"primary", "secondary"};
+   uint32 shb[4];
+   uint32 idb[2];
+   uint8 opt[24];
+   int i, n;
+
+   shb[0] = EC_PCAPNG_MAGIC;
+   shb[1] = 0x00000001; /* version 1.0 */
+   shb[2] = 0xffffffff; /* section length unknown */
+   shb[3] = 0xffffffff;
+   if (ecx_pcap_block(file, EC_PCAPNG_SHB, shb, sizeof(shb), NULL, 0, NULL, 0))
+   {
+      return -1;
+   }
+   for (i = 0; i < ifcnt; i++)
+   {
+      idb[0] = EC_PCAPNG_ETHER;
+      idb[1] = EC_BUFSIZE;
+      memset(opt, 0, sizeof(opt));
+      /* if_name */
+      n = (int)strlen(ifname[i]);
+      opt[0] = 2;
+      opt[2] = (uint8)n;
+      memcpy(&opt[4], ifname[i], n);
+      n = 4 + ((n + 3) & ~3);
+      /* if_tsresol, nanoseconds */
+      opt[n] = 9;
+      opt[n + 2] = 1;
+      opt[n + 4] = 9;
+      /* opt_endofopt */
+      n += 12;
+      if (ecx_pcap_block(file, EC_PCAPNG_IDB, idb, sizeof(idb), NULL, 0, opt, n))
+      {
+         return -1;
+      }
+   }
+
+   return 0;
+}
+
+/** Write all published frames of the ring to the file.
+ * @param[in] pcap     = capture state
+ * @return number of frames written
+ */
+static int ecx_pcap_drain(ec_pcapT *pcap)
+{
+   ec_pcapslotT *slot;
+   uint32 tail, epb[5], opt[3];
+   uint64 t;
+   int cnt;
+
+   cnt = 0;
+   tail = pcap->tail;
+   for (;;)
+   {
+      slot = &pcap->slot[tail & pcap->mask];
+      if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != tail + 1)
+      {
+         break;
+      }
+      t = (uint64)slot->ts.tv_sec * 1000000000 + slot->ts.tv_nsec;
+      epb[0] = slot->ifid;
+      epb[1] = (uint32)(t >> 32);
+      epb[2] = (uint32)t;
+      epb[3] = slot->len;
+      epb[4] = slot->len;
+      /* epb_flags with direction, opt_endofopt */
+      opt[0] = 2 | (4 << 16);
+      opt[1] = slot->dir;
+      opt[2] = 0;
+      ecx_pcap_block(pcap->file, EC_PCAPNG_EPB, epb, sizeof(epb), slot->data, slot->len, opt, sizeof(opt));
+      tail++;
+      __atomic_store_n(&pcap->tail, tail, __ATOMIC_RELEASE);
+      cnt++;
+   }
+   if (cnt)
+   {
+      fflush(pcap->file);
+   }
+
+   return cnt;
+}
+
+/** Writer thread, polls the ring until capture is stopped.
+ * @param[in] arg      = capture state
+ * @return NULL
+ */
+static void *ecx_pcap_writer(void *arg)
+{
+   ec_pcapT *pcap = (ec_pcapT *)arg;
+   struct timespec ts;
+
+   ts.tv_sec = 0;
+   ts.tv_nsec = EC_PCAPPOLLNS;
+   while (__atomic_load_n(&pcap->running, __ATOMIC_ACQUIRE))
+   {
+      if (!ecx_pcap_drain(pcap))
+      {
+         nanosleep(&ts, NULL);
+      }
+   }
+   ecx_pcap_drain(pcap);
+
+   return NULL;
+}
+
+/** Create capture ring, open pcapng file and start writer thread.
+ * @param[out] ppcap    = capture state, NULL on failure
+ * @param[in]  filename = pcapng file to write
+ * @param[in]  frames   = ring size in frames, 0 = default, rounded up to a
+ * power of two
+ * @param[in]  ifcnt    = number of interfaces, 1 or 2 if redundant
+ * @return 0 if succeeded
+ */
+int ecx_pcap_open(ec_pcapT **ppcap, const char *filename, int frames, int ifcnt)
+{
+   ec_pcapT *pcap;
+   uint32 n;
+
+   *ppcap = NULL;
+   if (frames <= 0)
+   {
+      frames = EC_PCAPFRAMES;
+   }
+   n = 1;
+   while (n < (uint32)frames)
+   {
+      n <<= 1;
+   }
+   pcap = calloc(1, sizeof(*pcap));
+   if (!pcap)
+   {
+      return -1;
+   }
+   pcap->mask = n - 1;
+   pcap->slot = calloc(n, sizeof(ec_pcapslotT));
+   pcap->file = fopen(filename, "wb");
+   if (!pcap->slot || !pcap->file || ecx_pcap_header(pcap->file, ifcnt))
+   {
+      goto fail;
+   }
+   fflush(pcap->file);
+   pcap->running = 1;
+   if (pthread_create(&pcap->thread, NULL, ecx_pcap_writer, pcap))
+   {
+      goto fail;
+   }
+
+   *ppcap = pcap;
+   return 0;
+
+fail:
+   if (pcap->file)
+   {
+      fclose(pcap->file);
+   }
+   free(pcap->slot);
+   free(pcap);
+   return -1;
+}
+
+/** Stop writer thread after it wrote all captured frames, close file and
+ * release ring. No frames must be put anymore.
+ * @param[in] pcap     = capture state
+ */
+void ecx_pcap_close(ec_pcapT *pcap)
+{
+   __atomic_store_n(&pcap->running, 0, __ATOMIC_RELEASE);
+   pthread_join(pcap->thread, NULL);
+   fclose(pcap->file);
+   free(pcap->slot);
+   free(pcap);
+}
+
+/** Copy frame into capture ring. Lock free, safe to call from multiple
+ * threads.
+ * @param[in] pcap     = capture state
+ * @param[in] ifid     = interface id, 0 = primary, 1 = secondary
+ * @param[in] dir      = 1 = received, 2 = sent
+ * @param[in] hdr      = ethernet header, or whole frame if data is NULL
+ * @param[in] hlen     = length of hdr
+ * @param[in] data     = frame data following the header, or NULL
+ * @param[in] len      = length of data
+ * @return 0 if captured, -1 if dropped
+ */
+int ecx_pcap_put(ec_pcapT *pcap, int ifid, int dir, const void *hdr, int hlen, const void *data, int len)
+{
+   ec_pcapslotT *slot;
+   uint32 pos;
+
+   if ((hlen < 0) || (len < 0) || ((hlen + len) > EC_BUFSIZE))
+   {
+      return -1;
+   }
+   pos = __atomic_load_n(&pcap->head, __ATOMIC_RELAXED);
+   do
+   {
+      if ((pos - __atomic_load_n(&pcap->tail, __ATOMIC_ACQUIRE)) > pcap->mask)
+      {
+         __atomic_add_fetch(&pcap->dropped, 1, __ATOMIC_RELAXED);
+         return -1;
+      }
+   } while (!__atomic_compare_exchange_n(&pcap->head, &pos, pos + 1, TRUE,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+   slot = &pcap->slot[pos & pcap->mask];
+   clock_gettime(CLOCK_REALTIME, &slot->ts);
+   slot->ifid = (uint8)ifid;
+   slot->dir = (uint8)dir;
+   slot->len = (uint16)(hlen + len);
+   memcpy(slot->data, hdr, hlen);
+   if (data)
+   {
+      memcpy(&slot->data[hlen], data, len);
+   }
+   __atomic_add_fetch(&pcap->captured, 1, __ATOMIC_RELAXED);
+   __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+   return 0;
+}
+
+/** Get capture counters.
+ * @param[in]  pcap     = capture state
+ * @param[out] captured = frames captured
+ * @param[out] dropped  = frames dropped because the ring was full
+ */
+void ecx_pcap_stats(ec_pcapT *pcap, uint64 *captured, uint64 *dropped)
+{
+   *captured = __atomic_load_n(&pcap->captured, __ATOMIC_RELAXED);
+   *dropped = __atomic_load_n(&pcap->dropped, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,30 @@
+/*
+ * This software is dual-licensed under GPLv3 and a commercial
+ * license. See the file LICENSE.md distributed with this software for
+ * full license information.
+ */
+
+/** \file
+ * \brief
+ * Headerfile for nicdrv_pcap.c, only used by nicdrv.c
+ */
+
+#ifndef _nicdrv_pcaph_
+#define _nicdrv_pcaph_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "oshw.h"
+
+int ecx_pcap_open(ec_pcapT **ppcap, const char *filename, int frames, int ifcnt);
+void ecx_pcap_close(ec_pcapT *pcap);
+int ecx_pcap_put(ec_pcapT *pcap, int ifid, int dir, const void *hdr, int hlen, const void *data, int len);
+void ecx_pcap_stats(ec_pcapT *pcap, uint64 *captured, uint64 *dropped);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,666 @@
+/*
+ * This software is dual-licensed under GPLv3 and a commercial
+ * license. See the file LICENSE.md distributed with this software for
+ * full license information.
+ */
+
+/** \file
+ * \brief
+ * EtherCAT frame replay.
+ *
+ * Backend of nicdrv.c that answers the frames of the master from a recorded
+ * trace of a real segment, f.e. written by ecx_capture_start() or tcpdump.
+ * The interface name is the pcap or pcapng file. Start up and cyclic
+ * operation can then be repeated offline, at full speed and with the same
+ * slave responses every time.
+ *
+ * The trace is read into a list of exchanges, a sent frame and the frame
+ * that returned with the same index. The direction of a frame is taken from
+ * the pcapng packet flags, without them the first frame with an index is
+ * the sent one and the next with that index the returned one. Only
+ * EtherCAT frames of the first interface are used.
+ *
+ * A frame sent by the master is matched by its command sequence: commands,
+ * addresses and lengths of all datagrams. The answer is the first recorded
+ * exchange with that sequence after the last matched one, or the first
+ * in the trace if there is none after it, so a short recording of the
+ * cyclic exchange is replayed over and over. The datagram indexes of the
+ * answer are replaced by the ones the master sent. Frames without recorded
+ * exchange are lost. The receive timestamp adds the recorded round trip
+ * time to the send time.
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "oshw.h"
+#include "osal.h"
+#include "nicdrv_replay.h"
+
+/** number of frames in the response queue */
+#define EC_REPLAYQUEUE (2 * EC_MAXBUF)
+
+/** One recorded exchange */
+typedef struct
+{
+   /** command sequence of sent frame */
+   uint32 sig;
+   /** round trip time in ns */
+   int64 rtt;
+   /** length of returned frame */
+   int len;
+   /** returned frame */
+   uint8 *frame;
+} ec_replayxT;
+
+/** Exchange position sorted by command sequence */
+typedef struct
+{
+   uint32 sig;
+   int pos;
+} ec_replaykeyT;
+
+/** Replay state */
+struct ec_replay
+{
+   /** eventfd, readable while responses are queued */
+   int fd;
+   /** recorded exchanges in trace order */
+   ec_replayxT *x;
+   /** number of exchanges */
+   int xcnt;
+   /** exchanges sorted by command sequence, then position */
+   ec_replaykeyT *key;
+   /** position after last matched exchange */
+   int cursor;
+   /** queued responses */
+   ec_bufT q[EC_REPLAYQUEUE];
+   /** lengths of queued responses */
+   int qlen[EC_REPLAYQUEUE];
+   /** receive timestamps of queued responses */
+   ec_timet qts[EC_REPLAYQUEUE];
+   /** queue producer position */
+   uint32 head;
+   /** queue consumer position */
+   uint32 tail;
+};
+
+/** Frame being read from trace */
+typedef struct
+{
+   /** interface id */
+   uint32 ifid;
+   /** timestamp in ns */
+   int64 ts;
+   /** direction, 0 = unknown, 1 = received, 2 = sent */
+   int dir;
+   /** frame length */
+   int len;
+   /** frame */
+   const uint8 *data;
+} ec_replaypktT;
+
+/** Trace reader state */
+typedef struct
+{
+   /** whole file */
+   uint8 *buf;
+   /** file size */
+   size_t size;
+   /** read position */
+   size_t pos;
+   /** TRUE if pcapng, else pcap */
+   boolean ng;
+   /** TRUE if file byte order differs from ours */
+   boolean swap;
+   /** pcap timestamp resolution in ns */
+   int64 tsres;
+   /** pcapng timestamp resolution in ns of first interfaces */
+   int64 iftsres[2];
+   /** number of pcapng interfaces in section */
+   uint32 ifcnt;
+} ec_replayrdT;
+
+static uint32 ecx_replay_u32(ec_replayrdT *rd, size_t pos)
+{
+   uint32 v;
+
+   memcpy(&v, rd->buf + pos, sizeof(v));
+   return rd->swap ? __builtin_bswap32(v) : v;
+}
+
+static uint16 ecx_replay_u16(ec_replayrdT *rd, size_t pos)
+{
+   uint16 v;
+
+   memcpy(&v, rd->buf + pos, sizeof(v));
+   return rd->swap ? __builtin_bswap16(v) : v;
+}
+
+/** Get pcapng timestamp resolution from interface description options.
+ * @param[in] rd       = reader state
+ * @param[in] opt      = first option
+ * @param[in] end      = end of options
+ * @return resolution in ns
+ */
+static int64 ecx_replay_tsresol(ec_replayrdT *rd, size_t opt, size_t end)
+{
+   uint16 code, len;
+   uint8 r;
+   int64 res;
+
+   while (opt + 4 <= end)
+   {
+      code = ecx_replay_u16(rd, opt);
+      len = ecx_replay_u16(rd, opt + 2);
+      if ((code == 0) || (opt + 4 + len > end))
+      {
+         break;
+      }
+      if ((code == 9) && (len >= 1))
+      {
+         r = rd->buf[opt + 4];
+         res = 1;
+         if (r & 0x80)
+         {
+            /* power of two, only exact for coarse resolutions */
+            return ((r & 0x7f) < 30) ? (1000000000LL >> (r & 0x7f)) : 1;
+         }
+         for (; r < 9; r++)
+         {
+            res *= 10;
+         }
+         return res;
+      }
+      opt += 4 + ((len + 3) & ~3);
+   }
+
+   return 1000; /* default microseconds */
+}
+
+/** Read next frame from trace.
+ * @param[in]  rd       = reader state
+ * @param[out] pkt      = frame
+ * @return 1 if a frame was read, 0 at end of file, -1 on format error
+ */
+static int ecx_replay_next(ec_replayrdT *rd, ec_replaypktT *pkt)
+{
+   uint32 type, blen, caplen, id, magic;
+   uint16 code, len;
+   size_t p, opt, end;
+   uint64 t;
+
+   if (!rd->ng)
+   {
+      if (rd->pos + 16 > rd->size)
+      {
+         return 0;
+      }
+      caplen = ecx_replay_u32(rd, rd->pos + 8);
+      if (rd->pos + 16 + caplen > rd->size)
+      {
+         return -1;
+      }
+      pkt->ifid = 0;
+      pkt->ts = (int64)ecx_replay_u32(rd, rd->pos) * 1000000000 +
+                (int64)ecx_replay_u32(rd, rd->pos + 4) * rd->tsres;
+      pkt->dir = 0;
+      pkt->len = (int)caplen;
+      pkt->data = rd->buf + rd->pos + 16;
+      rd->pos += 16 + caplen;
+      return 1;
+   }
+   while (rd->pos + 12 <= rd->size)
+   {
+      p = rd->pos;
+      type = ecx_replay_u32(rd, p);
+      if (type == 0x0A0D0D0A)
+      {
+         /* section header, byte order may change */
+         memcpy(&magic, rd->buf + p + 8, sizeof(magic));
+         rd->swap = (magic != 0x1A2B3C4D);
+         rd->ifcnt = 0;
+      }
+      blen = ecx_replay_u32(rd, p + 4);
+      if ((blen < 12) || (blen & 3) || (p + blen > rd->size))
+      {
+         return -1;
+      }
+      rd->pos += blen;
+      end = p + blen - 4;
+      if ((type == 0x00000001) && (blen >= 20))
+      {
+         if (rd->ifcnt < 2)
+         {
+            rd->iftsres[rd->ifcnt] = ecx_replay_tsresol(rd, p + 16, end);
+         }
+         rd->ifcnt++;
+      }
+      else if ((type == 0x00000006) && (blen >= 32))
+      {
+         id = ecx_replay_u32(rd, p + 8);
+         caplen = ecx_replay_u32(rd, p + 20);
+         if (p + 28 + caplen > end)
+         {
+            return -1;
+         }
+         t = ((uint64)ecx_replay_u32(rd, p + 12) << 32) | ecx_replay_u32(rd, p + 16);
+         pkt->ifid = id;
+         pkt->ts = (int64)t * ((id < 2) ? rd->iftsres[id] : 1000);
+         pkt->dir = 0;
+         pkt->len = (int)caplen;
+         pkt->data = rd->buf + p + 28;
+         /* epb_flags holds the direction */
+         opt = p + 28 + ((caplen + 3) & ~3);
+         while (opt + 4 <= end)
+         {
+            code = ecx_replay_u16(rd, opt);
+            len = ecx_replay_u16(rd, opt + 2);
+            if ((code == 0) || (opt + 4 + len > end))
+            {
+               break;
+            }
+            if ((code == 2) && (len == 4))
+            {
+               pkt->dir = ecx_replay_u32(rd, opt + 4) & 0x03;
+            }
+            opt += 4 + ((len + 3) & ~3);
+         }
+         return 1;
+      }
+   }
+
+   return 0;
+}
+
+/** Get command sequence of an EtherCAT frame.
+ * @param[in] frame    = frame including ethernet header
+ * @param[in] len      = length of frame
+ * @param[out] sig     = command sequence hash
+ * @return index of first datagram, or -1 if not an EtherCAT frame
+ */
+static int ecx_replay_sig(const uint8 *frame, int len, uint32 *sig)
+{
+   const ec_etherheadert *ehp = (const ec_etherheadert *)frame;
+   const uint8 *p, *end;
+   uint32 h;
+   uint16 dl;
+   int i;
+
+   if ((len < (int)(ETH_HEADERSIZE + EC_HEADERSIZE)) || (ehp->etype != htons(ETH_P_ECAT)))
+   {
+      return -1;
+   }
+   end = frame + len;
+   p = frame + ETH_HEADERSIZE + EC_ELENGTHSIZE;
+   /* FNV-1a over command, ADP, ADO and length of all datagrams */
+   h = 2166136261u;
+   while (p + EC_HEADERSIZE - EC_ELENGTHSIZE <= end)
+   {
+      for (i = 0; i < 8; i++)
+      {
+         if (i != 1)
+         {
+            h = (h ^ p[i]) * 16777619u;
+         }
+      }
+      dl = (uint16)(p[6] | (p[7] << 8));
+      p += EC_HEADERSIZE - EC_ELENGTHSIZE + (dl & 0x07ff) + EC_WKCSIZE;
+      if (!(dl & EC_DATAGRAMFOLLOWS))
+      {
+         break;
+      }
+   }
+   *sig = h;
+
+   return frame[ETH_HEADERSIZE + EC_ELENGTHSIZE + 1];
+}
+
+static int ecx_replay_keycmp(const void *a, const void *b)
+{
+   const ec_replaykeyT *ka = a, *kb = b;
+
+   if (ka->sig != kb->sig)
+   {
+      return (ka->sig < kb->sig) ? -1 : 1;
+   }
+   return ka->pos - kb->pos;
+}
+
+/** Read trace into exchange list.
+ * @param[in] replay   = replay state
+ * @param[in] rd       = reader positioned at first frame
+ * @return 0 if succeeded
+ */
+static int ecx_replay_load(ec_replayT *replay, ec_replayrdT *rd)
+{
+   ec_replaypktT pkt;
+   struct
+   {
+      boolean valid;
+      uint32 sig;
+      int64 ts;
+   } pend[256];
+   ec_replayxT *x;
+   uint32 sig;
+   int idx, r, max;
+
+   memset(pend, 0, sizeof(pend));
+   max = 0;
+   while ((r = ecx_replay_next(rd, &pkt)) > 0)
+   {
+      idx = ecx_replay_sig(pkt.data, pkt.len, &sig);
+      if ((pkt.ifid != 0) || (idx < 0) || (pkt.len > EC_BUFSIZE))
+      {
+         continue;
+      }
+      if ((pkt.dir == 2) || ((pkt.dir == 0) && !pend[idx].valid))
+      {
+         pend[idx].valid = TRUE;
+         pend[idx].sig = sig;
+         pend[idx].ts = pkt.ts;
+         continue;
+      }
+      if (!pend[idx].valid)
+      {
+         continue;
+      }
+      pend[idx].valid = FALSE;
+      if (replay->xcnt >= max)
+      {
+         max = max ? 2 * max : 1024;
+         x = realloc(replay->x, max * sizeof(ec_replayxT));
+         if (!x)
+         {
+            return -1;
+         }
+         replay->x = x;
+      }
+      x = &replay->x[replay->xcnt];
+      x->frame = malloc(pkt.len);
+      if (!x->frame)
+      {
+         return -1;
+      }
+      memcpy(x->frame, pkt.data, pkt.len);
+      x->len = pkt.len;
+      x->sig = pend[idx].sig;
+      x->rtt = pkt.ts - pend[idx].ts;
+      replay->xcnt++;
+   }
+   if ((r < 0) || !replay->xcnt)
+   {
+      return -1;
+   }
+   replay->key = malloc(replay->xcnt * sizeof(ec_replaykeyT));
+   if (!replay->key)
+   {
+      return -1;
+   }
+   for (idx = 0; idx < replay->xcnt; idx++)
+   {
+      replay->key[idx].sig = replay->x[idx].sig;
+      replay->key[idx].pos = idx;
+   }
+   qsort(replay->key, replay->xcnt, sizeof(ec_replaykeyT), ecx_replay_keycmp);
+
+   return 0;
+}
+
+/** Find exchange for sent frame.
+ * @param[in] replay   = replay state
+ * @param[in] sig      = command sequence of sent frame
+ * @return exchange or NULL if none recorded
+ */
+static ec_replayxT *ecx_replay_find(ec_replayT *replay, uint32 sig)
+{
+   int lo, hi, mid, first;
+   ec_replaykeyT *k = replay->key;
+
+   /* first key with sig */
+   lo = 0;
+   hi = replay->xcnt;
+   while (lo < hi)
+   {
+      mid = (lo + hi) / 2;
+      if (k[mid].sig < sig)
+      {
+         lo = mid + 1;
+      }
+      else
+      {
+         hi = mid;
+      }
+   }
+   if ((lo >= replay->xcnt) || (k[lo].sig != sig))
+   {
+      return NULL;
+   }
+   first = lo;
+   /* first key with sig at or after cursor */
+   hi = replay->xcnt;
+   while (lo < hi)
+   {
+      mid = (lo + hi) / 2;
+      if ((k[mid].sig == sig) && (k[mid].pos < replay->cursor))
+      {
+         lo = mid + 1;
+      }
+      else
+      {
+         hi = mid;
+      }
+   }
+   if ((lo >= replay->xcnt) || (k[lo].sig != sig))
+   {
+      lo = first;
+   }
+   replay->cursor = k[lo].pos + 1;
+
+   return &replay->x[k[lo].pos];
+}
+
+/** Read trace and create replay state.
+ * @param[out] preplay  = replay state, NULL on failure
+ * @param[in]  filename = pcap or pcapng file
+ * @return eventfd to wait on for responses or -1 on failure
+ */
+int ecx_replay_open(ec_replayT **preplay, const char *filename)
+{
+   ec_replayT *replay;
+   ec_replayrdT rd;
+   FILE *f;
+   uint32 magic;
+   long size;
+   int r;
+
+   *preplay = NULL;
+   memset(&rd, 0, sizeof(rd));
+   f = fopen(filename, "rb");
+   if (!f)
+   {
+      return -1;
+   }
+   r = -1;
+   if ((fseek(f, 0, SEEK_END) == 0) && ((size = ftell(f)) >= 24) && (fseek(f, 0, SEEK_SET) == 0))
+   {
+      rd.size = (size_t)size;
+      rd.buf = malloc(rd.size);
+      if (rd.buf && (fread(rd.buf, rd.size, 1, f) == 1))
+      {
+         r = 0;
+      }
+   }
+   fclose(f);
+   replay = calloc(1, sizeof(*replay));
+   if (r || !replay)
+   {
+      free(rd.buf);
+      free(replay);
+      return -1;
+   }
+   memcpy(&magic, rd.buf, sizeof(magic));
+   rd.tsres = 1000;
+   if (magic == 0x0A0D0D0A)
+   {
+      rd.ng = TRUE;
+   }
+   else if ((magic == 0xa1b2c3d4) || (magic == 0xa1b23c4d))
+   {
+      rd.tsres = (magic == 0xa1b23c4d) ? 1 : 1000;
+      rd.pos = 24;
+   }
+   else if ((magic == 0xd4c3b2a1) || (magic == 0x4d3cb2a1))
+   {
+      rd.swap = TRUE;
+      rd.tsres = (magic == 0x4d3cb2a1) ? 1 : 1000;
+      rd.pos = 24;
+   }
+   else
+   {
+      r = -1;
+   }
+   if (!r)
+   {
+      r = ecx_replay_load(replay, &rd);
+   }
+   free(rd.buf);
+   replay->fd = r ? -1 : eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+   if (replay->fd < 0)
+   {
+      ecx_replay_close(replay);
+      return -1;
+   }
+
+   *preplay = replay;
+   return replay->fd;
+}
+
+/** Release replay state. The eventfd is closed by the caller.
+ * @param[in] replay   = replay state
+ */
+void ecx_replay_close(ec_replayT *replay)
+{
+   int i;
+
+   for (i = 0; i < replay->xcnt; i++)
+   {
+      free(replay->x[i].frame);
+   }
+   free(replay->x);
+   free(replay->key);
+   free(replay);
+}
+
+/** Look up the recorded answer to a frame and queue it.
+ * Caller must serialize calls.
+ * @param[in]  replay   = replay state
+ * @param[in]  buf      = frame to send
+ * @param[in]  len      = length of frame
+ * @param[out] ts       = time frame was sent
+ * @return length of frame or -1 if response queue is full
+ */
+int ecx_replay_put(ec_replayT *replay, const void *buf, int len, ec_timet *ts)
+{
+   const uint8 *req = (const uint8 *)buf;
+   ec_replayxT *x;
+   uint8 *rsp;
+   uint32 head, sig;
+   uint64 one = 1;
+   int64 t;
+   int slot, p;
+   uint16 dl;
+
+   osal_get_monotonic_time(ts);
+   if (ecx_replay_sig(req, len, &sig) < 0)
+   {
+      return len;
+   }
+   x = ecx_replay_find(replay, sig);
+   if (!x || (x->len != len))
+   {
+      /* nothing recorded, frame is lost */
+      return len;
+   }
+   head = replay->head;
+   if ((head - __atomic_load_n(&replay->tail, __ATOMIC_ACQUIRE)) >= EC_REPLAYQUEUE)
+   {
+      return -1;
+   }
+   slot = head % EC_REPLAYQUEUE;
+   rsp = replay->q[slot];
+   memcpy(rsp, x->frame, len);
+   /* answer with the indexes the master sent */
+   p = ETH_HEADERSIZE + EC_ELENGTHSIZE;
+   while (p + (int)(EC_HEADERSIZE - EC_ELENGTHSIZE) <= len)
+   {
+      rsp[p + 1] = req[p + 1];
+      dl = (uint16)(req[p + 6] | (req[p + 7] << 8));
+      p += EC_HEADERSIZE - EC_ELENGTHSIZE + (dl & 0x07ff) + EC_WKCSIZE;
+      if (!(dl & EC_DATAGRAMFOLLOWS))
+      {
+         break;
+      }
+   }
+   replay->qlen[slot] = len;
+   t = (int64)ts->tv_sec * 1000000000 + ts->tv_nsec + ((x->rtt > 0) ? x->rtt : 0);
+   replay->qts[slot].tv_sec = t / 1000000000;
+   replay->qts[slot].tv_nsec = t % 1000000000;
+   __atomic_store_n(&replay->head, head + 1, __ATOMIC_RELEASE);
+   if (write(replay->fd, &one, sizeof(one)) < 0)
+   {
+      /* counter overflow is impossible, eventfd stays readable anyway */
+   }
+
+   return len;
+}
+
+/** Non blocking read of response queue. The frame stays queued until
+ * released with ecx_replay_release().
+ * @param[in]  replay   = replay state
+ * @param[out] len      = length of frame
+ * @param[out] ts       = time frame was received
+ * @return pointer to frame or NULL if queue is empty
+ */
+uint8 *ecx_replay_recv(ec_replayT *replay, int *len, ec_timet *ts)
+{
+   uint32 tail;
+   uint64 cnt;
+   int slot;
+
+   tail = replay->tail;
+   if (__atomic_load_n(&replay->head, __ATOMIC_ACQUIRE) == tail)
+   {
+      /* clear eventfd before the final check, a response queued after
+       * the check makes it readable again */
+      if (read(replay->fd, &cnt, sizeof(cnt)) < 0)
+      {
+         /* not readable, nothing to clear */
+      }
+      if (__atomic_load_n(&replay->head, __ATOMIC_ACQUIRE) == tail)
+      {
+         *len = 0;
+         return NULL;
+      }
+   }
+   slot = tail % EC_REPLAYQUEUE;
+   *len = replay->qlen[slot];
+   *ts = replay->qts[slot];
+
+   return replay->q[slot];
+}
+
+/** Release frame returned by ecx_replay_recv().
+ * @param[in] replay   = replay state
+ */
+void ecx_replay_release(ec_replayT *replay)
+{
+   __atomic_store_n(&replay->tail, replay->tail + 1, __ATOMIC_RELEASE);
+}
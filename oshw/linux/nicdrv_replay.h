@@ -0,0 +1,31 @@
+/*
+ * This software is dual-licensed under GPLv3 and a commercial
+ * license. See the file LICENSE.md distributed with this software for
+ * full license information.
+ */
+
+/** \file
+ * \brief
+ * Headerfile for nicdrv_replay.c, only used by nicdrv.c
+ */
+
+#ifndef _nicdrv_replayh_
+#define _nicdrv_replayh_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "oshw.h"
+
+int ecx_replay_open(ec_replayT **preplay, const char *filename);
+void ecx_replay_close(ec_replayT *replay);
+int ecx_replay_put(ec_replayT *replay, const void *buf, int len, ec_timet *ts);
+uint8 *ecx_replay_recv(ec_replayT *replay, int *len, ec_timet *ts);
+void ecx_replay_release(ec_replayT *replay);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1289 @@
+/*
+ * This software is dual-licensed under GPLv3 and a commercial
+ * license. See the file LICENSE.md distributed with this software for
+ * full license information.
+ */
+
+/** \file
+ * \brief
+ * Simulated EtherCAT segment.
+ *
+ * Backend of nicdrv.c that needs no NIC and no slaves. A line of N
+ * simulated EtherCAT slave controllers (ESC) processes every sent frame in
+ * process, the frame with updated data and working counters is queued and
+ * read back by the receive functions. It is meant for tests and for
+ * benchmarking the master, f.e. ecx_config_init() or the cyclic exchange
+ * with a thousand slaves, on any Linux machine.
+ *
+ * The segment is selected with the "sim" NIC backend, the interface name
+ * is the segment description "count[:outbytes[:inbytes]]", f.e. "100:4:2"
+ * for 100 slaves with 4 output and 2 input bytes each.
+ *
+ * Each slave models:
+ * - auto increment, configured address, broadcast and logical addressing,
+ *   including ARMW and FRMW, with the working counter rules of an ESC
+ * - the AL state machine with mailbox and process data SM checks
+ * - an SII EEPROM image with identity, mailbox, general, FMMU and SM
+ *   categories, readable and writable through the EEPROM interface
+ * - SM and FMMU logical mapping at byte granularity
+ * - DC receive time latching, local and system time, offset, delay and a
+ *   drift loop that slews the local clock on system time writes
+ * - a CoE mailbox with expedited and normal SDO upload and download of the
+ *   identity, sync manager and PDO mapping objects
+ *
+ * The slave application copies the outputs to the inputs once the frame
+ * that wrote them has passed, so inputs follow outputs with one frame
+ * delay. Frames are returned immediately, the receive timestamp models the
+ * time the frame would have spent on the wire.
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "oshw.h"
+#include "osal.h"
+#include "nicdrv_sim.h"
+
+/** maximum number of simulated slaves */
+#define EC_SIMMAXSLAVE 4096
+/** size of ESC register and process memory */
+#define EC_SIMMEMSIZE  0x1300
+/** start of process memory */
+#define EC_SIMRAM      0x1000
+/** mailbox in (SM0) start */
+#define EC_SIMMBXIN    0x1000
+/** mailbox out (SM1) start */
+#define EC_SIMMBXOUT   0x1080
+/** mailbox size */
+#define EC_SIMMBXSIZE  0x0080
+/** process data outputs (SM2) start */
+#define EC_SIMOUTPUTS  0x1100
+/** process data inputs (SM3) start */
+#define EC_SIMINPUTS   0x1200
+/** maximum outputs and inputs per slave, one PDO entry per byte */
+#define EC_SIMMAXPD    254
+/** number of FMMUs */
+#define EC_SIMFMMU     8
+/** size of SII EEPROM in words */
+#define EC_SIMSIISIZE  256
+/** frame forwarding delay per slave and direction in ns */
+#define EC_SIMHOPNS    600
+/** largest local clock correction per system time write in ns */
+#define EC_SIMDCSLEW   1000
+/** number of frames in the response queue */
+#define EC_SIMQUEUE    (2 * EC_MAXBUF)
+
+/** simulated slave identity */
+#define EC_SIMVENDOR   0xE0000001
+#define EC_SIMPRODUCT  0x00000001
+#define EC_SIMREVISION 0x00010000
+
+/** simulated slave name in SII */
+static const char ecx_simname[] = "SOEM simulated slave";
+
+/** One simulated slave */
+typedef struct
+{
+   /** registers and process memory */
+   uint8 mem[EC_SIMMEMSIZE];
+   /** SII EEPROM */
+   uint16 sii[EC_SIMSIISIZE];
+   /** AL status */
+   uint16 alstatus;
+   /** AL status code */
+   uint16 alcode;
+   /** read mailbox full */
+   boolean mbxfull;
+   /** outputs written by the current frame */
+   boolean pdupdate;
+   /** local clock minus simulation clock in ns */
+   int64 clkofs;
+   /** position in segment, 0 is next to the master */
+   int pos;
+} ec_simslaveT;
+
+/** Simulated segment state */
+struct ec_sim
+{
+   /** eventfd, readable while responses are queued */
+   int fd;
+   /** number of slaves */
+   int nslave;
+   /** output bytes per slave */
+   int outbytes;
+   /** input bytes per slave */
+   int inbytes;
+   /** slaves */
+   ec_simslaveT *slave;
+   /** slaves whose outputs were written by the current frame */
+   int *pdlist;
+   /** number of entries in pdlist */
+   int pdcnt;
+   /** simulation time the current frame entered the segment in ns */
+   int64 frametime;
+   /** queued responses */
+   ec_bufT q[EC_SIMQUEUE];
+   /** lengths of queued responses */
+   int qlen[EC_SIMQUEUE];
+   /** receive timestamps of queued responses */
+   ec_timet qts[EC_SIMQUEUE];
+   /** queue producer position */
+   uint32 head;
+   /** queue consumer position */
+   uint32 tail;
+};
+
+static uint16 ecx_sim_getw(const uint8 *p)
+{
+   return (uint16)(p[0] | (p[1] << 8));
+}
+
+static void ecx_sim_setw(uint8 *p, uint16 w)
+{
+   p[0] = (uint8)w;
+   p[1] = (uint8)(w >> 8);
+}
+
+static uint32 ecx_sim_getl(const uint8 *p)
+{
+   return ecx_sim_getw(p) | ((uint32)ecx_sim_getw(p + 2) << 16);
+}
+
+static void ecx_sim_setl(uint8 *p, uint32 l)
+{
+   ecx_sim_setw(p, (uint16)l);
+   ecx_sim_setw(p + 2, (uint16)(l >> 16));
+}
+
+static uint64 ecx_sim_getll(const uint8 *p)
+{
+   return ecx_sim_getl(p) | ((uint64)ecx_sim_getl(p + 4) << 32);
+}
+
+static void ecx_sim_setll(uint8 *p, uint64 ll)
+{
+   ecx_sim_setl(p, (uint32)ll);
+   ecx_sim_setl(p + 4, (uint32)(ll >> 32));
+}
+
+/** Check if memory access covers a register.
+ * @param[in] ado      = start of access
+ * @param[in] len      = length of access
+ * @param[in] reg      = register address
+ * @param[in] rlen     = register length
+ * @return TRUE if access and register overlap
+ */
+static inline boolean ecx_sim_covers(int ado, int len, int reg, int rlen)
+{
+   return (ado < reg + rlen) && (ado + len > reg);
+}
+
+/** Simulation time a frame passes a slave in forward direction.
+ * @param[in] sim      = segment state
+ * @param[in] sl       = slave
+ * @return time in ns
+ */
+static inline int64 ecx_sim_passtime(ec_simT *sim, ec_simslaveT *sl)
+{
+   return sim->frametime + (int64)sl->pos * EC_SIMHOPNS;
+}
+
+/** DC system time of slave when the current frame passes.
+ * @param[in] sim      = segment state
+ * @param[in] sl       = slave
+ * @return system time in ns
+ */
+static uint64 ecx_sim_systime(ec_simT *sim, ec_simslaveT *sl)
+{
+   return (uint64)(ecx_sim_passtime(sim, sl) + sl->clkofs) + ecx_sim_getll(&sl->mem[ECT_REG_DCSYSOFFSET]);
+}
+
+/** Start and length of a SM if it is activated.
+ * @param[in]  sl       = slave
+ * @param[in]  n        = SM number
+ * @param[out] len      = SM length
+ * @return SM start or -1 if SM is not activated
+ */
+static int ecx_sim_sm(ec_simslaveT *sl, int n, int *len)
+{
+   uint8 *sm = &sl->mem[ECT_REG_SM0 + 8 * n];
+
+   *len = ecx_sim_getw(sm + 2);
+   if (!(sm[6] & 0x01) || !*len)
+   {
+      return -1;
+   }
+
+   return ecx_sim_getw(sm);
+}
+
+/** Check SM configuration of slave against SII.
+ * @param[in] sl       = slave
+ * @param[in] n        = SM number
+ * @param[in] start    = expected start
+ * @param[in] len      = expected length
+ * @return TRUE if SM is activated with expected start and length
+ */
+static boolean ecx_sim_smok(ec_simslaveT *sl, int n, int start, int len)
+{
+   int smlen;
+
+   return (ecx_sim_sm(sl, n, &smlen) == start) && (smlen == len);
+}
+
+/** Handle AL control write, changes AL status immediately.
+ * @param[in] sim      = segment state
+ * @param[in] sl       = slave
+ */
+static void ecx_sim_alctl(ec_simT *sim, ec_simslaveT *sl)
+{
+   uint16 ctl, req, cur, code;
+
+   ctl = ecx_sim_getw(&sl->mem[ECT_REG_ALCTL]);
+   req = ctl & 0x0f;
+   if (sl->alstatus & EC_STATE_ERROR)
+   {
+      if (!(ctl & EC_STATE_ACK))
+      {
+         return;
+      }
+      sl->alstatus &= ~EC_STATE_ERROR;
+      sl->alcode = 0;
+   }
+   cur = sl->alstatus & 0x0f;
+   if (!req || (req == cur))
+   {
+      return;
+   }
+   code = 0;
+   switch (req)
+   {
+   case EC_STATE_INIT:
+      break;
+   case EC_STATE_PRE_OP:
+      if (cur == EC_STATE_BOOT)
+      {
+         code = 0x0011; /* invalid requested state change */
+      }
+      else if ((cur == EC_STATE_INIT) &&
+               (!ecx_sim_smok(sl, 0, EC_SIMMBXIN, EC_SIMMBXSIZE) ||
+                !ecx_sim_smok(sl, 1, EC_SIMMBXOUT, EC_SIMMBXSIZE)))
+      {
+         code = 0x0016; /* invalid mailbox configuration */
+      }
+      break;
+   case EC_STATE_BOOT:
+      if (cur != EC_STATE_INIT)
+      {
+         code = 0x0011;
+      }
+      break;
+   case EC_STATE_SAFE_OP:
+      if ((cur == EC_STATE_INIT) || (cur == EC_STATE_BOOT))
+      {
+         code = 0x0011;
+      }
+      else if (cur == EC_STATE_PRE_OP)
+      {
+         if (sim->outbytes && !ecx_sim_smok(sl, 2, EC_SIMOUTPUTS, sim->outbytes))
+         {
+            code = 0x001d; /* invalid output configuration */
+         }
+         else if (sim->inbytes && !ecx_sim_smok(sl, 3, EC_SIMINPUTS, sim->inbytes))
+         {
+            code = 0x001e; /* invalid input configuration */
+         }
+      }
+      break;
+   case EC_STATE_OPERATIONAL:
+      if (cur != EC_STATE_SAFE_OP)
+      {
+         code = 0x0011;
+      }
+      break;
+   default:
+      code = 0x0012; /* unknown requested state */
+      break;
+   }
+   if (code)
+   {
+      sl->alstatus = cur | EC_STATE_ERROR;
+      sl->alcode = code;
+      return;
+   }
+   sl->alstatus = req;
+   if ((req == EC_STATE_INIT) || (req == EC_STATE_BOOT))
+   {
+      sl->mbxfull = FALSE;
+   }
+}
+
+/** Handle EEPROM control write, commands complete immediately.
+ * @param[in] sl       = slave
+ */
+static void ecx_sim_eeprom(ec_simslaveT *sl)
+{
+   uint16 cmd, addr;
+   int i;
+
+   cmd = ecx_sim_getw(&sl->mem[ECT_REG_EEPCTL]) & 0x0700;
+   addr = ecx_sim_getw(&sl->mem[ECT_REG_EEPADR]);
+   if (cmd == EC_ECMD_READ)
+   {
+      for (i = 0; i < 4; i++)
+      {
+         ecx_sim_setw(&sl->mem[ECT_REG_EEPDAT + 2 * i],
+                      ((addr + i) < EC_SIMSIISIZE) ? sl->sii[addr + i] : 0xffff);
+      }
+   }
+   else if ((cmd == (EC_ECMD_WRITE & 0x0700)) && (addr < EC_SIMSIISIZE))
+   {
+      sl->sii[addr] = ecx_sim_getw(&sl->mem[ECT_REG_EEPDAT]);
+   }
+}
+
+/** Latch DC receive times of ports, the frame passes port 0 in forward and
+ * port 1 in return direction. The last slave has port 1 closed.
+ * @param[in] sim      = segment state
+ * @param[in] sl       = slave
+ */
+static void ecx_sim_dclatch(ec_simT *sim, ec_simslaveT *sl)
+{
+   int64 t0, t1;
+
+   t0 = ecx_sim_passtime(sim, sl) + sl->clkofs;
+   t1 = 0;
+   if (sl->pos < sim->nslave - 1)
+   {
+      t1 = t0 + 2 * (int64)(sim->nslave - 1 - sl->pos) * EC_SIMHOPNS;
+   }
+   ecx_sim_setl(&sl->mem[ECT_REG_DCTIME0], (uint32)t0);
+   ecx_sim_setl(&sl->mem[ECT_REG_DCTIME1], (uint32)t1);
+   ecx_sim_setl(&sl->mem[ECT_REG_DCTIME2], 0);
+   ecx_sim_setl(&sl->mem[ECT_REG_DCTIME3], 0);
+   ecx_sim_setll(&sl->mem[ECT_REG_DCSOF], (uint64)t0);
+}
+
+/** Handle system time write. The written time plus the system time delay
+ * is compared to the own system time, the difference is stored and the
+ * local clock is slewed towards it.
+ * @param[in] sim      = segment state
+ * @param[in] sl       = slave
+ * @param[in] len      = length of write, 4 or 8 bytes are compared
+ */
+static void ecx_sim_dcwrite(ec_simT *sim, ec_simslaveT *sl, int len)
+{
+   uint64 own, recv;
+   int64 diff, step;
+
+   own = ecx_sim_systime(sim, sl);
+   recv = ecx_sim_getll(&sl->mem[ECT_REG_DCSYSTIME]) + ecx_sim_getl(&sl->mem[ECT_REG_DCSYSDELAY]);
+   if (len < 8)
+   {
+      diff = (int32)((uint32)own - (uint32)recv);
+   }
+   else
+   {
+      diff = (int64)(own - recv);
+   }
+   if (diff > 0x7fffffff)
+   {
+      ecx_sim_setl(&sl->mem[ECT_REG_DCSYSDIFF], 0x7fffffff);
+   }
+   else if (diff < -0x7fffffff)
+   {
+      ecx_sim_setl(&sl->mem[ECT_REG_DCSYSDIFF], 0xffffffff);
+   }
+   else
+   {
+      ecx_sim_setl(&sl->mem[ECT_REG_DCSYSDIFF], (diff < 0) ? (0x80000000 | (uint32)-diff) : (uint32)diff);
+   }
+   step = diff / 8;
+   if (!step)
+   {
+      step = diff;
+   }
+   if (step > EC_SIMDCSLEW)
+   {
+      step = EC_SIMDCSLEW;
+   }
+   else if (step < -EC_SIMDCSLEW)
+   {
+      step = -EC_SIMDCSLEW;
+   }
+   sl->clkofs -= step;
+}
+
+/** Look up or write a CoE object entry.
+ * @param[in]     sim      = segment state
+ * @param[in]     sl       = slave
+ * @param[in]     index    = object index
+ * @param[in]     sub      = object subindex
+ * @param[in]     write    = TRUE to write *val
+ * @param[in,out] val      = value read or to write
+ * @param[out]    size     = size of entry in bytes
+ * @return 0 or SDO abort code
+ */
+static uint32 ecx_sim_object(ec_simT *sim, ec_simslaveT *sl, uint16 index, uint8 sub,
+                             boolean write, uint32 *val, int *size)
+{
+   uint32 v;
+   int n;
+   boolean writable;
+
+   v = 0;
+   *size = 1;
+   writable = FALSE;
+   switch (index)
+   {
+   case 0x1000: /* device type */
+      if (sub)
+      {
+         return 0x06090011; /* subindex does not exist */
+      }
+      *size = 4;
+      break;
+   case 0x1018: /* identity */
+      if (sub > 4)
+      {
+         return 0x06090011;
+      }
+      if (!sub)
+      {
+         v = 4;
+         break;
+      }
+      *size = 4;
+      v = (uint32)sl->sii[ECT_SII_MANUF + 2 * (sub - 1)] |
+          ((uint32)sl->sii[ECT_SII_MANUF + 2 * (sub - 1) + 1] << 16);
+      break;
+   case 0x1600: /* RxPDO mapping */
+   case 0x1a00: /* TxPDO mapping */
+      n = (index == 0x1600) ? sim->outbytes : sim->inbytes;
+      if (sub > n)
+      {
+         return 0x06090011;
+      }
+      writable = TRUE;
+      if (!sub)
+      {
+         v = n;
+         break;
+      }
+      *size = 4;
+      v = ((index == 0x1600) ? 0x70000008 : 0x60000008) | ((uint32)sub << 8);
+      break;
+   case ECT_SDO_SMCOMMTYPE:
+      if (sub > 4)
+      {
+         return 0x06090011;
+      }
+      v = sub ? sub : 4;
+      break;
+   case ECT_SDO_RXPDOASSIGN:
+   case ECT_SDO_TXPDOASSIGN:
+      n = (index == ECT_SDO_RXPDOASSIGN) ? sim->outbytes : sim->inbytes;
+      if (sub > ((n > 0) ? 1 : 0))
+      {
+         return 0x06090011;
+      }
+      writable = TRUE;
+      if (!sub)
+      {
+         v = (n > 0) ? 1 : 0;
+         break;
+      }
+      *size = 2;
+      v = (index == ECT_SDO_RXPDOASSIGN) ? 0x1600 : 0x1a00;
+      break;
+   case 0x6000: /* inputs */
+   case 0x7000: /* outputs */
+      n = (index == 0x7000) ? sim->outbytes : sim->inbytes;
+      if (sub > n)
+      {
+         return 0x06090011;
+      }
+      if (!sub)
+      {
+         v = n;
+         break;
+      }
+      if (index == 0x7000)
+      {
+         if (write)
+         {
+            sl->mem[EC_SIMOUTPUTS + sub - 1] = (uint8)*val;
+            return 0;
+         }
+         v = sl->mem[EC_SIMOUTPUTS + sub - 1];
+      }
+      else
+      {
+         v = sl->mem[EC_SIMINPUTS + sub - 1];
+      }
+      break;
+   default:
+      return 0x06020000; /* object does not exist */
+   }
+   if (write)
+   {
+      /* the mapping is fixed, only rewriting it with the same entries works */
+      if (!writable)
+      {
+         return 0x06010002; /* attempt to write a read only object */
+      }
+      if (sub && (*val != v))
+      {
+         return 0x06090030; /* value range exceeded */
+      }
+      return 0;
+   }
+   *val = v;
+
+   return 0;
+}
+
+/** Serve CoE SDO request.
+ * @param[in]  sim      = segment state
+ * @param[in]  sl       = slave
+ * @param[in]  req      = request mailbox
+ * @param[out] rsp      = response mailbox, at least 16 bytes
+ * @return length of response mailbox
+ */
+static int ecx_sim_coe(ec_simT *sim, ec_simslaveT *sl, const uint8 *req, uint8 *rsp)
+{
+   uint8 cmd, sub;
+   uint16 index;
+   uint32 val, abort;
+   int size;
+
+   cmd = req[8];
+   index = ecx_sim_getw(req + 9);
+   sub = req[11];
+   ecx_sim_setw(rsp, 10);
+   rsp[5] = ECT_MBXT_COE | (req[5] & 0xf0);
+   ecx_sim_setw(rsp + 6, ECT_COES_SDORES << 12);
+   ecx_sim_setw(rsp + 9, index);
+   rsp[11] = sub;
+   val = 0;
+   if ((ecx_sim_getw(req + 6) >> 12) != ECT_COES_SDOREQ)
+   {
+      abort = 0x05040001; /* command specifier not valid */
+   }
+   else if (cmd == ECT_SDO_UP_REQ)
+   {
+      abort = ecx_sim_object(sim, sl, index, sub, FALSE, &val, &size);
+      rsp[8] = 0x43 | ((4 - size) << 2); /* expedited upload response */
+   }
+   else if ((cmd & 0xf0) == 0x20)
+   {
+      if (cmd & 0x02)
+      {
+         /* expedited download */
+         size = (cmd & 0x01) ? 4 - ((cmd >> 2) & 0x03) : 4;
+         memcpy(&val, req + 12, size);
+         abort = 0;
+      }
+      else
+      {
+         /* normal download, only single frame with up to 4 bytes */
+         size = (int)ecx_sim_getl(req + 12);
+         abort = 0x06070010; /* length of service parameter does not match */
+         if ((size > 0) && (size <= 4) && (ecx_sim_getw(req) >= 10 + size))
+         {
+            memcpy(&val, req + 16, size);
+            abort = 0;
+         }
+      }
+      if (!abort)
+      {
+         val = ecx_sim_getl((uint8 *)&val);
+         abort = ecx_sim_object(sim, sl, index, sub, TRUE, &val, &size);
+      }
+      rsp[8] = 0x60; /* download response */
+      val = 0;
+   }
+   else if ((cmd == ECT_SDO_UP_REQ_CA) || (cmd == ECT_SDO_DOWN_INIT_CA))
+   {
+      abort = 0x06010000; /* unsupported access to an object */
+   }
+   else
+   {
+      abort = 0x05040001;
+   }
+   if (abort)
+   {
+      rsp[8] = ECT_SDO_ABORT;
+      val = abort;
+   }
+   ecx_sim_setl(rsp + 12, val);
+
+   return 16;
+}
+
+/** Handle mailbox written by master, the response is placed in the read
+ * mailbox at once.
+ * @param[in] sim      = segment state
+ * @param[in] sl       = slave
+ * @param[in] start    = write mailbox start
+ */
+static void ecx_sim_mailbox(ec_simT *sim, ec_simslaveT *sl, int start)
+{
+   uint8 rsp[16];
+   const uint8 *req;
+   int rstart, rlen, n;
+
+   rstart = ecx_sim_sm(sl, 1, &rlen);
+   if ((rstart < 0) || (rstart + rlen > EC_SIMMEMSIZE) || (rlen < (int)sizeof(rsp)) ||
+       (sl->alstatus & 0x0f) < EC_STATE_PRE_OP)
+   {
+      return;
+   }
+   req = &sl->mem[start];
+   memset(rsp, 0, sizeof(rsp));
+   if ((req[5] & 0x0f) == ECT_MBXT_COE)
+   {
+      n = ecx_sim_coe(sim, sl, req, rsp);
+   }
+   else
+   {
+      /* mailbox error, unsupported protocol */
+      ecx_sim_setw(rsp, 4);
+      rsp[5] = ECT_MBXT_ERR;
+      ecx_sim_setw(rsp + 6, 0x0001);
+      ecx_sim_setw(rsp + 8, 0x0002);
+      n = 10;
+   }
+   memset(&sl->mem[rstart], 0, rlen);
+   memcpy(&sl->mem[rstart], rsp, n);
+   sl->mbxfull = TRUE;
+}
+
+/** Read slave memory into datagram. Status registers are updated first.
+ * @param[in] sim      = segment state
+ * @param[in] sl       = slave
+ * @param[in] ado      = memory address
+ * @param[in] data     = datagram data
+ * @param[in] len      = length to read
+ * @param[in] or       = TRUE to OR memory into data, used by broadcast reads
+ * @return 1 if read, 0 if out of range
+ */
+static int ecx_sim_read(ec_simT *sim, ec_simslaveT *sl, int ado, uint8 *data, int len, boolean or)
+{
+   int i, start, smlen;
+
+   if ((ado + len) > EC_SIMMEMSIZE)
+   {
+      return 0;
+   }
+   if (ado < ECT_REG_DCSYSTIME + 8)
+   {
+      if (ecx_sim_covers(ado, len, ECT_REG_ALSTAT, 6))
+      {
+         ecx_sim_setw(&sl->mem[ECT_REG_ALSTAT], sl->alstatus);
+         ecx_sim_setw(&sl->mem[ECT_REG_ALSTATCODE], sl->alcode);
+      }
+      if (ecx_sim_covers(ado, len, ECT_REG_EEPSTAT, 2))
+      {
+         /* never busy, reads 8 bytes at once */
+         ecx_sim_setw(&sl->mem[ECT_REG_EEPSTAT], EC_ESTAT_R64);
+      }
+      if (ecx_sim_covers(ado, len, ECT_REG_SM0STAT, 9))
+      {
+         /* write mailbox is always empty */
+         sl->mem[ECT_REG_SM0STAT] = 0;
+         sl->mem[ECT_REG_SM1STAT] = sl->mbxfull ? 0x08 : 0x00;
+      }
+      if (ecx_sim_covers(ado, len, ECT_REG_DCSYSTIME, 8))
+      {
+         ecx_sim_setll(&sl->mem[ECT_REG_DCSYSTIME], ecx_sim_systime(sim, sl));
+      }
+   }
+   if (or)
+   {
+      for (i = 0; i < len; i++)
+      {
+         data[i] |= sl->mem[ado + i];
+      }
+   }
+   else
+   {
+      memcpy(data, &sl->mem[ado], len);
+   }
+   /* reading the last byte of the read mailbox empties it */
+   if (sl->mbxfull && (ado >= EC_SIMRAM))
+   {
+      start = ecx_sim_sm(sl, 1, &smlen);
+      if ((start >= 0) && ecx_sim_covers(ado, len, start + smlen - 1, 1))
+      {
+         sl->mbxfull = FALSE;
+      }
+   }
+
+   return 1;
+}
+
+/** Write datagram into slave memory and handle the registers written.
+ * @param[in] sim      = segment state
+ * @param[in] sl       = slave
+ * @param[in] ado      = memory address
+ * @param[in] data     = datagram data
+ * @param[in] len      = length to write
+ * @return 1 if written, 0 if out of range
+ */
+static int ecx_sim_write(ec_simT *sim, ec_simslaveT *sl, int ado, const uint8 *data, int len)
+{
+   int start, smlen;
+
+   if ((ado + len) > EC_SIMMEMSIZE)
+   {
+      return 0;
+   }
+   memcpy(&sl->mem[ado], data, len);
+   if (ado < EC_SIMRAM)
+   {
+      if (ecx_sim_covers(ado, len, ECT_REG_ALCTL, 1))
+      {
+         ecx_sim_alctl(sim, sl);
+      }
+      if (ecx_sim_covers(ado, len, ECT_REG_EEPCTL + 1, 1))
+      {
+         ecx_sim_eeprom(sl);
+      }
+      if (ecx_sim_covers(ado, len, ECT_REG_DCTIME0, 1))
+      {
+         ecx_sim_dclatch(sim, sl);
+      }
+      if ((ado == ECT_REG_DCSYSTIME) && (len >= 4))
+      {
+         ecx_sim_dcwrite(sim, sl, len);
+      }
+      return 1;
+   }
+   /* writing the last byte of the write mailbox hands it to the slave */
+   start = ecx_sim_sm(sl, 0, &smlen);
+   if ((start >= 0) && ecx_sim_covers(ado, len, start + smlen - 1, 1))
+   {
+      ecx_sim_mailbox(sim, sl, start);
+   }
+   if (!sl->pdupdate && ecx_sim_covers(ado, len, EC_SIMOUTPUTS, sim->outbytes))
+   {
+      sl->pdupdate = TRUE;
+      sim->pdlist[sim->pdcnt++] = sl->pos;
+   }
+
+   return 1;
+}
+
+/** Logical read and write through the FMMUs of a slave. All writes are done
+ * before the reads, so a slave with inputs and outputs at the same logical
+ * address gets the outputs and returns the inputs.
+ * @param[in] sim      = segment state
+ * @param[in] sl       = slave
+ * @param[in] cmd      = EC_CMD_LRD, EC_CMD_LWR or EC_CMD_LRW
+ * @param[in] logaddr  = logical address of datagram
+ * @param[in] data     = datagram data
+ * @param[in] len      = datagram data length
+ * @return working counter increment
+ */
+static int ecx_sim_logical(ec_simT *sim, ec_simslaveT *sl, uint8 cmd, uint32 logaddr, uint8 *data, int len)
+{
+   uint8 *fmmu;
+   uint64 lstart, lend, s, e;
+   int f, pass, phys, rd, wr;
+
+   rd = 0;
+   wr = 0;
+   for (pass = 0; pass < 2; pass++)
+   {
+      if ((pass == 0) && (cmd == EC_CMD_LRD))
+      {
+         continue;
+      }
+      if ((pass == 1) && (cmd == EC_CMD_LWR))
+      {
+         continue;
+      }
+      for (f = 0; f < EC_SIMFMMU; f++)
+      {
+         fmmu = &sl->mem[ECT_REG_FMMU0 + 16 * f];
+         /* type 1 = read, 2 = write */
+         if (!(fmmu[12] & 0x01) || !(fmmu[11] & ((pass == 0) ? 0x02 : 0x01)))
+         {
+            continue;
+         }
+         lstart = ecx_sim_getl(fmmu);
+         lend = lstart + ecx_sim_getw(fmmu + 4);
+         s = (lstart > logaddr) ? lstart : logaddr;
+         e = (lend < (uint64)logaddr + len) ? lend : (uint64)logaddr + len;
+         if (s >= e)
+         {
+            continue;
+         }
+         phys = ecx_sim_getw(fmmu + 8) + (int)(s - lstart);
+         /* process memory is only mapped from SAFE_OP on */
+         if ((phys >= EC_SIMRAM) && ((sl->alstatus & 0x0f) < EC_STATE_SAFE_OP))
+         {
+            continue;
+         }
+         if (pass == 0)
+         {
+            wr |= ecx_sim_write(sim, sl, phys, data + (s - logaddr), (int)(e - s));
+         }
+         else
+         {
+            rd |= ecx_sim_read(sim, sl, phys, data + (s - logaddr), (int)(e - s), FALSE);
+         }
+      }
+   }
+   if (wr && (cmd == EC_CMD_LRW))
+   {
+      wr = 2;
+   }
+
+   return rd + wr;
+}
+
+/** Pass a datagram through all slaves.
+ * @param[in] sim      = segment state
+ * @param[in] dg       = datagram, starting at command
+ * @param[in] data     = datagram data
+ * @param[in] len      = datagram data length
+ * @return working counter increment
+ */
+static int ecx_sim_datagram(ec_simT *sim, uint8 *dg, uint8 *data, int len)
+{
+   uint8 tmp[EC_BUFSIZE];
+   ec_simslaveT *sl;
+   uint8 cmd;
+   uint16 adp, ado;
+   int i, wkc, op;
+   boolean autoinc;
+   /* slave access, 1 = read, 2 = write, 3 = read and write */
+   enum
+   {
+      RD = 1,
+      WR = 2,
+      RW = 3
+   };
+
+   cmd = dg[0];
+   adp = ecx_sim_getw(dg + 2);
+   ado = ecx_sim_getw(dg + 4);
+   wkc = 0;
+   if ((cmd >= EC_CMD_LRD) && (cmd <= EC_CMD_LRW))
+   {
+      for (i = 0; i < sim->nslave; i++)
+      {
+         wkc += ecx_sim_logical(sim, &sim->slave[i], cmd, adp | ((uint32)ado << 16), data, len);
+      }
+      return wkc;
+   }
+   if ((cmd == EC_CMD_NOP) || (cmd > EC_CMD_FRMW))
+   {
+      return 0;
+   }
+   autoinc = (cmd <= EC_CMD_APRW) || (cmd >= EC_CMD_BRD && cmd <= EC_CMD_BRW) || (cmd == EC_CMD_ARMW);
+   for (i = 0; i < sim->nslave; i++)
+   {
+      sl = &sim->slave[i];
+      op = 0;
+      switch (cmd)
+      {
+      case EC_CMD_APRD:
+      case EC_CMD_APWR:
+      case EC_CMD_APRW:
+         if (!adp)
+         {
+            op = cmd - EC_CMD_APRD + 1;
+         }
+         break;
+      case EC_CMD_FPRD:
+      case EC_CMD_FPWR:
+      case EC_CMD_FPRW:
+         if (ecx_sim_getw(&sl->mem[ECT_REG_STADR]) == adp)
+         {
+            op = cmd - EC_CMD_FPRD + 1;
+         }
+         break;
+      case EC_CMD_BRD:
+      case EC_CMD_BWR:
+      case EC_CMD_BRW:
+         op = cmd - EC_CMD_BRD + 1;
+         break;
+      case EC_CMD_ARMW:
+         op = adp ? WR : RD;
+         break;
+      case EC_CMD_FRMW:
+         op = (ecx_sim_getw(&sl->mem[ECT_REG_STADR]) == adp) ? RD : WR;
+         break;
+      }
+      if (op == RD)
+      {
+         wkc += ecx_sim_read(sim, sl, ado, data, len, (cmd == EC_CMD_BRD));
+      }
+      else if (op == WR)
+      {
+         wkc += ecx_sim_write(sim, sl, ado, data, len);
+      }
+      else if (op == RW)
+      {
+         /* returns old memory contents, writes the data received */
+         memcpy(tmp, data, len);
+         if (ecx_sim_read(sim, sl, ado, data, len, (cmd == EC_CMD_BRW)))
+         {
+            ecx_sim_write(sim, sl, ado, tmp, len);
+            wkc += 3;
+         }
+      }
+      if (autoinc)
+      {
+         adp++;
+      }
+   }
+   if (autoinc)
+   {
+      ecx_sim_setw(dg + 2, adp);
+   }
+
+   return wkc;
+}
+
+/** Pass a frame through the segment.
+ * @param[in] sim      = segment state
+ * @param[in] frame    = frame including ethernet header, updated in place
+ * @param[in] len      = length of frame
+ */
+static void ecx_sim_frame(ec_simT *sim, uint8 *frame, int len)
+{
+   ec_etherheadert *ehp;
+   uint8 *p, *end, *data;
+   uint16 dl;
+   int i, dlen;
+   ec_simslaveT *sl;
+
+   ehp = (ec_etherheadert *)frame;
+   if ((len < (int)(ETH_HEADERSIZE + EC_ELENGTHSIZE)) || (ehp->etype != htons(ETH_P_ECAT)))
+   {
+      return;
+   }
+   p = frame + ETH_HEADERSIZE;
+   end = p + EC_ELENGTHSIZE + (ecx_sim_getw(p) & 0x07ff);
+   if (end > frame + len)
+   {
+      end = frame + len;
+   }
+   p += EC_ELENGTHSIZE;
+   sim->pdcnt = 0;
+   while (p + EC_HEADERSIZE - EC_ELENGTHSIZE <= end)
+   {
+      dl = ecx_sim_getw(p + 6);
+      dlen = dl & 0x07ff;
+      data = p + EC_HEADERSIZE - EC_ELENGTHSIZE;
+      if (data + dlen + EC_WKCSIZE > end)
+      {
+         break;
+      }
+      i = ecx_sim_datagram(sim, p, data, dlen);
+      ecx_sim_setw(data + dlen, ecx_sim_getw(data + dlen) + i);
+      if (!(dl & EC_DATAGRAMFOLLOWS))
+      {
+         break;
+      }
+      p = data + dlen + EC_WKCSIZE;
+   }
+   /* slave application, inputs follow outputs */
+   for (i = 0; i < sim->pdcnt; i++)
+   {
+      sl = &sim->slave[sim->pdlist[i]];
+      memcpy(&sl->mem[EC_SIMINPUTS], &sl->mem[EC_SIMOUTPUTS],
+             (sim->inbytes < sim->outbytes) ? sim->inbytes : sim->outbytes);
+      sl->pdupdate = FALSE;
+   }
+}
+
+/** Append SII category.
+ * @param[in] sii      = SII image
+ * @param[in] pos      = word position of category
+ * @param[in] type     = category type
+ * @param[in] data     = category data
+ * @param[in] len      = length of data in bytes
+ * @return word position of next category
+ */
+static int ecx_sim_siicat(uint16 *sii, int pos, uint16 type, const uint8 *data, int len)
+{
+   int i;
+
+   sii[pos++] = type;
+   sii[pos++] = (uint16)((len + 1) / 2);
+   for (i = 0; i < len; i += 2)
+   {
+      sii[pos++] = (uint16)(data[i] | (((i + 1) < len) ? (data[i + 1] << 8) : 0));
+   }
+
+   return pos;
+}
+
+/** Build SII image of slave.
+ * @param[in] sim      = segment state
+ * @param[in] sl       = slave
+ */
+static void ecx_sim_siiinit(ec_simT *sim, ec_simslaveT *sl)
+{
+   uint8 buf[32];
+   uint16 *sii = sl->sii;
+   int pos, n;
+   const struct
+   {
+      uint16 start, len;
+      uint8 ctrl, activate;
+   } sm[4] = {
+       {EC_SIMMBXIN, EC_SIMMBXSIZE, 0x26, 1},
+       {EC_SIMMBXOUT, EC_SIMMBXSIZE, 0x22, 1},
+       {EC_SIMOUTPUTS, (uint16)sim->outbytes, 0x64, sim->outbytes ? 1 : 0},
+       {EC_SIMINPUTS, (uint16)sim->inbytes, 0x20, sim->inbytes ? 1 : 0},
+   };
+
+   memset(sii, 0xff, sizeof(sl->sii));
+   memset(sii, 0, ECT_SII_START * sizeof(uint16));
+   sii[0x00] = 0x0005; /* PDI control */
+   sii[ECT_SII_MANUF] = (uint16)EC_SIMVENDOR;
+   sii[ECT_SII_MANUF + 1] = (uint16)(EC_SIMVENDOR >> 16);
+   sii[ECT_SII_ID] = (uint16)EC_SIMPRODUCT;
+   sii[ECT_SII_ID + 1] = (uint16)(EC_SIMPRODUCT >> 16);
+   sii[ECT_SII_REV] = (uint16)EC_SIMREVISION;
+   sii[ECT_SII_REV + 1] = (uint16)(EC_SIMREVISION >> 16);
+   sii[ECT_SII_SER] = (uint16)(sl->pos + 1);
+   sii[ECT_SII_BOOTRXMBX] = EC_SIMMBXIN;
+   sii[ECT_SII_BOOTRXMBX + 1] = EC_SIMMBXSIZE;
+   sii[ECT_SII_BOOTTXMBX] = EC_SIMMBXOUT;
+   sii[ECT_SII_BOOTTXMBX + 1] = EC_SIMMBXSIZE;
+   sii[ECT_SII_RXMBXADR] = EC_SIMMBXIN;
+   sii[ECT_SII_RXMBXADR + 1] = EC_SIMMBXSIZE;
+   sii[ECT_SII_TXMBXADR] = EC_SIMMBXOUT;
+   sii[ECT_SII_TXMBXADR + 1] = EC_SIMMBXSIZE;
+   sii[ECT_SII_MBXPROTO] = ECT_MBXPROT_COE;
+   sii[0x3e] = 0x0000; /* EEPROM size 1 KiB */
+   sii[0x3f] = 0x0001; /* SII version */
+   pos = ECT_SII_START;
+
+   n = (int)strlen(ecx_simname);
+   buf[0] = 1;
+   buf[1] = (uint8)n;
+   memcpy(&buf[2], ecx_simname, n);
+   pos = ecx_sim_siicat(sii, pos, ECT_SII_STRING, buf, n + 2);
+
+   memset(buf, 0, sizeof(buf));
+   buf[3] = 1;                                         /* name string */
+   buf[5] = ECT_COEDET_SDO | ECT_COEDET_PDOASSIGN;     /* CoE details */
+   pos = ecx_sim_siicat(sii, pos, ECT_SII_GENERAL, buf, 32);
+
+   buf[0] = 1; /* outputs */
+   buf[1] = 2; /* inputs */
+   buf[2] = 3; /* mailbox state */
+   buf[3] = 0xff;
+   pos = ecx_sim_siicat(sii, pos, ECT_SII_FMMU, buf, 4);
+
+   for (n = 0; n < 4; n++)
+   {
+      buf[8 * n + 0] = (uint8)sm[n].start;
+      buf[8 * n + 1] = (uint8)(sm[n].start >> 8);
+      buf[8 * n + 2] = (uint8)sm[n].len;
+      buf[8 * n + 3] = (uint8)(sm[n].len >> 8);
+      buf[8 * n + 4] = sm[n].ctrl;
+      buf[8 * n + 5] = 0;
+      buf[8 * n + 6] = sm[n].activate;
+      buf[8 * n + 7] = 0;
+   }
+   pos = ecx_sim_siicat(sii, pos, ECT_SII_SM, buf, 32);
+   sii[pos] = 0xffff; /* end */
+}
+
+/** Power up slave.
+ * @param[in] sim      = segment state
+ * @param[in] sl       = slave
+ * @param[in] pos      = position in segment
+ */
+static void ecx_sim_slaveinit(ec_simT *sim, ec_simslaveT *sl, int pos)
+{
+   uint16 dlstat;
+   uint64 x;
+
+   memset(sl, 0, sizeof(*sl));
+   sl->pos = pos;
+   sl->alstatus = EC_STATE_INIT;
+   /* clocks start at different times, spread them over some minutes */
+   x = ((uint64)pos + 1) * 0x9e3779b97f4a7c15ULL;
+   sl->clkofs = (int64)((x >> 24) % 600000000000ULL);
+   sl->mem[ECT_REG_TYPE] = 0x11;
+   sl->mem[0x0004] = EC_SIMFMMU;
+   sl->mem[0x0005] = 8;    /* SMs */
+   sl->mem[0x0006] = 1;    /* process memory in KiB */
+   sl->mem[ECT_REG_PORTDES] = 0x0f; /* port 0 and 1 MII */
+   ecx_sim_setw(&sl->mem[ECT_REG_ESCSUP], 0x000c); /* DC, 64 bit */
+   /* port 0 open with communication, port 1 too unless last slave */
+   dlstat = 0x0001 | 0x0010 | 0x0200 | 0x1000 | 0x4000;
+   dlstat |= (pos < sim->nslave - 1) ? (0x0020 | 0x0800) : 0x0400;
+   ecx_sim_setw(&sl->mem[ECT_REG_DLSTAT], dlstat);
+   ecx_sim_setw(&sl->mem[ECT_REG_PDICTL], 0x0005);
+   ecx_sim_siiinit(sim, sl);
+}
+
+/** Create simulated segment.
+ * @param[out] psim     = segment state, NULL on failure
+ * @param[in]  spec     = segment description "count[:outbytes[:inbytes]]"
+ * @return eventfd to wait on for responses or -1 on failure
+ */
+int ecx_sim_open(ec_simT **psim, const char *spec)
+{
+   ec_simT *sim;
+   char *p;
+   long n, o, i;
+
+   *psim = NULL;
+   o = 2;
+   i = 2;
+   n = strtol(spec, &p, 10);
+   if (*p == ':')
+   {
+      o = strtol(p + 1, &p, 10);
+      if (*p == ':')
+      {
+         i = strtol(p + 1, &p, 10);
+      }
+   }
+   if (*p || (n < 1) || (n > EC_SIMMAXSLAVE) || (o < 0) || (o > EC_SIMMAXPD) ||
+       (i < 0) || (i > EC_SIMMAXPD))
+   {
+      return -1;
+   }
+   sim = calloc(1, sizeof(*sim));
+   if (!sim)
+   {
+      return -1;
+   }
+   sim->nslave = (int)n;
+   sim->outbytes = (int)o;
+   sim->inbytes = (int)i;
+   sim->slave = calloc(n, sizeof(ec_simslaveT));
+   sim->pdlist = calloc(n, sizeof(int));
+   sim->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+   if (!sim->slave || !sim->pdlist || (sim->fd < 0))
+   {
+      if (sim->fd >= 0)
+      {
+         close(sim->fd);
+      }
+      ecx_sim_close(sim);
+      return -1;
+   }
+   for (i = 0; i < n; i++)
+   {
+      ecx_sim_slaveinit(sim, &sim->slave[i], (int)i);
+   }
+
+   *psim = sim;
+   return sim->fd;
+}
+
+/** Release segment state. The eventfd is closed by the caller.
+ * @param[in] sim      = segment state
+ */
+void ecx_sim_close(ec_simT *sim)
+{
+   free(sim->slave);
+   free(sim->pdlist);
+   free(sim);
+}
+
+/** Pass frame through the segment and queue the response.
+ * Caller must serialize calls.
+ * @param[in]  sim      = segment state
+ * @param[in]  buf      = frame to send
+ * @param[in]  len      = length of frame
+ * @param[out] ts       = time frame was sent
+ * @return length of frame or -1 if response queue is full
+ */
+int ecx_sim_put(ec_simT *sim, const void *buf, int len, ec_timet *ts)
+{
+   uint32 head;
+   uint64 one = 1;
+   int slot;
+   int64 wire;
+
+   head = sim->head;
+   if ((head - __atomic_load_n(&sim->tail, __ATOMIC_ACQUIRE)) >= EC_SIMQUEUE)
+   {
+      return -1;
+   }
+   if ((len < 0) || (len > EC_BUFSIZE))
+   {
+      return -1;
+   }
+   slot = head % EC_SIMQUEUE;
+   memcpy(sim->q[slot], buf, len);
+   osal_get_monotonic_time(ts);
+   sim->frametime = (int64)ts->tv_sec * 1000000000 + ts->tv_nsec;
+   ecx_sim_frame(sim, sim->q[slot], len);
+   sim->qlen[slot] = len;
+   /* 100 Mbit/s, 80 ns per byte, plus forwarding delay of all slaves */
+   wire = sim->frametime + (int64)len * 80 + 2 * (int64)sim->nslave * EC_SIMHOPNS;
+   sim->qts[slot].tv_sec = wire / 1000000000;
+   sim->qts[slot].tv_nsec = wire % 1000000000;
+   __atomic_store_n(&sim->head, head + 1, __ATOMIC_RELEASE);
+   if (write(sim->fd, &one, sizeof(one)) < 0)
+   {
+      /* counter overflow is impossible, eventfd stays readable anyway */
+   }
+
+   return len;
+}
+
+/** Non blocking read of response queue. The frame stays queued until
+ * released with ecx_sim_release().
+ * @param[in]  sim      = segment state
+ * @param[out] len      = length of frame
+ * @param[out] ts       = time frame was received
+ * @return pointer to frame or NULL if queue is empty
+ */
+uint8 *ecx_sim_recv(ec_simT *sim, int *len, ec_timet *ts)
+{
+   uint32 tail;
+   uint64 cnt;
+   int slot;
+
+   tail = sim->tail;
+   if (__atomic_load_n(&sim->head, __ATOMIC_ACQUIRE) == tail)
+   {
+      /* clear eventfd before the final check, a response queued after
+       * the check makes it readable again */
+      if (read(sim->fd, &cnt, sizeof(cnt)) < 0)
+      {
+         /* not readable, nothing to clear */
+      }
+      if (__atomic_load_n(&sim->head, __ATOMIC_ACQUIRE) == tail)
+      {
+         *len = 0;
+         return NULL;
+      }
+   }
+   slot = tail % EC_SIMQUEUE;
+   *len = sim->qlen[slot];
+   *ts = sim->qts[slot];
+
+   return sim->q[slot];
+}
+
+/** Release frame returned by ecx_sim_recv().
+ * @param[in] sim      = segment state
+ */
+void ecx_sim_release(ec_simT *sim)
+{
+   __atomic_store_n(&sim->tail, sim->tail + 1, __ATOMIC_RELEASE);
+}
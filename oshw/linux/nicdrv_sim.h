@@ -0,0 +1,31 @@
+/*
+ * This software is dual-licensed under GPLv3 and a commercial
+ * license. See the file LICENSE.md distributed with this software for
+ * full license information.
+ */
+
+/** \file
+ * \brief
+ * Headerfile for nicdrv_sim.c, only used by nicdrv.c
+ */
+
+#ifndef _nicdrv_simh_
+#define _nicdrv_simh_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "oshw.h"
+
+int ecx_sim_open(ec_simT **psim, const char *spec);
+void ecx_sim_close(ec_simT *sim);
+int ecx_sim_put(ec_simT *sim, const void *buf, int len, ec_timet *ts);
+uint8 *ecx_sim_recv(ec_simT *sim, int *len, ec_timet *ts);
+void ecx_sim_release(ec_simT *sim);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
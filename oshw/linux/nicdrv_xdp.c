@@ -0,0 +1,429 @@
+/*
+ * This software is dual-licensed under GPLv3 and a commercial
+ * license. See the file LICENSE.md distributed with this software for
+ * full license information.
+ */
+
+/** \file
+ * \brief
+ * EtherCAT AF_XDP socket driver.
+ *
+ * Backend of nicdrv.c for ECT_NIC_XDP mode. An AF_XDP socket is bound to
+ * one queue of the NIC. A small XDP program, assembled here so no BPF
+ * toolchain or library is needed, redirects EtherCAT frames arriving on that
+ * queue to the socket and passes all other traffic to the network stack.
+ * Frames are exchanged through the UMEM, a memory area shared with the
+ * kernel, and four rings: fill and rx for receive, tx and completion for
+ * transmit.
+ *
+ * The UMEM is split in 2048 byte chunks. The first half is used for
+ * transmit, chunk n of it belongs to tx ring entry n. The second half is
+ * handed to the kernel through the fill ring and receives frames.
+ *
+ * The socket is bound in zero-copy mode if the NIC driver supports it,
+ * otherwise in copy mode. Copy mode works on every interface, including veth.
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <linux/if_xdp.h>
+#include <linux/bpf.h>
+
+#include "oshw.h"
+#include "nicdrv_xdp.h"
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+/** size of one UMEM chunk, a power of two */
+#define EC_XDPFRAMESIZE 2048
+
+/** mapped AF_XDP ring */
+typedef struct
+{
+   /** producer position, shared with kernel */
+   uint32 *producer;
+   /** consumer position, shared with kernel */
+   uint32 *consumer;
+   /** ring entries */
+   void *desc;
+   /** number of entries - 1 */
+   uint32 mask;
+   /** mapped area */
+   void *map;
+   /** size of mapped area */
+   size_t maplen;
+} ec_xskringT;
+
+/** AF_XDP socket state */
+struct ec_xdp
+{
+   /** AF_XDP socket */
+   int fd;
+   /** XSKMAP holding the socket */
+   int mapfd;
+   /** XDP program */
+   int progfd;
+   /** link attaching program to NIC */
+   int linkfd;
+   /** UMEM area */
+   uint8 *umem;
+   /** size of UMEM area */
+   size_t umemlen;
+   /** number of entries in each ring */
+   uint32 ringsize;
+   /** number of transmitted frames reported complete by the kernel */
+   uint32 txdone;
+   /** rx ring */
+   ec_xskringT rx;
+   /** tx ring */
+   ec_xskringT tx;
+   /** fill ring */
+   ec_xskringT fill;
+   /** completion ring */
+   ec_xskringT comp;
+};
+
+static int ecx_xdp_bpf(int cmd, union bpf_attr *attr)
+{
+   return (int)syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+/** Map one ring of the AF_XDP socket.
+ * @param[in]  fd        = AF_XDP socket
+ * @param[out] ring      = ring to map
+ * @param[in]  off       = ring offsets reported by kernel
+ * @param[in]  pgoff     = ring selector
+ * @param[in]  entries   = number of ring entries
+ * @param[in]  entrysize = size of one ring entry
+ * @return 0 if succeeded
+ */
+static int ecx_xdp_mapring(int fd, ec_xskringT *ring, struct xdp_ring_offset *off,
+                           off_t pgoff, uint32 entries, size_t entrysize)
+{
+   ring->maplen = off->desc + entries * entrysize;
+   ring->map = mmap(NULL, ring->maplen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, pgoff);
+   if (ring->map == MAP_FAILED)
+   {
+      ring->map = NULL;
+      return -1;
+   }
+   ring->producer = (uint32 *)((uint8 *)ring->map + off->producer);
+   ring->consumer = (uint32 *)((uint8 *)ring->map + off->consumer);
+   ring->desc = (uint8 *)ring->map + off->desc;
+   ring->mask = entries - 1;
+
+   return 0;
+}
+
+/** Load the XDP program redirecting EtherCAT frames to the socket and attach
+ * it to the NIC.
+ * @param[in] xdp      = AF_XDP socket state
+ * @param[in] ifindex  = NIC interface index
+ * @param[in] queue    = NIC queue the socket is bound to
+ * @return 0 if succeeded
+ */
+static int ecx_xdp_attach(ec_xdpT *xdp, int ifindex, int queue)
+{
+   union bpf_attr attr;
+   uint32 key, value;
+   static const char license[] = "GPL";
+   struct bpf_insn prog[] =
+   {
+      /* r2 = data, r3 = data_end */
+      {BPF_LDX | BPF_MEM | BPF_W, 2, 1, offsetof(struct xdp_md, data), 0},
+      {BPF_LDX | BPF_MEM | BPF_W, 3, 1, offsetof(struct xdp_md, data_end), 0},
+      /* pass frames shorter than an ethernet header */
+      {BPF_ALU64 | BPF_MOV | BPF_X, 4, 2, 0, 0},
+      {BPF_ALU64 | BPF_ADD | BPF_K, 4, 0, 0, ETH_HEADERSIZE},
+      {BPF_JMP | BPF_JGT | BPF_X, 4, 3, 8, 0},
+      /* pass frames that are not EtherCAT */
+      {BPF_LDX | BPF_MEM | BPF_H, 4, 2, 12, 0},
+      {BPF_JMP | BPF_JNE | BPF_K, 4, 0, 6, htons(ETH_P_ECAT)},
+      /* return bpf_redirect_map(xskmap, rx_queue_index, XDP_PASS) */
+      {BPF_LDX | BPF_MEM | BPF_W, 2, 1, offsetof(struct xdp_md, rx_queue_index), 0},
+      {BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, 0},
+      {0, 0, 0, 0, 0},
+      {BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_PASS},
+      {BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map},
+      {BPF_JMP | BPF_EXIT, 0, 0, 0, 0},
+      /* return XDP_PASS */
+      {BPF_ALU64 | BPF_MOV | BPF_K, 0, 0, 0, XDP_PASS},
+      {BPF_JMP | BPF_EXIT, 0, 0, 0, 0},
+   };
+
+   memset(&attr, 0, sizeof(attr));
+   attr.map_type = BPF_MAP_TYPE_XSKMAP;
+   attr.key_size = sizeof(key);
+   attr.value_size = sizeof(value);
+   attr.max_entries = queue + 1;
+   xdp->mapfd = ecx_xdp_bpf(BPF_MAP_CREATE, &attr);
+   if (xdp->mapfd < 0)
+      return -1;
+
+   key = queue;
+   value = xdp->fd;
+   memset(&attr, 0, sizeof(attr));
+   attr.map_fd = xdp->mapfd;
+   attr.key = (uintptr_t)&key;
+   attr.value = (uintptr_t)&value;
+   attr.flags = BPF_ANY;
+   if (ecx_xdp_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0)
+      return -1;
+
+   prog[8].imm = xdp->mapfd;
+   memset(&attr, 0, sizeof(attr));
+   attr.prog_type = BPF_PROG_TYPE_XDP;
+   attr.expected_attach_type = BPF_XDP;
+   attr.insns = (uintptr_t)prog;
+   attr.insn_cnt = sizeof(prog) / sizeof(prog[0]);
+   attr.license = (uintptr_t)license;
+   xdp->progfd = ecx_xdp_bpf(BPF_PROG_LOAD, &attr);
+   if (xdp->progfd < 0)
+      return -1;
+
+   /* the link detaches the program when it is closed */
+   memset(&attr, 0, sizeof(attr));
+   attr.link_create.prog_fd = xdp->progfd;
+   attr.link_create.target_ifindex = ifindex;
+   attr.link_create.attach_type = BPF_XDP;
+   xdp->linkfd = ecx_xdp_bpf(BPF_LINK_CREATE, &attr);
+   if (xdp->linkfd < 0)
+      return -1;
+
+   return 0;
+}
+
+/** Open AF_XDP socket on NIC queue and attach the XDP program.
+ * @param[out] pxdp     = AF_XDP socket state, NULL on failure
+ * @param[in]  ifindex  = NIC interface index
+ * @param[in]  queue    = NIC queue to bind to
+ * @return socket handle or -1 on failure
+ */
+int ecx_xdp_open(ec_xdpT **pxdp, int ifindex, int queue)
+{
+   ec_xdpT *xdp;
+   struct xdp_umem_reg reg;
+   struct xdp_mmap_offsets off;
+   struct sockaddr_xdp sxdp;
+   socklen_t optlen;
+   uint64 *fill;
+   uint32 i, n;
+   int r, fd;
+
+   *pxdp = NULL;
+   xdp = calloc(1, sizeof(*xdp));
+   if (!xdp)
+      return -1;
+   xdp->mapfd = -1;
+   xdp->progfd = -1;
+   xdp->linkfd = -1;
+   n = 1;
+   while (n < 4 * EC_MAXBUF)
+   {
+      n <<= 1;
+   }
+   xdp->ringsize = n;
+   xdp->fd = socket(AF_XDP, SOCK_RAW, 0);
+   if (xdp->fd < 0)
+   {
+      free(xdp);
+      return -1;
+   }
+
+   /* first half of UMEM is for tx, second half for rx */
+   xdp->umemlen = 2 * (size_t)n * EC_XDPFRAMESIZE;
+   xdp->umem = mmap(NULL, xdp->umemlen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (xdp->umem == MAP_FAILED)
+   {
+      xdp->umem = NULL;
+      goto fail;
+   }
+   memset(&reg, 0, sizeof(reg));
+   reg.addr = (uintptr_t)xdp->umem;
+   reg.len = xdp->umemlen;
+   reg.chunk_size = EC_XDPFRAMESIZE;
+   r = setsockopt(xdp->fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg));
+   r |= setsockopt(xdp->fd, SOL_XDP, XDP_UMEM_FILL_RING, &n, sizeof(n));
+   r |= setsockopt(xdp->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &n, sizeof(n));
+   r |= setsockopt(xdp->fd, SOL_XDP, XDP_RX_RING, &n, sizeof(n));
+   r |= setsockopt(xdp->fd, SOL_XDP, XDP_TX_RING, &n, sizeof(n));
+   optlen = sizeof(off);
+   r |= getsockopt(xdp->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen);
+   if (r)
+      goto fail;
+   r = ecx_xdp_mapring(xdp->fd, &xdp->rx, &off.rx, XDP_PGOFF_RX_RING, n, sizeof(struct xdp_desc));
+   r |= ecx_xdp_mapring(xdp->fd, &xdp->tx, &off.tx, XDP_PGOFF_TX_RING, n, sizeof(struct xdp_desc));
+   r |= ecx_xdp_mapring(xdp->fd, &xdp->fill, &off.fr, XDP_UMEM_PGOFF_FILL_RING, n, sizeof(uint64));
+   r |= ecx_xdp_mapring(xdp->fd, &xdp->comp, &off.cr, XDP_UMEM_PGOFF_COMPLETION_RING, n, sizeof(uint64));
+   if (r)
+      goto fail;
+
+   /* hand all rx chunks to the kernel */
+   fill = xdp->fill.desc;
+   for (i = 0; i < n; i++)
+   {
+      fill[i] = (uint64)(n + i) * EC_XDPFRAMESIZE;
+   }
+   __atomic_store_n(xdp->fill.producer, n, __ATOMIC_RELEASE);
+
+   memset(&sxdp, 0, sizeof(sxdp));
+   sxdp.sxdp_family = AF_XDP;
+   sxdp.sxdp_ifindex = ifindex;
+   sxdp.sxdp_queue_id = queue;
+   sxdp.sxdp_flags = XDP_ZEROCOPY;
+   if (bind(xdp->fd, (struct sockaddr *)&sxdp, sizeof(sxdp)) < 0)
+   {
+      /* NIC driver has no zero-copy support */
+      sxdp.sxdp_flags = XDP_COPY;
+      if (bind(xdp->fd, (struct sockaddr *)&sxdp, sizeof(sxdp)) < 0)
+         goto fail;
+   }
+   if (ecx_xdp_attach(xdp, ifindex, queue))
+      goto fail;
+
+   *pxdp = xdp;
+   return xdp->fd;
+
+fail:
+   fd = xdp->fd;
+   ecx_xdp_close(xdp);
+   close(fd);
+   return -1;
+}
+
+/** Detach XDP program and release AF_XDP socket state. The socket itself is
+ * closed by the caller.
+ * @param[in] xdp      = AF_XDP socket state
+ */
+void ecx_xdp_close(ec_xdpT *xdp)
+{
+   if (xdp->linkfd >= 0)
+      close(xdp->linkfd);
+   if (xdp->progfd >= 0)
+      close(xdp->progfd);
+   if (xdp->mapfd >= 0)
+      close(xdp->mapfd);
+   if (xdp->rx.map)
+      munmap(xdp->rx.map, xdp->rx.maplen);
+   if (xdp->tx.map)
+      munmap(xdp->tx.map, xdp->tx.maplen);
+   if (xdp->fill.map)
+      munmap(xdp->fill.map, xdp->fill.maplen);
+   if (xdp->comp.map)
+      munmap(xdp->comp.map, xdp->comp.maplen);
+   if (xdp->umem)
+      munmap(xdp->umem, xdp->umemlen);
+   free(xdp);
+}
+
+/** Put frame in tx ring. Transmission is triggered by ecx_xdp_kick().
+ * Caller must serialize access to the tx ring.
+ * @param[in] xdp      = AF_XDP socket state
+ * @param[in] buf      = frame to send
+ * @param[in] len      = length of frame
+ * @return length of frame or -1 if no free tx chunk
+ */
+int ecx_xdp_put(ec_xdpT *xdp, const void *buf, int len)
+{
+   uint32 prod, cons;
+   uint64 addr;
+   struct xdp_desc *desc;
+
+   /* collect tx chunks the kernel is done with */
+   prod = __atomic_load_n(xdp->comp.producer, __ATOMIC_ACQUIRE);
+   cons = *xdp->comp.consumer;
+   if (prod != cons)
+   {
+      xdp->txdone += prod - cons;
+      __atomic_store_n(xdp->comp.consumer, prod, __ATOMIC_RELEASE);
+   }
+   prod = *xdp->tx.producer;
+   if ((prod - xdp->txdone) >= xdp->ringsize)
+   {
+      /* all tx chunks in flight, kick kernel to complete them */
+      ecx_xdp_kick(xdp);
+      return -1;
+   }
+   addr = (uint64)(prod & xdp->tx.mask) * EC_XDPFRAMESIZE;
+   memcpy(xdp->umem + addr, buf, len);
+   desc = (struct xdp_desc *)xdp->tx.desc + (prod & xdp->tx.mask);
+   desc->addr = addr;
+   desc->len = len;
+   desc->options = 0;
+   __atomic_store_n(xdp->tx.producer, prod + 1, __ATOMIC_RELEASE);
+
+   return len;
+}
+
+/** Let the kernel transmit all frames put in the tx ring.
+ * @param[in] xdp      = AF_XDP socket state
+ * @return 0 or -1 on error
+ */
+int ecx_xdp_kick(ec_xdpT *xdp)
+{
+   /* busy or no buffers means the kernel picks the frames up on the next kick */
+   if ((sendto(xdp->fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0) &&
+       (errno != EAGAIN) && (errno != EBUSY) && (errno != ENOBUFS))
+   {
+      return -1;
+   }
+
+   return 0;
+}
+
+/** Non blocking read of rx ring. The frame stays in the UMEM until released
+ * with ecx_xdp_release().
+ * @param[in]  xdp      = AF_XDP socket state
+ * @param[out] len      = length of frame
+ * @return pointer to frame or NULL if rx ring is empty
+ */
+uint8 *ecx_xdp_recv(ec_xdpT *xdp, int *len)
+{
+   uint32 cons;
+   struct xdp_desc *desc;
+
+   cons = *xdp->rx.consumer;
+   if (__atomic_load_n(xdp->rx.producer, __ATOMIC_ACQUIRE) == cons)
+   {
+      *len = 0;
+      return NULL;
+   }
+   desc = (struct xdp_desc *)xdp->rx.desc + (cons & xdp->rx.mask);
+   *len = desc->len;
+
+   return xdp->umem + desc->addr;
+}
+
+/** Release frame returned by ecx_xdp_recv() and hand its chunk back to the
+ * kernel through the fill ring.
+ * @param[in] xdp      = AF_XDP socket state
+ */
+void ecx_xdp_release(ec_xdpT *xdp)
+{
+   uint32 cons, prod;
+   struct xdp_desc *desc;
+   uint64 *fill;
+
+   cons = *xdp->rx.consumer;
+   desc = (struct xdp_desc *)xdp->rx.desc + (cons & xdp->rx.mask);
+   prod = *xdp->fill.producer;
+   fill = xdp->fill.desc;
+   fill[prod & xdp->fill.mask] = desc->addr & ~(uint64)(EC_XDPFRAMESIZE - 1);
+   __atomic_store_n(xdp->fill.producer, prod + 1, __ATOMIC_RELEASE);
+   __atomic_store_n(xdp->rx.consumer, cons + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,32 @@
+/*
+ * This software is dual-licensed under GPLv3 and a commercial
+ * license. See the file LICENSE.md distributed with this software for
+ * full license information.
+ */
+
+/** \file
+ * \brief
+ * Headerfile for nicdrv_xdp.c, only used by nicdrv.c
+ */
+
+#ifndef _nicdrv_xdph_
+#define _nicdrv_xdph_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "oshw.h"
+
+int ecx_xdp_open(ec_xdpT **pxdp, int ifindex, int queue);
+void ecx_xdp_close(ec_xdpT *xdp);
+int ecx_xdp_put(ec_xdpT *xdp, const void *buf, int len);
+int ecx_xdp_kick(ec_xdpT *xdp);
+uint8 *ecx_xdp_recv(ec_xdpT *xdp, int *len);
+void ecx_xdp_release(ec_xdpT *xdp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -238,6 +238,20 @@ void ecx_setbufstat(ecx_portt *port, uint8 idx, int bufstat)
       port->redport->rxbufstat[idx] = bufstat;
 }
 
+/** Pin or unpin the rx buffer of an index. Frames are always copied to the
+ * rx buffer of their index once received, so a pinned buffer only changes
+ * when its own frame returns and there is nothing to do.
+ * @param[in] port     = port context struct
+ * @param[in] idx      = index in buffer array
+ * @param[in] pinned   = TRUE to pin, FALSE to unpin
+ */
+void ecx_pinrxbuf(ecx_portt *port, uint8 idx, int pinned)
+{
+   (void)port;
+   (void)idx;
+   (void)pinned;
+}
+
 /** Transmit buffer over socket (non blocking).
  * @param[in] port        = port context struct
  * @param[in] idx      = index in tx buffer array
@@ -306,6 +320,29 @@ int ecx_outframe_red(ecx_portt *port, uint8 idx)
    return rval;
 }
 
+/** Transmit list of buffers (non blocking).
+ * Frames are sent one by one with ecx_outframe_red().
+ * @param[in] port        = port context struct
+ * @param[in] idxlist     = indexes in tx buffer array
+ * @param[in] cnt         = number of indexes in list
+ * @return number of frames sent over primary socket
+ */
+int ecx_outframes_red(ecx_portt *port, const uint8 *idxlist, int cnt)
+{
+   int i, sent;
+
+   sent = 0;
+   for (i = 0; i < cnt; i++)
+   {
+      if (ecx_outframe_red(port, idxlist[i]) != -1)
+      {
+         sent++;
+      }
+   }
+
+   return sent;
+}
+
 /** Non blocking read of socket. Put frame in temporary buffer.
  * @param[in] port        = port context struct
  * @param[in] stacknumber = 0=primary 1=secondary stack
@@ -559,6 +596,27 @@ int ecx_waitinframe(ecx_portt *port, uint8 idx, int timeout)
    return wkc;
 }
 
+/** Non blocking receive frame function. Reads all frames pending on the
+ * socket and returns the work counter if the frame with the requested index
+ * is among them or was received before. Frames are not polled in redundant
+ * mode, they need the decision of ecx_waitinframe() over both stacks.
+ * @param[in] port        = port context struct
+ * @param[in] idx         = requested index of frame
+ * @return Workcounter if the frame is received, otherwise EC_NOFRAME.
+ */
+int ecx_pollinframe(ecx_portt *port, uint8 idx)
+{
+   int wkc;
+
+   if (port->redstate != ECT_RED_NONE)
+   {
+      return EC_NOFRAME;
+   }
+   wkc = ecx_inframe(port, idx, 0);
+
+   return (wkc > EC_NOFRAME) ? wkc : EC_NOFRAME;
+}
+
 /** Blocking send and receive frame function. Used for non processdata frames.
  * A datagram is build into a frame and transmitted via this function. It waits
  * for an answer and returns the workcounter. The function retries if time is
@@ -597,3 +655,20 @@ int ecx_srconfirm(ecx_portt *port, uint8 idx, int timeout)
 
    return wkc;
 }
+
+/** Get NIC timestamps of frame. Not supported by this driver.
+ * @param[in]  port        = port context struct
+ * @param[in]  idx         = index of frame
+ * @param[out] txtime      = time frame was sent, always zero
+ * @param[out] rxtime      = time frame was received, always zero
+ * @return 0
+ */
+int ecx_getframetime(ecx_portt *port, uint8 idx, ec_timet *txtime, ec_timet *rxtime)
+{
+   (void)port;
+   (void)idx;
+   memset(txtime, 0, sizeof(*txtime));
+   memset(rxtime, 0, sizeof(*rxtime));
+
+   return 0;
+}
@@ -98,11 +98,15 @@ void ec_setupheader(void *p);
 int ecx_setupnic(ecx_portt *port, const char *ifname, int secondary);
 int ecx_closenic(ecx_portt *port);
 void ecx_setbufstat(ecx_portt *port, uint8 idx, int bufstat);
+void ecx_pinrxbuf(ecx_portt *port, uint8 idx, int pinned);
 uint8 ecx_getindex(ecx_portt *port);
 int ecx_outframe(ecx_portt *port, uint8 idx, int sock);
 int ecx_outframe_red(ecx_portt *port, uint8 idx);
+int ecx_outframes_red(ecx_portt *port, const uint8 *idxlist, int cnt);
 int ecx_waitinframe(ecx_portt *port, uint8 idx, int timeout);
+int ecx_pollinframe(ecx_portt *port, uint8 idx);
 int ecx_srconfirm(ecx_portt *port, uint8 idx, int timeout);
+int ecx_getframetime(ecx_portt *port, uint8 idx, ec_timet *txtime, ec_timet *rxtime);
 
 #ifdef __cplusplus
 }
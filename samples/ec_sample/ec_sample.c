@@ -36,31 +36,15 @@ void add_time_ns(ec_timet *ts, int64 addtime)
    osal_timespecadd(ts, &addts, ts);
 }
 
-static float pgain = 0.01f;
-static float igain = 0.00002f;
 /* set linux sync point 500us later than DC sync, just as example */
 static int64 syncoffset = 500000;
-static int64 timeerror;
-
-/* PI calculation to get linux time synced to DC time */
-void ec_sync(int64 reftime, int64 cycletime, int64 *offsettime)
-{
-   static int64 integral = 0;
-   int64 delta;
-   delta = (reftime - syncoffset) % cycletime;
-   if (delta > (cycletime / 2))
-   {
-      delta = delta - cycletime;
-   }
-   timeerror = -delta;
-   integral += timeerror;
-   *offsettime = (int64)((timeerror * pgain) + (integral * igain));
-}
+/* DC sync controller to get linux time synced to DC time */
+static ec_dcsynct dcsync;
 
 /* Cyclic RT EtherCAT thread */
 OSAL_THREAD_FUNC_RT ecatthread(void)
 {
-   ec_timet ts;
+   ec_timet ts, tnow;
    int ht;
    static int64_t toff = 0;
 
@@ -88,12 +72,10 @@ OSAL_THREAD_FUNC_RT ecatthread(void)
          else
             dowkccheck = 0;
 
-         if (ctx.slavelist[0].hasdc && (wkc > 0))
-         {
-            /* calculate toff to get linux time and DC synced */
-            ec_sync(ctx.DCtime, cycletime, &toff);
-         }
          ecx_mbxhandler(&ctx, 0, 4);
+         /* calculate toff to get linux time and DC synced */
+         osal_get_monotonic_time(&tnow);
+         toff = ecx_dcsync(&ctx, &dcsync, &tnow);
          ecx_send_processdata(&ctx);
       }
    }
@@ -207,6 +189,12 @@ void ecatbringup(char *ifname)
          /* Configure distributed clocks */
          mappingdone = 1;
          ecx_configdc(&ctx);
+         /* Let DC slaves converge to within 1us before cyclic operation */
+         if (ecx_dcstaticdrift(&ctx, 1000, 10000) < 0)
+         {
+            printf("DC slaves not converged.\n");
+         }
+         ecx_dcsync_init(&ctx, &dcsync, EC_DCSYNC_MASTERSHIFT, cycletime, syncoffset);
 
          /* Add all CoE slaves to cyclic mailbox handler */
          int sdoslave = -1;
@@ -260,7 +248,7 @@ void ecatbringup(char *ifname)
                       cycle,
                       wkc,
                       ctx.DCtime,
-                      timeerror);
+                      dcsync.offset);
 
                size = group->Obytes < 8 ? group->Obytes : 8;
                for (int j = 0; j < size; j++)
@@ -0,0 +1,168 @@
+/*
+ * This software is dual-licensed under GPLv3 and a commercial
+ * license. See the file LICENSE.md distributed with this software for
+ * full license information.
+ */
+
+/** \file
+ * \brief Frame round trip time measurement
+ *
+ * Usage: rtt_test IFNAME [backend] [count] [queue] [wait] [ts]
+ * IFNAME is the NIC interface name, e.g. 'eth0'
+ * backend is the NIC backend, e.g. socket, mmap or xdp
+ * wait is poll, spin, busypoll, adaptive or epoll
+ * ts enables NIC timestamps
+ *
+ * Sends count BRD frames one after the other and reports the minimum,
+ * average and maximum time from send to receive for the selected NIC
+ * backend and receive wait mode. With NIC timestamps the time the
+ * frames spent on the wire is reported as well.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "soem/soem.h"
+
+static ecx_contextt ctx;
+
+static const char *waitmodes[] = {"poll", "spin", "busypoll", "adaptive", "epoll"};
+
+static int64 rtt_ns(ec_timet *start, ec_timet *end)
+{
+   ec_timet diff;
+
+   osal_time_diff(start, end, &diff);
+   return (int64)diff.tv_sec * 1000000000 + diff.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+   ec_timet start, end;
+   ec_timet txtime, rxtime;
+   int64 t, tmin, tmax, tsum;
+   int64 tw, twmin, twmax, twsum;
+   int i, count, lost, stamped, wkc, waitmode;
+   uint8 idx;
+   uint16 w;
+   ec_waitstatT *ws;
+
+   printf("SOEM (Simple Open EtherCAT Master)\nrtt_test\n");
+
+   if (argc < 2)
+   {
+      printf("Usage: rtt_test ifname [backend] [count] [queue] [wait] [ts]\n");
+      printf("backend = socket, mmap or xdp\n");
+      printf("wait = poll, spin, busypoll, adaptive or epoll\n");
+      printf("ts = enable NIC timestamps\n");
+      return 1;
+   }
+   ctx.port.nicops = ecx_getnicops((argc > 2) ? argv[2] : "socket");
+   if (ctx.port.nicops == NULL)
+   {
+      printf("Unknown NIC backend %s\n", argv[2]);
+      return 1;
+   }
+   count = (argc > 3) ? atoi(argv[3]) : 10000;
+   ctx.port.nicqueue = (argc > 4) ? atoi(argv[4]) : 0;
+   if (count < 1)
+      count = 1;
+   waitmode = ECT_WAIT_POLL;
+   if (argc > 5)
+   {
+      for (i = 0; i < (int)(sizeof(waitmodes) / sizeof(waitmodes[0])); i++)
+      {
+         if (strcmp(argv[5], waitmodes[i]) == 0)
+            waitmode = ECT_WAIT_POLL + i;
+      }
+   }
+   ctx.port.timestamping = (argc > 6) && (strcmp(argv[6], "ts") == 0);
+
+   if (!ecx_init(&ctx, argv[1]))
+   {
+      printf("No socket connection on %s\n", argv[1]);
+      return 1;
+   }
+   if (!ecx_setwaitmode(&ctx.port, waitmode, 0, 0))
+   {
+      printf("Wait mode %s not available, using poll\n", waitmodes[waitmode]);
+      waitmode = ECT_WAIT_POLL;
+   }
+
+   tmin = INT64_MAX;
+   tmax = 0;
+   tsum = 0;
+   lost = 0;
+   twmin = INT64_MAX;
+   twmax = 0;
+   twsum = 0;
+   stamped = 0;
+   for (i = 0; i < count; i++)
+   {
+      /* same as ecx_BRD(), but keep the frame to read its timestamps */
+      w = 0;
+      osal_get_monotonic_time(&start);
+      idx = ecx_getindex(&ctx.port);
+      ecx_setupdatagram(&ctx.port, &(ctx.port.txbuf[idx]), EC_CMD_BRD, idx, 0x0000, ECT_REG_TYPE, sizeof(w), &w);
+      wkc = ecx_srconfirm(&ctx.port, idx, EC_TIMEOUTRET);
+      osal_get_monotonic_time(&end);
+      if (wkc > EC_NOFRAME && ecx_getframetime(&ctx.port, idx, &txtime, &rxtime))
+      {
+         tw = rtt_ns(&txtime, &rxtime);
+         if (tw < twmin) twmin = tw;
+         if (tw > twmax) twmax = tw;
+         twsum += tw;
+         stamped++;
+      }
+      ecx_setbufstat(&ctx.port, idx, EC_BUF_EMPTY);
+      if (wkc <= EC_NOFRAME)
+      {
+         lost++;
+         continue;
+      }
+      t = rtt_ns(&start, &end);
+      if (t < tmin) tmin = t;
+      if (t > tmax) tmax = t;
+      tsum += t;
+   }
+   if (lost < count)
+   {
+      printf("%d frames, %d lost, rtt min %.1f avg %.1f max %.1f us\n",
+             count,
+             lost,
+             tmin / 1000.0,
+             tsum / 1000.0 / (count - lost),
+             tmax / 1000.0);
+   }
+   else
+   {
+      printf("%d frames, all lost\n", count);
+   }
+   if (stamped > 0)
+   {
+      printf("%d frames timestamped, wire rtt min %.1f avg %.1f max %.1f us\n",
+             stamped,
+             twmin / 1000.0,
+             twsum / 1000.0 / stamped,
+             twmax / 1000.0);
+   }
+   else if (ctx.port.timestamping)
+   {
+      printf("no NIC timestamps available\n");
+   }
+   ws = &ctx.port.waitstat;
+   printf("wait %s: %" PRIu64 " buffered, %" PRIu64 " spins, %" PRIu64 " sleeps, %" PRIu64 " timeouts, "
+          "%.1f us waiting of which %.1f us blocked per frame\n",
+          waitmodes[waitmode],
+          ws->buffered,
+          ws->spins,
+          ws->sleeps,
+          ws->timeouts,
+          ws->waitns / 1000.0 / count,
+          ws->sleepns / 1000.0 / count);
+   ecx_close(&ctx);
+
+   return 0;
+}
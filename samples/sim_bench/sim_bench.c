@@ -0,0 +1,543 @@
+/*
+ * This software is dual-licensed under GPLv3 and a commercial
+ * license. See the file LICENSE.md distributed with this software for
+ * full license information.
+ */
+
+/** \file
+ * \brief Master benchmark on a simulated segment
+ *
+ * Usage: sim_bench [-p] [-n] [-z] [-c us] [segment|trace] [cycles] [record]
+ * -p runs the cycles pipelined, see ecx_contextt.pipelinedMode
+ * -n receives with ecx_poll_processdata() from a poll() loop
+ * -z maps the processdata into the frames, see ecx_contextt.zerocopyMode
+ * -c runs the cycles with the cycle engine at the given cycle time, see
+ *    ecx_cycle_start(), and reports its wakeup statistics
+ * segment is the simulated segment "count[:outbytes[:inbytes]]", e.g. '100:4:2'
+ * trace is a pcap or pcapng file to replay instead
+ * record is a pcapng file to capture all frames to
+ *
+ * Runs the usual start up sequence against the simulated segment of the
+ * "sim" NIC backend and reports how long each step took, then runs cycles
+ * process data exchanges. The simulated slaves copy their outputs to their
+ * inputs, the received inputs and working counters are checked every cycle.
+ * No NIC or slaves are needed, large segments can be set up for testing
+ * f.e. with EC_MAXSLAVE=1001 and segment 1000.
+ *
+ * If the first argument is an existing file the "replay" NIC backend
+ * answers the frames from that recording of a real or simulated segment
+ * instead. Inputs are not checked then. The CPU time per cycle of a replay
+ * only depends on the master, so it can be compared between builds.
+ *
+ * Pipelined, the frames of a cycle are sent before the frames of the
+ * previous cycle are received, the inputs received in a cycle are those of
+ * the previous one.
+ *
+ * On the simulated segment the NIC timestamps of every cycle and the frame
+ * template are checked as well, and register subscriptions are read with
+ * the processdata. After the cycles the identity of the slaves is read
+ * through their mailboxes in mailbox piggyback mode. The exit code is 1 if
+ * any check failed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+
+#include "soem/soem.h"
+
+static ecx_contextt ctx;
+static uint8 IOmap[EC_MAXSLAVE * 2 * 254];
+static int refWKC, badwkc, baddata, badtime, badframes;
+static ec_timet lasttx;
+static uint8 templateidx[EC_MAXBUF];
+static int templateframes;
+static uint16 alstat, allalstat;
+static int subslave, suball;
+
+static int64 cpu_ns(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+   return (int64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int64 elapsed_ns(ec_timet *start)
+{
+   ec_timet end, diff;
+
+   osal_get_monotonic_time(&end);
+   osal_time_diff(start, &end, &diff);
+   return (int64)diff.tv_sec * 1000000000 + diff.tv_nsec;
+}
+
+static uint8 pattern(int cycle, int slave, int byte)
+{
+   return (uint8)(cycle * 7 + slave * 3 + byte);
+}
+
+/* inputs must hold the outputs of this or of the previous cycle, depending
+ * on the order in which the frames passed the slave */
+static int check_inputs(int cycle)
+{
+   ec_slavet *slave;
+   int i, j, n, bad;
+
+   bad = 0;
+   for (i = 1; i <= ctx.slavecount; i++)
+   {
+      slave = &ctx.slavelist[i];
+      n = (slave->Obytes < slave->Ibytes) ? slave->Obytes : slave->Ibytes;
+      for (j = 0; j < n; j++)
+      {
+         if ((slave->inputs[j] != pattern(cycle, i, j)) &&
+             (slave->inputs[j] != pattern(cycle - 1, i, j)))
+         {
+            bad++;
+            break;
+         }
+      }
+   }
+
+   return bad;
+}
+
+/* the frames of a cycle must return after they were sent, and cycles are
+ * sent in order */
+static int check_times(void)
+{
+   ec_groupt *group = &ctx.grouplist[0];
+   int bad;
+
+   bad = !osal_timespecisset(&group->pdtxtime) ||
+         !osal_timespecisset(&group->pdrxtime) ||
+         !osal_timespeccmp(&group->pdrxtime, &group->pdtxtime, >) ||
+         osal_timespeccmp(&group->pdtxtime, &lasttx, <);
+   lasttx = group->pdtxtime;
+
+   return bad;
+}
+
+/* without pipelining the frames of the second cycle are kept as template
+ * and sent again with the same reserved indexes, the first cycle holds the
+ * register reads. A template reserves at most EC_MAXBUF / 2 indexes, a group
+ * with more segments, one frame each, is built every cycle. Zero copy
+ * frames are sent in place without template. */
+static int check_template(int cycle)
+{
+   ec_pdtemplateT *pdtemplate = &ctx.grouplist[0].pdtemplate;
+   int i;
+
+   if (ctx.grouplist[0].zcframes)
+   {
+      return pdtemplate->valid;
+   }
+   if (ctx.grouplist[0].nsegments > (EC_MAXBUF / 2))
+   {
+      return 0;
+   }
+   if (cycle == 2)
+   {
+      templateframes = pdtemplate->frames;
+      memcpy(templateidx, pdtemplate->idx, sizeof(templateidx));
+   }
+   if (!pdtemplate->valid || !templateframes || (pdtemplate->frames != templateframes))
+   {
+      return 1;
+   }
+   for (i = 0; i < templateframes; i++)
+   {
+      if ((pdtemplate->idx[i] != templateidx[i]) || !ctx.pdreserved[templateidx[i]])
+      {
+         return 1;
+      }
+   }
+
+   return 0;
+}
+
+/* wait for the frames of a cycle in our own event loop */
+static int poll_processdata(void)
+{
+   struct pollfd fds;
+   ec_timet start;
+   int wkc;
+
+   fds.fd = ctx.port.sockhandle;
+   fds.events = POLLIN;
+   osal_get_monotonic_time(&start);
+   while (ecx_poll_processdata(&ctx, &wkc) > 0)
+   {
+      if (elapsed_ns(&start) > (int64)EC_TIMEOUTRET * 1000)
+      {
+         /* give up, collect the rest with a timeout */
+         return ecx_receive_processdata(&ctx, EC_TIMEOUTRET);
+      }
+      poll(&fds, 1, 1);
+   }
+
+   return wkc;
+}
+
+static void set_outputs(int cycle)
+{
+   ec_slavet *slave;
+   int i, j;
+
+   for (i = 1; i <= ctx.slavecount; i++)
+   {
+      slave = &ctx.slavelist[i];
+      for (j = 0; j < (int)slave->Obytes; j++)
+      {
+         slave->outputs[j] = pattern(cycle, i, j);
+      }
+   }
+}
+
+/* cycle engine hook, same checks as the benchmark loop */
+static void cycle_hook(ec_cyclet *cycle, ec_cyclephaset phase)
+{
+   int i = (int)cycle->cycles + 1;
+
+   if (phase == EC_CYCLE_OUTPUTS)
+   {
+      set_outputs(i);
+   }
+   else if (phase == EC_CYCLE_INPUTS)
+   {
+      if ((i == 1) && (cycle->wkc >= refWKC))
+      {
+         refWKC = cycle->wkc;
+      }
+      if (cycle->wkc != refWKC)
+      {
+         badwkc++;
+      }
+      else if ((i > 1) && check_inputs(i))
+      {
+         baddata++;
+      }
+      if (check_times())
+      {
+         badtime++;
+      }
+      if (!ctx.mbxpiggybackMode && (i > 1) && check_template(i))
+      {
+         badframes++;
+      }
+   }
+}
+
+/* read the vendor id of each slave through its mailbox while the cycle
+ * engine runs, the mailbox datagrams are carried by the processdata frames */
+static int check_mailbox(int cycletime)
+{
+   ec_cyclet cycle;
+   uint32 vendor;
+   int i, size, bad;
+
+   ctx.mbxpiggybackMode = TRUE;
+   for (i = 1; i <= ctx.slavecount; i++)
+   {
+      ecx_slavembxcyclic(&ctx, (uint16)i);
+   }
+   ecx_cycle_init(&cycle, &ctx, 0, (int64)cycletime * 1000);
+   cycle.hook = cycle_hook;
+   if (!ecx_cycle_start(&cycle))
+   {
+      printf("Can not start cycle engine\n");
+      return ctx.slavecount;
+   }
+   bad = 0;
+   for (i = 1; i <= ctx.slavecount; i++)
+   {
+      vendor = 0;
+      size = sizeof(vendor);
+      if ((ecx_SDOread(&ctx, (uint16)i, 0x1018, 1, FALSE, &size, &vendor, EC_TIMEOUTRXM) <= 0) ||
+          (size != sizeof(vendor)) || (etohl(vendor) != ctx.slavelist[i].eep_man))
+      {
+         bad++;
+      }
+   }
+   ecx_cycle_stop(&cycle);
+   ctx.mbxpiggybackMode = FALSE;
+
+   return bad;
+}
+
+/* print the results of the checks, on the simulated segment the mailbox
+ * check runs first. Returns the number of failed checks. */
+static int check_results(int expectedWKC, int cycletime, boolean replay)
+{
+   ec_regsubT *regsub = ctx.grouplist[0].regsub;
+   int badmbx, badreg;
+
+   badmbx = 0;
+   badreg = 0;
+   if (!replay)
+   {
+      badmbx = check_mailbox((cycletime > 0) ? cycletime : 250);
+      if ((subslave < 0) || (regsub[subslave].wkc != 1) || !regsub[subslave].updates ||
+          ((etohs(alstat) & 0x0f) != EC_STATE_OPERATIONAL))
+      {
+         badreg++;
+      }
+      if ((suball < 0) || (regsub[suball].wkc != ctx.slavecount) || !regsub[suball].updates ||
+          ((etohs(allalstat) & 0x0f) != EC_STATE_OPERATIONAL))
+      {
+         badreg++;
+      }
+   }
+   printf("%d wrong wkc (%d, expected %d), %d wrong inputs\n",
+          badwkc,
+          refWKC,
+          expectedWKC,
+          baddata);
+   if (!replay)
+   {
+      printf("%d wrong timestamps, %d wrong frame templates, %d wrong register reads\n",
+             badtime,
+             badframes,
+             badreg);
+      printf("%d of %d mailbox reads failed\n", badmbx, ctx.slavecount);
+   }
+
+   return badwkc + baddata + badtime + badframes + badreg + badmbx;
+}
+
+static void print_stat(const char *name, ec_cyclestatt *stat)
+{
+   if (stat->count)
+   {
+      printf("%-9s min %.1f avg %.1f max %.1f us\n", name,
+             stat->min / 1000.0,
+             stat->sum / 1000.0 / stat->count,
+             stat->max / 1000.0);
+   }
+}
+
+/* run the cycles with the cycle engine */
+static int run_cycle(int cycles, int cycletime)
+{
+   ec_cyclet cycle;
+
+   ecx_cycle_init(&cycle, &ctx, 0, (int64)cycletime * 1000);
+   cycle.hook = cycle_hook;
+   if (!ecx_cycle_start(&cycle))
+   {
+      printf("Can not start cycle engine\n");
+      return 0;
+   }
+   while (cycle.cycles < (uint64)cycles)
+   {
+      osal_usleep(10000);
+   }
+   ecx_cycle_stop(&cycle);
+   printf("%" PRIu64 " cycles of %d us, %" PRIu64 " overruns\n", cycle.cycles, cycletime, cycle.overruns);
+   print_stat("latency", &cycle.latency);
+   print_stat("exchange", &cycle.exchange);
+   print_stat("overrun", &cycle.overrun);
+
+   return 1;
+}
+
+int main(int argc, char *argv[])
+{
+   const char *segment;
+   ec_timet start;
+   ec_groupt *group;
+   int64 t, tmin, tmax, tsum, cpu;
+   uint64 captured, dropped;
+   int i, cycles, cycletime, wkc, expectedWKC, bad;
+   boolean replay, pipelined, nonblocking;
+
+   printf("SOEM (Simple Open EtherCAT Master)\nsim_bench\n");
+
+   pipelined = FALSE;
+   nonblocking = FALSE;
+   cycletime = 0;
+   while ((argc > 1) && (argv[1][0] == '-'))
+   {
+      if (strcmp(argv[1], "-p") == 0)
+      {
+         pipelined = TRUE;
+      }
+      else if (strcmp(argv[1], "-n") == 0)
+      {
+         nonblocking = TRUE;
+      }
+      else if (strcmp(argv[1], "-z") == 0)
+      {
+         ctx.zerocopyMode = TRUE;
+      }
+      else if ((strcmp(argv[1], "-c") == 0) && (argc > 2))
+      {
+         cycletime = atoi(argv[2]);
+         argc--;
+         argv++;
+      }
+      argc--;
+      argv++;
+   }
+   segment = (argc > 1) ? argv[1] : "100";
+   cycles = (argc > 2) ? atoi(argv[2]) : 10000;
+   if (cycles < 1)
+      cycles = 1;
+   replay = (access(segment, R_OK) == 0);
+   ctx.port.nicops = ecx_getnicops(replay ? "replay" : "sim");
+   ctx.port.timestamping = !replay;
+   if (!ecx_init(&ctx, segment))
+   {
+      printf("Invalid segment or trace %s, use count[:outbytes[:inbytes]]\n", segment);
+      return 1;
+   }
+   /* the segment is fast, give the capture writer some slack */
+   if ((argc > 3) && !ecx_capture_start(&ctx.port, argv[3], 65536))
+   {
+      printf("Can not capture to %s\n", argv[3]);
+   }
+
+   osal_get_monotonic_time(&start);
+   if (ecx_config_init(&ctx) <= 0)
+   {
+      printf("No slaves found\n");
+      ecx_close(&ctx);
+      return 1;
+   }
+   printf("config_init      %8.3f ms, %d slaves\n", elapsed_ns(&start) / 1e6, ctx.slavecount);
+
+   osal_get_monotonic_time(&start);
+   ecx_config_map_group(&ctx, IOmap, 0);
+   group = &ctx.grouplist[0];
+   expectedWKC = (group->outputsWKC * 2) + group->inputsWKC;
+   printf("config_map_group %8.3f ms, %dO+%dI bytes in %d segments%s\n",
+          elapsed_ns(&start) / 1e6, group->Obytes, group->Ibytes, group->nsegments,
+          group->zcframes ? ", zero copy" : "");
+
+   osal_get_monotonic_time(&start);
+   ecx_configdc(&ctx);
+   printf("configdc         %8.3f ms\n", elapsed_ns(&start) / 1e6);
+
+   osal_get_monotonic_time(&start);
+   ecx_statecheck(&ctx, 0, EC_STATE_SAFE_OP, EC_TIMEOUTSTATE * 4);
+   ecx_send_processdata(&ctx);
+   ecx_receive_processdata(&ctx, EC_TIMEOUTRET);
+   ctx.slavelist[0].state = EC_STATE_OPERATIONAL;
+   ecx_writestate(&ctx, 0);
+   ecx_statecheck(&ctx, 0, EC_STATE_OPERATIONAL, EC_TIMEOUTSTATE);
+   if (ctx.slavelist[0].state != EC_STATE_OPERATIONAL)
+   {
+      printf("Not all slaves reached operational state\n");
+      ecx_close(&ctx);
+      return 1;
+   }
+   printf("to operational   %8.3f ms\n", elapsed_ns(&start) / 1e6);
+
+   /* a replay only answers the frames recorded */
+   if (!replay)
+   {
+      subslave = ecx_regsubscribe(&ctx, 0, 1, ECT_REG_ALSTAT, sizeof(alstat), 10, &alstat);
+      suball = ecx_regsubscribe(&ctx, 0, 0, ECT_REG_ALSTAT, sizeof(allalstat), 10, &allalstat);
+   }
+
+   if (pipelined)
+   {
+      /* first cycle in flight */
+      ctx.pipelinedMode = TRUE;
+      set_outputs(0);
+      if (ecx_send_processdata(&ctx) < 0)
+      {
+         printf("Cycle does not fit on the index stack twice, not pipelined\n");
+         ctx.pipelinedMode = FALSE;
+         pipelined = FALSE;
+      }
+   }
+
+   /* a slave is counted again in each frame its mailbox status byte is in
+    * without its inputs, so with several segments the working counter is
+    * larger than expectedWKC. Check the first cycle against expectedWKC and
+    * the following ones against the first. */
+   refWKC = expectedWKC;
+   tmin = INT64_MAX;
+   tmax = 0;
+   tsum = 0;
+   cpu = cpu_ns();
+   badwkc = 0;
+   baddata = 0;
+   if ((cycletime > 0) && !pipelined && !replay)
+   {
+      i = run_cycle(cycles, cycletime);
+      bad = check_results(expectedWKC, cycletime, replay);
+      ecx_close(&ctx);
+      return (!i || bad) ? 1 : 0;
+   }
+   for (i = 1; i <= cycles; i++)
+   {
+      set_outputs(i);
+      osal_get_monotonic_time(&start);
+      /* pipelined, this receives the cycle sent before */
+      ecx_send_processdata(&ctx);
+      if (nonblocking)
+      {
+         wkc = poll_processdata();
+      }
+      else
+      {
+         wkc = ecx_receive_processdata(&ctx, EC_TIMEOUTRET);
+      }
+      t = elapsed_ns(&start);
+      if (t < tmin) tmin = t;
+      if (t > tmax) tmax = t;
+      tsum += t;
+      if ((i == 1) && (wkc >= expectedWKC))
+      {
+         refWKC = wkc;
+      }
+      if (wkc != refWKC)
+      {
+         badwkc++;
+      }
+      else if (!replay && (i > 1) && check_inputs(pipelined ? i - 1 : i))
+      {
+         baddata++;
+      }
+      if (!replay && check_times())
+      {
+         badtime++;
+      }
+      if (!replay && !pipelined && (i > 1) && check_template(i))
+      {
+         badframes++;
+      }
+   }
+   cpu = cpu_ns() - cpu;
+   if (pipelined)
+   {
+      /* last cycle still in flight */
+      ecx_receive_processdata(&ctx, EC_TIMEOUTRET);
+      ctx.pipelinedMode = FALSE;
+   }
+   printf("%d cycles, min %.1f avg %.1f max %.1f us, cpu %.1f us per cycle\n",
+          cycles,
+          tmin / 1000.0,
+          tsum / 1000.0 / cycles,
+          tmax / 1000.0,
+          cpu / 1000.0 / cycles);
+   bad = check_results(expectedWKC, cycletime, replay);
+
+   if (ecx_capture_stats(&ctx.port, &captured, &dropped))
+   {
+      printf("%" PRIu64 " frames captured, %" PRIu64 " dropped\n", captured, dropped);
+   }
+
+   ctx.slavelist[0].state = EC_STATE_INIT;
+   ecx_writestate(&ctx, 0);
+   ecx_close(&ctx);
+
+   return bad ? 1 : 0;
+}
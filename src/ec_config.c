@@ -38,12 +38,42 @@ OSAL_THREAD_HANDLE ecx_threadh[EC_MAX_MAPT];
 /** standard SM0 flags configuration for digital output slaves */
 #define EC_DEFAULTDOSM0  0x00010044
 
+/** Release the frames of a zero copy group.
+ * @param[in]  context    context struct
+ * @param[in]  group      group number
+ */
+static void ecx_config_zerocopy_release(ecx_contextt *context, uint8 group)
+{
+   ec_groupt *grp = &context->grouplist[group];
+   int i;
+
+   for (i = 0; i < grp->zcframes; i++)
+   {
+      context->pdreserved[grp->zcidx[i]] = FALSE;
+      ecx_pinrxbuf(&context->port, grp->zcidx[i], FALSE);
+      ecx_setbufstat(&context->port, grp->zcidx[i], EC_BUF_EMPTY);
+   }
+   grp->zcframes = 0;
+}
+
 void ecx_init_context(ecx_contextt *context)
 {
    int lp;
+   /* mailbox datagrams in flight refer to the slaves and groups */
+   for (lp = 0; lp < EC_MAXGROUP; lp++)
+   {
+      ecx_releasembxdg(context, (uint8)lp);
+   }
    context->slavecount = 0;
    /* clean ec_slave array */
    memset(context->slavelist, 0x00, sizeof(context->slavelist));
+   context->DCbusshift = FALSE;
+   /* frames kept by the groups are free again */
+   ecx_clearpdtemplate(context);
+   for (lp = 0; lp < EC_MAXGROUP; lp++)
+   {
+      ecx_config_zerocopy_release(context, (uint8)lp);
+   }
    memset(context->grouplist, 0x00, sizeof(context->grouplist));
    /* clear slave eeprom cache, does not actually read any eeprom */
    ecx_siigetbyte(context, 0, EC_MAXEEPBUF);
@@ -1245,7 +1275,8 @@ static int ecx_main_config_map_group(ecx_contextt *context, void *pIOmap, uint8
       context->grouplist[group].IOsegment[currentsegment] = segmentsize;
       context->grouplist[group].nsegments = currentsegment + 1;
       context->grouplist[group].mbxstatus = (uint8 *)(pIOmap) + context->grouplist[group].Obytes + context->grouplist[group].Ibytes;
-      context->grouplist[group].mbxstatuslength = LogAddr - context->grouplist[group].Obytes - context->grouplist[group].Ibytes;
+      context->grouplist[group].mbxstatuslength = LogAddr - context->grouplist[group].logstartaddr -
+                                                  context->grouplist[group].Obytes - context->grouplist[group].Ibytes;
       if (!group)
       {
          context->slavelist[0].inputs = (uint8 *)(pIOmap) + context->slavelist[0].Obytes;
@@ -1503,6 +1534,208 @@ static int ecx_config_overlap_map_group(ecx_contextt *context, void *pIOmap, uin
    return 0;
 }
 
+/** Locate a slice of the group processdata in its IO segments.
+ * @param[in]  grp        group
+ * @param[in]  iomap      start of group processdata in the IOmap
+ * @param[in]  ptr        start of slice in the IOmap
+ * @param[in]  length     length of slice in bytes
+ * @param[out] pos        position of slice in the segment
+ * @return segment holding the whole slice, -1 if there is none
+ */
+static int ecx_zerocopy_segment(ec_groupt *grp, uint8 *iomap, uint8 *ptr, uint32 length, uint32 *pos)
+{
+   uint32 offset, start;
+   int i;
+
+   if (ptr < iomap)
+   {
+      return -1;
+   }
+   offset = (uint32)(ptr - iomap);
+   start = 0;
+   for (i = 0; i < grp->nsegments; i++)
+   {
+      if (offset < (start + grp->IOsegment[i]))
+      {
+         *pos = offset - start;
+         return ((offset + length) <= (start + grp->IOsegment[i])) ? i : -1;
+      }
+      start += grp->IOsegment[i];
+   }
+
+   return -1;
+}
+
+/** Translate an IOmap pointer of a zero copy group to the frame buffers.
+ * @param[in]  context    context struct
+ * @param[in]  grp        group
+ * @param[in]  iomap      start of group processdata in the IOmap
+ * @param[in]  ptr        start of slice in the IOmap
+ * @param[in]  length     length of slice in bytes
+ * @param[in]  rx         TRUE for the rx frame, FALSE for the tx frame
+ * @return pointer in frame buffer, NULL if the slice spans frames
+ */
+static uint8 *ecx_zerocopy_ptr(ecx_contextt *context, ec_groupt *grp, uint8 *iomap, uint8 *ptr, uint32 length, boolean rx)
+{
+   uint32 pos;
+   int seg;
+
+   seg = ecx_zerocopy_segment(grp, iomap, ptr, length, &pos);
+   if (seg < 0)
+   {
+      return NULL;
+   }
+   /* rx frame is without ethernet header */
+   if (rx)
+   {
+      return &(context->port.rxbuf[grp->zcidx[seg]][EC_HEADERSIZE + pos]);
+   }
+   return &(context->port.txbuf[grp->zcidx[seg]][ETH_HEADERSIZE + EC_HEADERSIZE + pos]);
+}
+
+/** Number of bytes holding the processdata bits of a slave.
+ * @param[in]  bytes      processdata bytes
+ * @param[in]  bits       processdata bits
+ * @param[in]  startbit   first bit in first byte
+ * @return number of bytes
+ */
+static uint32 ecx_zerocopy_bytes(uint32 bytes, uint16 bits, uint8 startbit)
+{
+   if (bytes)
+   {
+      return bytes;
+   }
+   return ((uint32)startbit + bits + 7) / 8;
+}
+
+/** Place the processdata of a mapped group in frame buffers, see
+ * ecx_contextt.zerocopyMode. Each IO segment gets its own frame with a
+ * reserved index. The slave pointers are moved from the IOmap into the
+ * frames. The group stays in the IOmap if it uses LRD/LWR, if a slave
+ * slice or the mailbox status spans two frames, or if too few frame
+ * indexes are left.
+ * @param[in]  context    context struct
+ * @param[in]  group      group number
+ * @return number of frames used, 0 if the group stays in the IOmap
+ */
+static int ecx_config_zerocopy_group(ecx_contextt *context, uint8 group)
+{
+   ec_groupt *grp = &context->grouplist[group];
+   ecx_portt *port = &context->port;
+   ec_slavet *slave;
+   uint8 *iomap;
+   uint32 LogAdr, start, pos;
+   int i, reserved;
+   uint16 cnt;
+   uint8 idx;
+
+   if (context->overlappedMode || grp->blockLRW || !grp->nsegments ||
+       !(grp->Obytes + grp->Ibytes + grp->mbxstatuslength))
+   {
+      return 0;
+   }
+   /* in bus shift mode the first frame needs room for the write of the
+      reference clock, see ecx_dcsync_init() */
+   if (context->DCbusshift && grp->hasdc && (grp->DCnext == context->slavelist[0].DCnext) &&
+       ((grp->IOsegment[0] + EC_FIRSTDCDATAGRAM + EC_BUSSHIFTDATAGRAM) > EC_MAXLRWDATA))
+   {
+      return 0;
+   }
+   /* leave enough indexes for mailbox and other traffic */
+   reserved = 0;
+   for (i = 0; i < EC_MAXBUF; i++)
+   {
+      if (context->pdreserved[i])
+      {
+         reserved++;
+      }
+   }
+   if ((reserved + grp->nsegments) > (EC_MAXBUF / 2))
+   {
+      return 0;
+   }
+   iomap = grp->outputs;
+   /* every slice must be within one frame */
+   if (grp->mbxstatuslength &&
+       (ecx_zerocopy_segment(grp, iomap, grp->mbxstatus, grp->mbxstatuslength, &pos) < 0))
+   {
+      return 0;
+   }
+   for (cnt = 1; cnt <= context->slavecount; cnt++)
+   {
+      slave = &context->slavelist[cnt];
+      if (group && (group != slave->group))
+      {
+         continue;
+      }
+      if ((slave->Obits && (ecx_zerocopy_segment(grp, iomap, slave->outputs, ecx_zerocopy_bytes(slave->Obytes, slave->Obits, slave->Ostartbit), &pos) < 0)) ||
+          (slave->Ibits && (ecx_zerocopy_segment(grp, iomap, slave->inputs, ecx_zerocopy_bytes(slave->Ibytes, slave->Ibits, slave->Istartbit), &pos) < 0)) ||
+          (slave->mbxstatus && (ecx_zerocopy_segment(grp, iomap, slave->mbxstatus, 1, &pos) < 0)))
+      {
+         return 0;
+      }
+   }
+
+   /* frames start with the content of the IOmap */
+   LogAdr = grp->logstartaddr;
+   start = 0;
+   for (i = 0; i < grp->nsegments; i++)
+   {
+      idx = ecx_getindex(port);
+      context->pdreserved[idx] = TRUE;
+      /* inputs are read from the rx buffer */
+      ecx_pinrxbuf(port, idx, TRUE);
+      grp->zcidx[i] = idx;
+      ecx_setupdatagram(port, &(port->txbuf[idx]), EC_CMD_LRW, idx, LO_WORD(LogAdr), HI_WORD(LogAdr),
+                        (uint16)grp->IOsegment[i], iomap + start);
+      memcpy(&(port->rxbuf[idx][EC_HEADERSIZE]), iomap + start, grp->IOsegment[i]);
+      LogAdr += grp->IOsegment[i];
+      start += grp->IOsegment[i];
+   }
+   grp->zcframes = grp->nsegments;
+
+   for (cnt = 1; cnt <= context->slavecount; cnt++)
+   {
+      slave = &context->slavelist[cnt];
+      if (group && (group != slave->group))
+      {
+         continue;
+      }
+      if (slave->Obits)
+      {
+         slave->outputs = ecx_zerocopy_ptr(context, grp, iomap, slave->outputs, ecx_zerocopy_bytes(slave->Obytes, slave->Obits, slave->Ostartbit), FALSE);
+      }
+      if (slave->Ibits)
+      {
+         slave->inputs = ecx_zerocopy_ptr(context, grp, iomap, slave->inputs, ecx_zerocopy_bytes(slave->Ibytes, slave->Ibits, slave->Istartbit), TRUE);
+      }
+      if (slave->mbxstatus)
+      {
+         slave->mbxstatus = ecx_zerocopy_ptr(context, grp, iomap, slave->mbxstatus, 1, TRUE);
+      }
+   }
+   if (grp->mbxstatuslength)
+   {
+      /* the mailbox status is only read */
+      memset(ecx_zerocopy_ptr(context, grp, iomap, grp->mbxstatus, grp->mbxstatuslength, FALSE), 0, grp->mbxstatuslength);
+      grp->mbxstatus = ecx_zerocopy_ptr(context, grp, iomap, grp->mbxstatus, grp->mbxstatuslength, TRUE);
+   }
+   /* group pointers only cover the first frame */
+   if (grp->Ibytes)
+   {
+      grp->inputs = ecx_zerocopy_ptr(context, grp, iomap, grp->inputs, 1, TRUE);
+   }
+   grp->outputs = ecx_zerocopy_ptr(context, grp, iomap, grp->outputs, 1, FALSE);
+   if (!group)
+   {
+      context->slavelist[0].outputs = grp->outputs;
+      context->slavelist[0].inputs = grp->inputs;
+      context->slavelist[0].mbxstatus = grp->mbxstatus;
+   }
+
+   return grp->zcframes;
+}
+
 /** Map all PDOs in one group of slaves to IOmap
  *
  * In packed mode, processdata for a slave may not start at a byte
@@ -1514,6 +1747,9 @@ static int ecx_config_overlap_map_group(ecx_contextt *context, void *pIOmap, uin
  * frame. Use this mode for TI ESC when using LRW. Packed mode is not
  * possible when overlapped mode is enabled.
  *
+ * In zero copy mode, the processdata is moved from the IOmap into the
+ * frame buffers after mapping, see ecx_contextt.zerocopyMode.
+ *
  * @param[in]  context    context struct
  * @param[out] pIOmap     pointer to IOmap
  * @param[in]  group      group to map, 0 = all groups
@@ -1521,11 +1757,23 @@ static int ecx_config_overlap_map_group(ecx_contextt *context, void *pIOmap, uin
  */
 int ecx_config_map_group(ecx_contextt *context, void *pIOmap, uint8 group)
 {
+   int rval;
+
+   /* processdata frames change with the mapping */
+   ecx_clearpdtemplate(context);
+   ecx_config_zerocopy_release(context, group);
+   ecx_releasembxdg(context, group);
    if (context->overlappedMode)
    {
       return ecx_config_overlap_map_group(context, pIOmap, group);
    }
-   return ecx_main_config_map_group(context, pIOmap, group);
+   rval = ecx_main_config_map_group(context, pIOmap, group);
+   if (context->zerocopyMode)
+   {
+      ecx_config_zerocopy_group(context, group);
+   }
+
+   return rval;
 }
 
 /** Recover slave.
@@ -0,0 +1,323 @@
+/*
+ * This software is dual-licensed under GPLv3 and a commercial
+ * license. See the file LICENSE.md distributed with this software for
+ * full license information.
+ */
+
+/** \file
+ * \brief
+ * Realtime cycle engine.
+ *
+ * Runs the cyclic processdata exchange of one group in a realtime thread,
+ * the loop every application used to copy from the samples. Each cycle
+ * the thread wakes up at an absolute deadline, calls the hook for the
+ * outputs, sends and receives the processdata, calls the hook for the
+ * inputs, runs the mailbox handler and calls the hook for the end of the
+ * cycle.
+ *
+ * With DC sync the deadlines follow the DC reference clock, the cycle
+ * time is corrected by the DC sync controller in master shift mode, or the
+ * reference clock follows the master in bus shift mode, see
+ * ecx_dcsync_init(). Wakeup latency, exchange time and overruns are kept
+ * as statistics with histograms.
+ */
+#include <string.h>
+#include "soem/soem.h"
+#include "osal.h"
+
+/** time to wait for the cycle thread to start in us */
+#define EC_CYCLE_STARTUS 100000
+
+/** Time in ns.
+ * @param[in]  ts             time
+ * @return Time in ns.
+ */
+static int64 ecx_cycle_ns(const ec_timet *ts)
+{
+   return ((int64)ts->tv_sec * 1000000000) + ts->tv_nsec;
+}
+
+/** Add time in ns to a time.
+ * @param[in,out] ts          time
+ * @param[in]  ns             time to add in ns, may be negative
+ */
+static void ecx_cycle_addns(ec_timet *ts, int64 ns)
+{
+   int64 t;
+
+   t = ecx_cycle_ns(ts) + ns;
+   ts->tv_sec = t / 1000000000;
+   ts->tv_nsec = t % 1000000000;
+}
+
+/** Clear statistics.
+ * @param[in]  stat           statistics
+ */
+static void ecx_cycle_initstat(ec_cyclestatt *stat)
+{
+   memset(stat, 0, sizeof(*stat));
+   stat->min = INT64_MAX;
+   stat->max = INT64_MIN;
+}
+
+/** Add a value to statistics.
+ * @param[in]  cycle          cycle engine
+ * @param[in]  stat           statistics
+ * @param[in]  value          value in ns
+ */
+static void ecx_cycle_addstat(ec_cyclet *cycle, ec_cyclestatt *stat, int64 value)
+{
+   int64 bin;
+
+   stat->count++;
+   stat->sum += value;
+   if (value < stat->min)
+   {
+      stat->min = value;
+   }
+   if (value > stat->max)
+   {
+      stat->max = value;
+   }
+   bin = (value > 0) ? (value / cycle->binwidth) : 0;
+   if (bin >= EC_CYCLEBINS)
+   {
+      bin = EC_CYCLEBINS - 1;
+   }
+   stat->bin[bin]++;
+}
+
+/** Wait until the deadline. Sleeps until spintime before the deadline
+ * and busy waits the rest.
+ * @param[in]  cycle          cycle engine
+ * @param[in]  deadline       absolute monotonic time
+ */
+static void ecx_cycle_wait(ec_cyclet *cycle, ec_timet *deadline)
+{
+   ec_timet wakeup, now;
+
+   if (cycle->spintime <= 0)
+   {
+      osal_monotonic_sleep(deadline);
+      return;
+   }
+   wakeup = *deadline;
+   ecx_cycle_addns(&wakeup, -cycle->spintime);
+   osal_monotonic_sleep(&wakeup);
+   do
+   {
+      osal_get_monotonic_time(&now);
+   } while (osal_timespeccmp(&now, deadline, <));
+}
+
+/** Call the hook of the cycle.
+ * @param[in]  cycle          cycle engine
+ * @param[in]  phase          phase of the cycle
+ */
+static void ecx_cycle_hook(ec_cyclet *cycle, ec_cyclephaset phase)
+{
+   if (cycle->hook)
+   {
+      cycle->hook(cycle, phase);
+   }
+}
+
+/** Move the first deadline into the DC cycle, so the processdata passes
+ * the reference clock at the syncoffset of the DC sync controller from the
+ * first cycle on. In bus shift mode the reference clock follows the master
+ * clock already, in master shift mode the DC time is taken from one
+ * exchange. The deadline is moved back by less than one cycle.
+ * @param[in]  cycle          cycle engine
+ * @param[in,out] deadline    first deadline, at least one cycle ahead
+ */
+static void ecx_cycle_dcstart(ec_cyclet *cycle, ec_timet *deadline)
+{
+   ecx_contextt *context = cycle->context;
+   ec_timet sent;
+   int64 dctime, phase;
+
+   if (cycle->sync.cycletime <= 0)
+   {
+      return;
+   }
+   osal_get_monotonic_time(&sent);
+   if (cycle->sync.mode == EC_DCSYNC_BUSSHIFT)
+   {
+      dctime = cycle->sync.base + ecx_cycle_ns(&sent);
+   }
+   else
+   {
+      ecx_send_processdata_group(context, cycle->group);
+      if (ecx_receive_processdata_group(context, cycle->group, cycle->timeout) <= 0)
+      {
+         return;
+      }
+      dctime = context->grouplist[cycle->group].DCtime;
+      /* this exchange is off the DC cycle, not an update of the controller */
+      cycle->sync.lastdctime = context->DCtime;
+   }
+   /* DC time at the deadline */
+   dctime += ecx_cycle_ns(deadline) - ecx_cycle_ns(&sent);
+   phase = (dctime - cycle->sync.syncoffset) % cycle->cycletime;
+   if (phase < 0)
+   {
+      phase += cycle->cycletime;
+   }
+   ecx_cycle_addns(deadline, -phase);
+}
+
+/** Cycle thread.
+ * @param[in]  param          cycle engine
+ */
+static OSAL_THREAD_FUNC_RT ecx_cycle_thread(void *param)
+{
+   ec_cyclet *cycle = (ec_cyclet *)param;
+   ecx_contextt *context = cycle->context;
+   ec_timet deadline, now, sent;
+   int64 late, toff;
+
+   cycle->active = TRUE;
+   if (cycle->cpu >= 0)
+   {
+      osal_thread_setaffinity(cycle->cpu);
+   }
+   /* first deadline on a multiple of the cycle time, with DC sync on the
+      syncoffset in the DC cycle */
+   osal_get_monotonic_time(&deadline);
+   ecx_cycle_addns(&deadline, (2 * cycle->cycletime) - (ecx_cycle_ns(&deadline) % cycle->cycletime));
+   if (cycle->dcsync && cycle->running)
+   {
+      ecx_cycle_dcstart(cycle, &deadline);
+   }
+   while (cycle->running)
+   {
+      ecx_cycle_wait(cycle, &deadline);
+      osal_get_monotonic_time(&now);
+      if (cycle->clearstats)
+      {
+         ecx_cycle_initstat(&cycle->latency);
+         ecx_cycle_initstat(&cycle->exchange);
+         ecx_cycle_initstat(&cycle->overrun);
+         cycle->overruns = 0;
+         cycle->clearstats = FALSE;
+      }
+      ecx_cycle_addstat(cycle, &cycle->latency, ecx_cycle_ns(&now) - ecx_cycle_ns(&deadline));
+
+      ecx_cycle_hook(cycle, EC_CYCLE_OUTPUTS);
+      osal_get_monotonic_time(&sent);
+      toff = 0;
+      if (cycle->dcsync)
+      {
+         toff = ecx_dcsync(context, &cycle->sync, &sent);
+      }
+      ecx_send_processdata_group(context, cycle->group);
+      cycle->wkc = ecx_receive_processdata_group(context, cycle->group, cycle->timeout);
+      osal_get_monotonic_time(&now);
+      ecx_cycle_addstat(cycle, &cycle->exchange, ecx_cycle_ns(&now) - ecx_cycle_ns(&sent));
+      ecx_cycle_hook(cycle, EC_CYCLE_INPUTS);
+      if (cycle->mbxlimit > 0)
+      {
+         ecx_mbxhandler(context, cycle->group, cycle->mbxlimit);
+      }
+      ecx_cycle_hook(cycle, EC_CYCLE_END);
+      cycle->cycles++;
+
+      /* next deadline, skip the ones already passed */
+      ecx_cycle_addns(&deadline, cycle->cycletime + toff);
+      osal_get_monotonic_time(&now);
+      late = ecx_cycle_ns(&now) - ecx_cycle_ns(&deadline);
+      if (late > 0)
+      {
+         ecx_cycle_addstat(cycle, &cycle->overrun, late);
+         while (late > 0)
+         {
+            ecx_cycle_addns(&deadline, cycle->cycletime);
+            late -= cycle->cycletime;
+            cycle->overruns++;
+         }
+      }
+   }
+   cycle->active = FALSE;
+}
+
+/** Set up a cycle engine with default settings: no CPU pinning, no busy
+ * wait, DC sync in master shift mode with syncoffset at half the cycle if
+ * the group has DC, mailbox handler limit 4 and receive timeout
+ * EC_TIMEOUTRET.
+ * @param[out] cycle          cycle engine
+ * @param[in]  context        context struct
+ * @param[in]  group          group to exchange
+ * @param[in]  cycletime      cycle time in ns
+ */
+void ecx_cycle_init(ec_cyclet *cycle, ecx_contextt *context, uint8 group, int64 cycletime)
+{
+   memset(cycle, 0, sizeof(*cycle));
+   cycle->context = context;
+   cycle->group = group;
+   cycle->cycletime = cycletime;
+   cycle->cpu = -1;
+   cycle->dcsync = context->grouplist[group].hasdc;
+   ecx_dcsync_init(context, &cycle->sync, EC_DCSYNC_MASTERSHIFT, cycletime, cycletime / 2);
+   cycle->mbxlimit = 4;
+   cycle->timeout = EC_TIMEOUTRET;
+   cycle->binwidth = EC_CYCLEBINWIDTH;
+   ecx_cycle_initstat(&cycle->latency);
+   ecx_cycle_initstat(&cycle->exchange);
+   ecx_cycle_initstat(&cycle->overrun);
+}
+
+/** Start the cycle thread. The thread gets realtime priority if permitted
+ * and runs at normal priority otherwise. The group is exchanged by the
+ * thread only, until ecx_cycle_stop().
+ * @param[in]  cycle          cycle engine set up by ecx_cycle_init()
+ * @return 1 if the thread runs, 0 if it could not be created or did not
+ * start.
+ */
+int ecx_cycle_start(ec_cyclet *cycle)
+{
+   osal_timert timer;
+
+   if ((cycle->cycletime <= 0) || (cycle->binwidth <= 0) || cycle->active)
+   {
+      return 0;
+   }
+   cycle->running = TRUE;
+   if (!osal_thread_create_rt(&cycle->thread, EC_CYCLESTACK, &ecx_cycle_thread, cycle))
+   {
+      /* a thread created without realtime priority ends right away */
+      cycle->running = FALSE;
+      return 0;
+   }
+   osal_timer_start(&timer, EC_CYCLE_STARTUS);
+   while (!cycle->active && !osal_timer_is_expired(&timer))
+   {
+      osal_usleep(100);
+   }
+   if (!cycle->active)
+   {
+      cycle->running = FALSE;
+      return 0;
+   }
+
+   return 1;
+}
+
+/** Stop the cycle thread, returns after the last cycle has ended.
+ * @param[in]  cycle          cycle engine
+ */
+void ecx_cycle_stop(ec_cyclet *cycle)
+{
+   cycle->running = FALSE;
+   while (cycle->active)
+   {
+      osal_usleep(1000);
+   }
+}
+
+/** Clear the statistics, done by the cycle thread at its next wakeup.
+ * @param[in]  cycle          cycle engine
+ */
+void ecx_cycle_clearstats(ec_cyclet *cycle)
+{
+   cycle->clearstats = TRUE;
+}
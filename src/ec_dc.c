@@ -9,6 +9,7 @@
  * Distributed Clock EtherCAT functions.
  *
  */
+#include <string.h>
 #include "soem/soem.h"
 #include "oshw.h"
 #include "osal.h"
@@ -21,6 +22,100 @@
 /** 1st sync pulse delay in ns here 100ms */
 #define SyncDelay ((int32)100000000)
 
+/** frames of static drift compensation in flight */
+#define EC_DCBURSTPIPE     4
+/** FRMW datagrams per frame of static drift compensation */
+#define EC_DCBURSTDGRAMS   32
+/** frames of static drift compensation between reads of the difference */
+#define EC_DCBURSTCHECK    100
+/** system time differences read per frame */
+#define EC_DCDIFFMULTI     64
+/** slaves per batch of DC register access */
+#define EC_DCBATCH         128
+/** largest register block of DC batch access, DCTIME0 up to DCSOF */
+#define EC_DCBATCHLEN      32
+
+/** proportional gain of master shift as divisor */
+#define EC_DCSYNC_PDIV    100
+/** integral gain of master shift as divisor */
+#define EC_DCSYNC_IDIV    50000
+/** drift is measured over windows of this time in ns, shorter windows
+ * only show the send jitter */
+#define EC_DCSYNC_DRIFTNS  1000000000
+/** drift filter, weight of a new drift value as divisor */
+#define EC_DCSYNC_DRIFTDIV 4
+
+/** Read or write the same DC registers of many slaves. The datagrams are
+ * packed into as few frames as possible and all frames are sent before the
+ * first is waited for. A frame that is lost is sent again once, blocking.
+ *
+ * @param[in]  context        context struct
+ * @param[in]  com            EC_CMD_FPRD or EC_CMD_FPWR
+ * @param[in]  n              number of slaves, up to EC_DCBATCH
+ * @param[in]  slave          list of slave numbers
+ * @param[in]  ado            register address
+ * @param[in]  length         length of register block, up to EC_DCBATCHLEN
+ * @param[in,out] data        n blocks of length bytes, one per slave
+ * @return Number of slaves that responded.
+ */
+static int ecx_dcbatch(ecx_contextt *context, uint8 com, int n, const uint16 *slave, uint16 ado, uint16 length, uint8 *data)
+{
+   ecx_portt *port = &context->port;
+   /* EC_DCBATCH blocks of EC_DCBATCHLEN need less frames than EC_MAXBUF */
+   uint8 idx[EC_MAXBUF];
+   uint16 pos[EC_DCBATCH];
+   uint16 le_wkc;
+   int perframe, frames, cnt, f, i, j, wkc, done;
+
+   if (n <= 0)
+   {
+      return 0;
+   }
+   perframe = (EC_MAXLRWDATA + EC_HEADERSIZE + EC_WKCSIZE) / (length + EC_HEADERSIZE + EC_WKCSIZE);
+   frames = 0;
+   for (i = 0; i < n; i += perframe)
+   {
+      cnt = ((n - i) < perframe) ? (n - i) : perframe;
+      idx[frames] = ecx_getindex(port);
+      ecx_setupdatagram(port, &(port->txbuf[idx[frames]]), com, idx[frames],
+                        context->slavelist[slave[i]].configadr, ado, length, &data[i * length]);
+      pos[i] = EC_HEADERSIZE;
+      for (j = 1; j < cnt; j++)
+      {
+         pos[i + j] = ecx_adddatagram(port, &(port->txbuf[idx[frames]]), com, idx[frames], (j < (cnt - 1)),
+                                      context->slavelist[slave[i + j]].configadr, ado, length,
+                                      &data[(i + j) * length]);
+      }
+      frames++;
+   }
+   ecx_outframes_red(port, idx, frames);
+   done = 0;
+   for (f = 0; f < frames; f++)
+   {
+      wkc = ecx_waitinframe(port, idx[f], EC_TIMEOUTRET);
+      if (wkc <= EC_NOFRAME)
+      {
+         wkc = ecx_srconfirm(port, idx[f], EC_TIMEOUTRET);
+      }
+      for (i = f * perframe; (wkc > EC_NOFRAME) && (i < n) && (i < ((f + 1) * perframe)); i++)
+      {
+         /* every datagram has its own WKC */
+         memcpy(&le_wkc, &(port->rxbuf[idx[f]][pos[i] + length]), EC_WKCSIZE);
+         if (etohs(le_wkc) > 0)
+         {
+            if (com == EC_CMD_FPRD)
+            {
+               memcpy(&data[i * length], &(port->rxbuf[idx[f]][pos[i]]), length);
+            }
+            done++;
+         }
+      }
+      ecx_setbufstat(port, idx[f], EC_BUF_EMPTY);
+   }
+
+   return done;
+}
+
 /**
  * Set DC of slave to fire sync0 at CyclTime interval with CyclShift offset.
  *
@@ -142,6 +237,125 @@ void ecx_dcsync01(ecx_contextt *context, uint16 slave, boolean act, uint32 CyclT
    context->slavelist[slave].DCcycle = CyclTime0;
 }
 
+/* Set DC of many slaves to fire sync0, and sync1 if enabled, with a common
+   start time, see ecx_dcsync0_multi() and ecx_dcsync01_multi() */
+static int ecx_dcsyncbatch(ecx_contextt *context, int n, const uint16 *slave, boolean act, boolean sync1,
+                           uint32 CyclTime0, uint32 CyclTime1, int32 CyclShift)
+{
+   uint16 stop[EC_DCBATCH];
+   int64 start[EC_DCBATCH];
+   int32 tc[EC_DCBATCH * 2];
+   uint8 RA[EC_DCBATCH];
+   uint16 refslave, tclength;
+   uint32 TrueCyclTime;
+   int64 t, t1;
+   int i, j, cnt, done;
+
+   if (n <= 0)
+   {
+      return 0;
+   }
+   TrueCyclTime = CyclTime0;
+   tclength = sizeof(tc[0]);
+   if (sync1)
+   {
+      /* Sync1 can be used as a multiple of Sync0, use true cycle time */
+      TrueCyclTime = ((CyclTime1 / CyclTime0) + 1) * CyclTime0;
+      /* SYNC1 cycle time follows SYNC0 cycle time */
+      tclength = 2 * sizeof(tc[0]);
+   }
+   /* all DC slaves run on the system time of the reference clock */
+   refslave = context->slavelist[0].hasdc ? context->slavelist[0].DCnext : slave[0];
+   t1 = 0;
+   (void)ecx_FPRD(&context->port, context->slavelist[refslave].configadr, ECT_REG_DCSYSTIME, sizeof(t1), &t1, EC_TIMEOUTRET); /* read local time of slave */
+   t1 = etohll(t1);
+   /* first trigger time as in ecx_dcsync0() and ecx_dcsync01(), common for
+      all slaves */
+   if (CyclTime0 > 0)
+   {
+      t = ((t1 + SyncDelay) / TrueCyclTime) * TrueCyclTime + TrueCyclTime + CyclShift;
+   }
+   else
+   {
+      t = t1 + SyncDelay + CyclShift;
+   }
+   done = 0;
+   for (i = 0; i < n; i += cnt)
+   {
+      cnt = ((n - i) < EC_DCBATCH) ? (n - i) : EC_DCBATCH;
+      for (j = 0; j < cnt; j++)
+      {
+         stop[j] = 0;
+         start[j] = htoell(t);
+         RA[j] = 0;
+         if (act)
+         {
+            RA[j] = sync1 ? (1 + 2 + 4) : (1 + 2);
+         }
+         if (sync1)
+         {
+            tc[2 * j] = htoel(CyclTime0);
+            tc[(2 * j) + 1] = htoel(CyclTime1);
+         }
+         else
+         {
+            tc[j] = htoel(CyclTime0);
+         }
+      }
+      /* write access to ethercat and stop cyclic operation in one write */
+      ecx_dcbatch(context, EC_CMD_FPWR, cnt, &slave[i], ECT_REG_DCCUC, sizeof(stop[0]), (uint8 *)stop);
+      ecx_dcbatch(context, EC_CMD_FPWR, cnt, &slave[i], ECT_REG_DCSTART0, sizeof(start[0]), (uint8 *)start);
+      ecx_dcbatch(context, EC_CMD_FPWR, cnt, &slave[i], ECT_REG_DCCYCLE0, tclength, (uint8 *)tc);
+      done += ecx_dcbatch(context, EC_CMD_FPWR, cnt, &slave[i], ECT_REG_DCSYNCACT, sizeof(RA[0]), RA);
+      for (j = 0; j < cnt; j++)
+      {
+         context->slavelist[slave[i + j]].DCactive = (uint8)act;
+         context->slavelist[slave[i + j]].DCshift = CyclShift;
+         context->slavelist[slave[i + j]].DCcycle = CyclTime0;
+      }
+   }
+
+   return done;
+}
+
+/**
+ * Set DC of many slaves to fire sync0 at CyclTime interval with CyclShift
+ * offset. Same as ecx_dcsync0() for each slave, but the registers of all
+ * slaves are written in batches and all slaves get the same start time.
+ *
+ * @param[in]  context          context struct
+ * @param [in] n                Number of slaves.
+ * @param [in] slave            List of slave numbers.
+ * @param [in] act              TRUE = active, FALSE = deactivated
+ * @param [in] CyclTime         Cycltime in ns.
+ * @param [in] CyclShift        CyclShift in ns.
+ * @return Number of slaves set.
+ */
+int ecx_dcsync0_multi(ecx_contextt *context, int n, const uint16 *slave, boolean act, uint32 CyclTime, int32 CyclShift)
+{
+   return ecx_dcsyncbatch(context, n, slave, act, FALSE, CyclTime, 0, CyclShift);
+}
+
+/**
+ * Set DC of many slaves to fire sync0 and sync1 at CyclTime interval with
+ * CyclShift offset. Same as ecx_dcsync01() for each slave, but the registers
+ * of all slaves are written in batches and all slaves get the same start
+ * time.
+ *
+ * @param[in]  context          context struct
+ * @param [in] n                Number of slaves.
+ * @param [in] slave            List of slave numbers.
+ * @param [in] act              TRUE = active, FALSE = deactivated
+ * @param [in] CyclTime0        Cycltime SYNC0 in ns.
+ * @param [in] CyclTime1        Cycltime SYNC1 in ns, see ecx_dcsync01().
+ * @param [in] CyclShift        CyclShift in ns.
+ * @return Number of slaves set.
+ */
+int ecx_dcsync01_multi(ecx_contextt *context, int n, const uint16 *slave, boolean act, uint32 CyclTime0, uint32 CyclTime1, int32 CyclShift)
+{
+   return ecx_dcsyncbatch(context, n, slave, act, TRUE, CyclTime0, CyclTime1, CyclShift);
+}
+
 /* latched port time of slave */
 static int32 ecx_porttime(ecx_contextt *context, uint16 slave, uint8 port)
 {
@@ -241,6 +455,52 @@ static uint8 ecx_parentport(ecx_contextt *context, uint16 parent)
    return parentport;
 }
 
+/* read latched port times and receive time of DC slaves, set their system
+   time offset so that the local time starts around mastertime */
+static void ecx_dcsetoffsets(ecx_contextt *context, int n, const uint16 *slave, uint64 mastertime64)
+{
+   uint8 buf[EC_DCBATCH * EC_DCBATCHLEN];
+   int64 hrt[EC_DCBATCH];
+   int32 ht;
+   uint8 *p;
+   int i;
+
+   memset(buf, 0, n * EC_DCBATCHLEN);
+   /* DCTIME0-3 and DCSOF in one block */
+   ecx_dcbatch(context, EC_CMD_FPRD, n, slave, ECT_REG_DCTIME0, EC_DCBATCHLEN, buf);
+   for (i = 0; i < n; i++)
+   {
+      p = &buf[i * EC_DCBATCHLEN];
+      memcpy(&ht, p + (ECT_REG_DCTIME0 - ECT_REG_DCTIME0), sizeof(ht));
+      context->slavelist[slave[i]].DCrtA = etohl(ht);
+      memcpy(&ht, p + (ECT_REG_DCTIME1 - ECT_REG_DCTIME0), sizeof(ht));
+      context->slavelist[slave[i]].DCrtB = etohl(ht);
+      memcpy(&ht, p + (ECT_REG_DCTIME2 - ECT_REG_DCTIME0), sizeof(ht));
+      context->slavelist[slave[i]].DCrtC = etohl(ht);
+      memcpy(&ht, p + (ECT_REG_DCTIME3 - ECT_REG_DCTIME0), sizeof(ht));
+      context->slavelist[slave[i]].DCrtD = etohl(ht);
+      /* 64bit latched DCrecvTimeA of each specific slave */
+      memcpy(&hrt[i], p + (ECT_REG_DCSOF - ECT_REG_DCTIME0), sizeof(hrt[i]));
+      /* use it as offset in order to set local time around 0 + mastertime */
+      hrt[i] = htoell(-etohll(hrt[i]) + mastertime64);
+   }
+   /* save it in the offset register */
+   ecx_dcbatch(context, EC_CMD_FPWR, n, slave, ECT_REG_DCSYSOFFSET, sizeof(hrt[0]), (uint8 *)hrt);
+}
+
+/* write propagation delay of DC slaves */
+static void ecx_dcsetdelays(ecx_contextt *context, int n, const uint16 *slave)
+{
+   int32 ht[EC_DCBATCH];
+   int i;
+
+   for (i = 0; i < n; i++)
+   {
+      ht[i] = htoel(context->slavelist[slave[i]].pdelay);
+   }
+   ecx_dcbatch(context, EC_CMD_FPWR, n, slave, ECT_REG_DCSYSDELAY, sizeof(ht[0]), (uint8 *)ht);
+}
+
 /**
  * Locate DC slaves, measure propagation delays.
  *
@@ -249,18 +509,22 @@ static uint8 ecx_parentport(ecx_contextt *context, uint16 parent)
  */
 boolean ecx_configdc(ecx_contextt *context)
 {
-   uint16 i, slaveh, parent, child;
+   uint16 i, parent, child;
    uint16 parenthold = 0;
    uint16 prevDCslave = 0;
+   uint16 dclist[EC_DCBATCH];
    int32 ht, dt1, dt2, dt3;
-   int64 hrt;
    uint8 entryport;
+   int n;
    int8 nlist;
    int8 plist[4];
    int32 tlist[4];
    ec_timet mastertime;
    uint64 mastertime64;
 
+   /* the DC datagram is part of the processdata frames */
+   ecx_clearpdtemplate(context);
+   context->DCbusshift = FALSE;
    context->slavelist[0].hasdc = FALSE;
    context->grouplist[0].hasdc = FALSE;
    ht = 0;
@@ -269,6 +533,20 @@ boolean ecx_configdc(ecx_contextt *context)
    mastertime = osal_current_time();
    mastertime.tv_sec -= 946684800UL; /* EtherCAT uses 2000-01-01 as epoch start instead of 1970-01-01 */
    mastertime64 = ((uint64)mastertime.tv_sec * 1000 * 1000 * 1000) + (uint64)mastertime.tv_nsec;
+   /* port times of all DC slaves are read and offsets written in batches */
+   n = 0;
+   for (i = 1; i <= context->slavecount; i++)
+   {
+      if (context->slavelist[i].hasdc)
+      {
+         dclist[n++] = i;
+      }
+      if ((n == EC_DCBATCH) || ((i == context->slavecount) && (n > 0)))
+      {
+         ecx_dcsetoffsets(context, n, dclist, mastertime64);
+         n = 0;
+      }
+   }
    for (i = 1; i <= context->slavecount; i++)
    {
       context->slavelist[i].consumedports = context->slavelist[i].activeports;
@@ -290,21 +568,6 @@ boolean ecx_configdc(ecx_contextt *context)
          /* this branch has DC slave so remove parenthold */
          parenthold = 0;
          prevDCslave = i;
-         slaveh = context->slavelist[i].configadr;
-         (void)ecx_FPRD(&context->port, slaveh, ECT_REG_DCTIME0, sizeof(ht), &ht, EC_TIMEOUTRET);
-         context->slavelist[i].DCrtA = etohl(ht);
-         /* 64bit latched DCrecvTimeA of each specific slave */
-         (void)ecx_FPRD(&context->port, slaveh, ECT_REG_DCSOF, sizeof(hrt), &hrt, EC_TIMEOUTRET);
-         /* use it as offset in order to set local time around 0 + mastertime */
-         hrt = htoell(-etohll(hrt) + mastertime64);
-         /* save it in the offset register */
-         (void)ecx_FPWR(&context->port, slaveh, ECT_REG_DCSYSOFFSET, sizeof(hrt), &hrt, EC_TIMEOUTRET);
-         (void)ecx_FPRD(&context->port, slaveh, ECT_REG_DCTIME1, sizeof(ht), &ht, EC_TIMEOUTRET);
-         context->slavelist[i].DCrtB = etohl(ht);
-         (void)ecx_FPRD(&context->port, slaveh, ECT_REG_DCTIME2, sizeof(ht), &ht, EC_TIMEOUTRET);
-         context->slavelist[i].DCrtC = etohl(ht);
-         (void)ecx_FPRD(&context->port, slaveh, ECT_REG_DCTIME3, sizeof(ht), &ht, EC_TIMEOUTRET);
-         context->slavelist[i].DCrtD = etohl(ht);
 
          /* make list of active ports and their time stamps */
          nlist = 0;
@@ -400,9 +663,13 @@ boolean ecx_configdc(ecx_contextt *context)
             /* assumption : forward delay equals return delay */
             context->slavelist[i].pdelay = ((dt3 - dt1) / 2) + dt2 +
                                            context->slavelist[parent].pdelay;
-            ht = htoel(context->slavelist[i].pdelay);
-            /* write propagation delay*/
-            (void)ecx_FPWR(&context->port, slaveh, ECT_REG_DCSYSDELAY, sizeof(ht), &ht, EC_TIMEOUTRET);
+            /* write propagation delay, batched */
+            dclist[n++] = i;
+            if (n == EC_DCBATCH)
+            {
+               ecx_dcsetdelays(context, n, dclist);
+               n = 0;
+            }
          }
       }
       else
@@ -423,6 +690,335 @@ boolean ecx_configdc(ecx_contextt *context)
          }
       }
    }
+   if (n > 0)
+   {
+      ecx_dcsetdelays(context, n, dclist);
+   }
 
    return context->slavelist[0].hasdc;
 }
+
+/** Largest system time difference of the DC slaves following the reference
+ * clock, read with multiple datagrams per frame.
+ *
+ * @param[in]  context        context struct
+ * @return Largest absolute difference in ns, or -1 if a slave did not respond.
+ */
+static int32 ecx_dcmaxdiff(ecx_contextt *context)
+{
+   ecx_portt *port = &context->port;
+   uint16 configadr[EC_DCDIFFMULTI];
+   uint16 pos[EC_DCDIFFMULTI];
+   uint16 slave;
+   uint16 le_wkc;
+   uint32 diff;
+   int32 maxdiff;
+   uint8 idx;
+   int n, i, wkc;
+
+   maxdiff = 0;
+   diff = 0;
+   slave = context->slavelist[context->slavelist[0].DCnext].DCnext;
+   while (slave)
+   {
+      n = 0;
+      while (slave && (n < EC_DCDIFFMULTI))
+      {
+         configadr[n++] = context->slavelist[slave].configadr;
+         slave = context->slavelist[slave].DCnext;
+      }
+      idx = ecx_getindex(port);
+      ecx_setupdatagram(port, &(port->txbuf[idx]), EC_CMD_FPRD, idx, configadr[0], ECT_REG_DCSYSDIFF, sizeof(diff), &diff);
+      pos[0] = EC_HEADERSIZE;
+      for (i = 1; i < n; i++)
+      {
+         pos[i] = ecx_adddatagram(port, &(port->txbuf[idx]), EC_CMD_FPRD, idx, (i < (n - 1)),
+                                  configadr[i], ECT_REG_DCSYSDIFF, sizeof(diff), &diff);
+      }
+      wkc = ecx_srconfirm(port, idx, EC_TIMEOUTRET);
+      for (i = 0; (wkc > 0) && (i < n); i++)
+      {
+         /* the returned WKC is the one of the last datagram, check each */
+         memcpy(&le_wkc, &(port->rxbuf[idx][pos[i] + sizeof(diff)]), EC_WKCSIZE);
+         wkc = etohs(le_wkc);
+         memcpy(&diff, &(port->rxbuf[idx][pos[i]]), sizeof(diff));
+         /* bit 31 is the sign, the rest the absolute difference */
+         diff = etohl(diff) & 0x7fffffff;
+         if ((int32)diff > maxdiff)
+         {
+            maxdiff = (int32)diff;
+         }
+      }
+      ecx_setbufstat(port, idx, EC_BUF_EMPTY);
+      if (wkc <= 0)
+      {
+         return -1;
+      }
+   }
+
+   return maxdiff;
+}
+
+/**
+ * Static drift compensation, lets the DC slaves converge to the reference
+ * clock before the cyclic processdata starts. Frames full of FRMW datagrams
+ * of the reference clock system time are sent back to back with several
+ * frames in flight, every write steps the time control loop of all following
+ * DC slaves. Between rounds the system time difference (0x092C) of the DC
+ * slaves is read until all are within the threshold.
+ *
+ * Call after ecx_configdc().
+ *
+ * @param[in]  context        context struct
+ * @param[in]  threshold      largest system time difference in ns
+ * @param[in]  maxframes      largest number of frames to send
+ * @return Number of frames sent until all DC slaves were within the
+ * threshold, 0 if there are no DC slaves, -1 if not converged.
+ */
+int ecx_dcstaticdrift(ecx_contextt *context, int32 threshold, int maxframes)
+{
+   ecx_portt *port = &context->port;
+   uint8 idx[EC_DCBURSTPIPE];
+   uint16 refadr;
+   int64 t;
+   int32 maxdiff;
+   int sent, round, n, i, j;
+
+   if (!context->slavelist[0].hasdc)
+   {
+      return 0;
+   }
+   refadr = context->slavelist[context->slavelist[0].DCnext].configadr;
+   t = 0;
+   for (i = 0; i < EC_DCBURSTPIPE; i++)
+   {
+      idx[i] = ecx_getindex(port);
+      ecx_setupdatagram(port, &(port->txbuf[idx[i]]), EC_CMD_FRMW, idx[i], refadr, ECT_REG_DCSYSTIME, sizeof(t), &t);
+      for (j = 1; j < EC_DCBURSTDGRAMS; j++)
+      {
+         ecx_adddatagram(port, &(port->txbuf[idx[i]]), EC_CMD_FRMW, idx[i], (j < (EC_DCBURSTDGRAMS - 1)),
+                         refadr, ECT_REG_DCSYSTIME, sizeof(t), &t);
+      }
+   }
+   sent = 0;
+   maxdiff = -1;
+   while (sent < maxframes)
+   {
+      round = maxframes - sent;
+      if (round > EC_DCBURSTCHECK)
+      {
+         round = EC_DCBURSTCHECK;
+      }
+      n = (round < EC_DCBURSTPIPE) ? round : EC_DCBURSTPIPE;
+      /* keep n frames in flight, a received frame is sent again as is */
+      ecx_outframes_red(port, idx, n);
+      for (i = 0; i < round; i++)
+      {
+         ecx_waitinframe(port, idx[i % n], EC_TIMEOUTRET);
+         if ((i + n) < round)
+         {
+            ecx_outframe_red(port, idx[i % n]);
+         }
+      }
+      sent += round;
+      maxdiff = ecx_dcmaxdiff(context);
+      if ((maxdiff >= 0) && (maxdiff <= threshold))
+      {
+         break;
+      }
+   }
+   for (i = 0; i < EC_DCBURSTPIPE; i++)
+   {
+      ecx_setbufstat(port, idx[i], EC_BUF_EMPTY);
+   }
+
+   return ((maxdiff >= 0) && (maxdiff <= threshold)) ? sent : -1;
+}
+
+/** Time in ns.
+ * @param[in]  ts             time
+ * @return Time in ns.
+ */
+static int64 ecx_dcsync_ns(const ec_timet *ts)
+{
+   return ((int64)ts->tv_sec * 1000000000) + ts->tv_nsec;
+}
+
+/**
+ * Set up a DC sync controller for the reference clock found by
+ * ecx_configdc(). The controller is updated every cycle by ecx_dcsync().
+ *
+ * In master shift mode the master corrects its cycle time so that the
+ * processdata passes the reference clock at syncoffset in the DC cycle.
+ *
+ * In bus shift mode the reference clock is set to follow the master clock.
+ * The difference of both clocks is read once here, from then on the master
+ * time is written to the system time of the reference clock with the
+ * processdata, in front of the DC datagram. The time control loop of the
+ * reference clock then removes the drift and all other DC slaves follow
+ * the reference clock as before. Must not be called while processdata is
+ * exchanged.
+ *
+ * @param[in]  context        context struct
+ * @param[out] sync           DC sync controller
+ * @param[in]  mode           EC_DCSYNC_MASTERSHIFT or EC_DCSYNC_BUSSHIFT
+ * @param[in]  cycletime      cycle time in ns
+ * @param[in]  syncoffset     master shift: DC time in the cycle at which the
+ *                            processdata passes the reference clock, in ns
+ * @return 1 if set up, 0 if there is no reference clock or it does not
+ * respond. In bus shift mode also 0 if the first frame of a zero copy group
+ * with the reference clock has no room for the write.
+ */
+int ecx_dcsync_init(ecx_contextt *context, ec_dcsynct *sync, ec_dcsyncmodet mode, int64 cycletime, int64 syncoffset)
+{
+   ec_groupt *grp;
+   ec_timet t1, t2;
+   int64 dctime;
+   int wkc, group;
+
+   memset(sync, 0, sizeof(*sync));
+   sync->mode = mode;
+   sync->cycletime = cycletime;
+   sync->syncoffset = syncoffset;
+   /* only a DC time received after the start counts */
+   sync->lastdctime = context->DCtime;
+   if (!context->slavelist[0].hasdc || (cycletime <= 0))
+   {
+      return 0;
+   }
+   if (mode == EC_DCSYNC_BUSSHIFT)
+   {
+      /* zero copy frames are laid out at mapping, the write must fit in
+         the first one next to the DC datagram */
+      for (group = 0; group < EC_MAXGROUP; group++)
+      {
+         grp = &context->grouplist[group];
+         if (grp->zcframes && grp->hasdc && (grp->DCnext == context->slavelist[0].DCnext) &&
+             ((grp->IOsegment[0] + EC_FIRSTDCDATAGRAM + EC_BUSSHIFTDATAGRAM) > EC_MAXLRWDATA))
+         {
+            return 0;
+         }
+      }
+      osal_get_monotonic_time(&t1);
+      wkc = ecx_FPRD(&context->port, context->slavelist[context->slavelist[0].DCnext].configadr,
+                     ECT_REG_DCSYSTIME, sizeof(dctime), &dctime, EC_TIMEOUTRET);
+      osal_get_monotonic_time(&t2);
+      if (wkc <= 0)
+      {
+         return 0;
+      }
+      /* the read passed the reference clock about halfway */
+      sync->base = etohll(dctime) - ((ecx_dcsync_ns(&t1) + ecx_dcsync_ns(&t2)) / 2);
+      sync->lastwrite = sync->base + ecx_dcsync_ns(&t2);
+      context->DCsettime = htoel((uint32)sync->lastwrite);
+      if (!context->DCbusshift)
+      {
+         /* the write is a new datagram in the processdata frames */
+         context->DCbusshift = TRUE;
+         ecx_clearpdtemplate(context);
+      }
+   }
+
+   return 1;
+}
+
+/**
+ * Update a DC sync controller, call once per cycle right before the
+ * processdata is sent. The DC time received with the last processdata
+ * updates offset, drift and in master shift mode the correction of the
+ * cycle time. A cycle without new DC time is not counted. In bus shift mode
+ * the master time to write to the reference clock is set for the next
+ * send.
+ *
+ * @param[in]  context        context struct
+ * @param[in,out] sync        DC sync controller set up by ecx_dcsync_init()
+ * @param[in]  now            monotonic master time before the send
+ * @return Correction to add to the next cycle time in ns, always 0 in bus
+ * shift mode.
+ */
+int64 ecx_dcsync(ecx_contextt *context, ec_dcsynct *sync, const ec_timet *now)
+{
+   int64 t, delta, elapsed, drift;
+
+   t = ecx_dcsync_ns(now);
+   sync->correction = 0;
+   if ((sync->cycletime > 0) && (context->DCtime != sync->lastdctime))
+   {
+      if (sync->mode == EC_DCSYNC_BUSSHIFT)
+      {
+         /* DC time was read right after the last write */
+         delta = context->DCtime - sync->lastwrite;
+      }
+      else
+      {
+         delta = (context->DCtime - sync->syncoffset) % sync->cycletime;
+         if (delta > (sync->cycletime / 2))
+         {
+            delta -= sync->cycletime;
+         }
+         else if (delta < -(sync->cycletime / 2))
+         {
+            delta += sync->cycletime;
+         }
+         sync->integral -= delta;
+         sync->correction = (-delta / EC_DCSYNC_PDIV) + (sync->integral / EC_DCSYNC_IDIV);
+      }
+      sync->offset = delta;
+      if (delta < 0)
+      {
+         delta = -delta;
+      }
+      if (delta > sync->maxoffset)
+      {
+         sync->maxoffset = delta;
+      }
+      /* the DC time belongs to the send of the last cycle */
+      if (sync->updates == 0)
+      {
+         sync->windowdctime = context->DCtime;
+         sync->windownow = sync->lastnow;
+      }
+      elapsed = sync->lastnow - sync->windownow;
+      if (elapsed >= EC_DCSYNC_DRIFTNS)
+      {
+         drift = ((context->DCtime - sync->windowdctime) - elapsed) * 1000000000 / elapsed;
+         if (sync->windows++ == 0)
+         {
+            sync->drift = drift;
+         }
+         else
+         {
+            sync->drift += (drift - sync->drift) / EC_DCSYNC_DRIFTDIV;
+         }
+         sync->windowdctime = context->DCtime;
+         sync->windownow = sync->lastnow;
+      }
+      sync->lastdctime = context->DCtime;
+      sync->updates++;
+   }
+   sync->lastnow = t;
+   if (sync->mode == EC_DCSYNC_BUSSHIFT)
+   {
+      sync->lastwrite = sync->base + t;
+      context->DCsettime = htoel((uint32)sync->lastwrite);
+   }
+
+   return sync->correction;
+}
+
+/**
+ * Stop a DC sync controller. In bus shift mode the reference clock is not
+ * written anymore. Must not be called while processdata is exchanged.
+ *
+ * @param[in]  context        context struct
+ * @param[in]  sync           DC sync controller
+ */
+void ecx_dcsync_close(ecx_contextt *context, ec_dcsynct *sync)
+{
+   if ((sync->mode == EC_DCSYNC_BUSSHIFT) && context->DCbusshift)
+   {
+      context->DCbusshift = FALSE;
+      ecx_clearpdtemplate(context);
+   }
+   sync->cycletime = 0;
+}
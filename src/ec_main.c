@@ -218,6 +218,7 @@ static void ecx_mbxemergencyerror(ecx_contextt *context, uint16 Slave, uint16 Er
 int ecx_init(ecx_contextt *context, const char *ifname)
 {
    ecx_initmbxpool(context);
+   context->pdmutex = (osal_mutext *)osal_mutex_create();
    return ecx_setupnic(&context->port, ifname, FALSE);
 }
 
@@ -234,6 +235,7 @@ int ecx_init_redundant(ecx_contextt *context, ecx_redportt *redport, const char
    ec_etherheadert *ehp;
 
    ecx_initmbxpool(context);
+   context->pdmutex = (osal_mutext *)osal_mutex_create();
    context->port.redport = redport;
    ecx_setupnic(&context->port, ifname, FALSE);
    rval = ecx_setupnic(&context->port, if2name, TRUE);
@@ -261,6 +263,7 @@ void ecx_close(ecx_contextt *context)
    }
 
    osal_mutex_destroy(context->mbxpool.mbxmutex);
+   osal_mutex_destroy(context->pdmutex);
    ecx_closenic(&context->port);
 }
 
@@ -1210,6 +1213,230 @@ int ecx_mbxempty(ecx_contextt *context, uint16 slave, int timeout)
    return 0;
 }
 
+/** Check for a pending mailbox datagram of a slave in mailbox piggyback
+ * mode.
+ * @param[in]  context        context struct
+ * @param[in]  group          group number
+ * @param[in]  slave          slave number
+ * @param[in]  com            EC_CMD_FPRD or EC_CMD_FPWR
+ * @return TRUE if a datagram of the slave is queued or sent.
+ */
+static boolean ecx_mbxdgbusy(ecx_contextt *context, uint8 group, uint16 slave, uint8 com)
+{
+   ec_mbxdgT *mbxdg = context->grouplist[group].mbxdg;
+   int i;
+
+   for (i = 0; i < EC_MAXMBXDG; i++)
+   {
+      if ((mbxdg[i].state != EC_MBXDG_FREE) && (mbxdg[i].slave == slave) && (mbxdg[i].com == com))
+      {
+         return TRUE;
+      }
+   }
+
+   return FALSE;
+}
+
+/** Queue a mailbox datagram to be sent with the next processdata of the
+ * group, see ecx_contextt.mbxpiggybackMode. Only one read and one write per
+ * slave are pending at a time.
+ * @param[in]  context        context struct
+ * @param[in]  group          group number
+ * @param[in]  com            EC_CMD_FPRD to read the out mailbox,
+ *                            EC_CMD_FPWR to write the in mailbox
+ * @param[in]  slave          slave number
+ * @param[in]  mbx            mailbox buffer
+ * @return 1 if queued, 0 if all datagrams are in use or the slave has one
+ * pending.
+ */
+static int ecx_mbxdgqueue(ecx_contextt *context, uint8 group, uint8 com, uint16 slave, ec_mbxbuft *mbx)
+{
+   ec_mbxdgT *mbxdg = context->grouplist[group].mbxdg;
+   int i;
+
+   if (ecx_mbxdgbusy(context, group, slave, com))
+   {
+      return 0;
+   }
+   for (i = 0; i < EC_MAXMBXDG; i++)
+   {
+      if (mbxdg[i].state == EC_MBXDG_FREE)
+      {
+         mbxdg[i].com = com;
+         mbxdg[i].slave = slave;
+         mbxdg[i].mbx = mbx;
+         mbxdg[i].state = EC_MBXDG_QUEUED;
+         return 1;
+      }
+   }
+
+   return 0;
+}
+
+/** Cancel the mailbox datagram writing a mailbox dropped from the transmit
+ * queue. A queued datagram is not sent, a sent one is not completed.
+ * @param[in]  context        context struct
+ * @param[in]  group          group number
+ * @param[in]  mbx            mailbox buffer dropped
+ */
+static void ecx_mbxdgcancel(ecx_contextt *context, uint8 group, ec_mbxbuft *mbx)
+{
+   ec_mbxdgT *mbxdg = context->grouplist[group].mbxdg;
+   int i;
+
+   for (i = 0; i < EC_MAXMBXDG; i++)
+   {
+      if ((mbxdg[i].state != EC_MBXDG_FREE) && (mbxdg[i].com == EC_CMD_FPWR) && (mbxdg[i].mbx == mbx))
+      {
+         if (mbxdg[i].state == EC_MBXDG_QUEUED)
+         {
+            mbxdg[i].state = EC_MBXDG_FREE;
+         }
+         mbxdg[i].mbx = NULL;
+      }
+   }
+}
+
+/** Process a mailbox read from a slave by the cyclic mailbox handler. The
+ * mailbox is handed to the protocol waiting for it or dropped to the pool.
+ * @param[in]  context        context struct
+ * @param[in]  slave          slave number
+ * @param[in]  mbx            mailbox read
+ * @param[in]  wkc            work counter of the read, <= 0 if the mailbox
+ *                            is lost
+ */
+static void ecx_mbxinprocess(ecx_contextt *context, uint16 slave, ec_mbxbuft *mbx, int wkc)
+{
+   ec_slavet *slaveitem = &context->slavelist[slave];
+   ec_mbxheadert *mbxh;
+   ec_emcyt *EMp;
+   ec_mbxerrort *MBXEp;
+
+   if (wkc > 0)
+   {
+      mbxh = (ec_mbxheadert *)mbx;
+      if ((mbxh->mbxtype & 0x0f) == ECT_MBXT_ERR) /* Mailbox error response? */
+      {
+         MBXEp = (ec_mbxerrort *)mbx;
+         ecx_mbxerror(context, slave, etohs(MBXEp->Detail));
+      }
+      else if ((mbxh->mbxtype & 0x0f) == ECT_MBXT_COE) /* CoE response? */
+      {
+         EMp = (ec_emcyt *)mbx;
+         if ((etohs(EMp->CANOpen) >> 12) == 0x01) /* Emergency request? */
+         {
+            ecx_mbxemergencyerror(context, slave, etohs(EMp->ErrorCode), EMp->ErrorReg,
+                                  EMp->bData, etohs(EMp->w1), etohs(EMp->w2));
+         }
+         else
+         {
+            if (slaveitem->coembxin && (slaveitem->coembxinfull == FALSE))
+            {
+               slaveitem->coembxin = (uint8 *)mbx;
+               mbx = NULL;
+               slaveitem->coembxinfull = TRUE;
+            }
+            else
+            {
+               slaveitem->coembxoverrun++;
+            }
+         }
+      }
+      else if ((mbxh->mbxtype & 0x0f) == ECT_MBXT_SOE) /* SoE response? */
+      {
+         if (slaveitem->soembxin && (slaveitem->soembxinfull == FALSE))
+         {
+            slaveitem->soembxin = (uint8 *)mbx;
+            mbx = NULL;
+            slaveitem->soembxinfull = TRUE;
+         }
+         else
+         {
+            slaveitem->soembxoverrun++;
+         }
+      }
+      else if ((mbxh->mbxtype & 0x0f) == ECT_MBXT_EOE) /* EoE response? */
+      {
+         ec_EOEt *eoembx = (ec_EOEt *)mbx;
+         uint16 frameinfo1 = etohs(eoembx->frameinfo1);
+         /* All non fragment data frame types are expected to be handled by
+          * slave send/receive API if the EoE hook is set
+          */
+         if (EOE_HDR_FRAME_TYPE_GET(frameinfo1) == EOE_FRAG_DATA)
+         {
+            if (context->EOEhook)
+            {
+               if (context->EOEhook(context, slave, eoembx) > 0)
+               {
+                  /* Fragment handled by EoE hook */
+                  wkc = 0;
+               }
+            }
+         }
+         /* Not handled by hook */
+         if ((wkc > 0) && slaveitem->eoembxin && (slaveitem->eoembxinfull == FALSE))
+         {
+            slaveitem->eoembxin = (uint8 *)mbx;
+            mbx = NULL;
+            slaveitem->eoembxinfull = TRUE;
+         }
+         else
+         {
+            slaveitem->eoembxoverrun++;
+         }
+      }
+      else if ((mbxh->mbxtype & 0x0f) == ECT_MBXT_FOE) /* FoE response? */
+      {
+         if (slaveitem->foembxin && (slaveitem->foembxinfull == FALSE))
+         {
+            slaveitem->foembxin = (uint8 *)mbx;
+            mbx = NULL;
+            slaveitem->foembxinfull = TRUE;
+         }
+         else
+         {
+            slaveitem->foembxoverrun++;
+         }
+      }
+      else if ((mbxh->mbxtype & 0x0f) == ECT_MBXT_VOE) /* VoE response? */
+      {
+         if (slaveitem->voembxin && (slaveitem->voembxinfull == FALSE))
+         {
+            slaveitem->voembxin = (uint8 *)mbx;
+            mbx = NULL;
+            slaveitem->voembxinfull = TRUE;
+         }
+         else
+         {
+            slaveitem->voembxoverrun++;
+         }
+      }
+      else if ((mbxh->mbxtype & 0x0f) == ECT_MBXT_AOE) /* AoE response? */
+      {
+         if (slaveitem->aoembxin && (slaveitem->aoembxinfull == FALSE))
+         {
+            slaveitem->aoembxin = (uint8 *)mbx;
+            mbx = NULL;
+            slaveitem->aoembxinfull = TRUE;
+         }
+         else
+         {
+            slaveitem->aoembxoverrun++;
+         }
+      }
+   }
+   else
+   {
+      /* mailbox lost, initiate robust mailbox protocol */
+      slaveitem->mbxrmpstate = 1;
+   }
+   /* release mailbox to pool if still owner */
+   if (mbx)
+   {
+      ecx_dropmbx(context, mbx);
+   }
+}
+
 /**
  * Handles incoming mailbox messages for a specified group.
  *
@@ -1218,7 +1445,9 @@ int ecx_mbxempty(ecx_contextt *context, uint16 slave, int timeout)
  * according to their type (CoE, SoE, EoE, etc.).  Also manages the
  * robust mailbox protocol state machine for error handling. It keeps
  * track of a work limit to prevent excessive processing in a single
- * call.
+ * call. In mailbox piggyback mode the mailboxes are read with the next
+ * processdata instead, the robust mailbox protocol still reads and writes
+ * directly.
  *
  * @param[in]  context  context struct
  * @param[in]  group    group number
@@ -1230,9 +1459,6 @@ int ecx_mbxinhandler(ecx_contextt *context, uint8 group, int limit)
    int cnt, cntoffset, wkc, wkc2, limitcnt;
    int maxcnt = context->grouplist[group].mbxstatuslength;
    ec_mbxbuft *mbx;
-   ec_mbxheadert *mbxh;
-   ec_emcyt *EMp;
-   ec_mbxerrort *MBXEp;
    uint8 SMcontr;
    uint16 SMstatex;
 
@@ -1291,138 +1517,32 @@ int ecx_mbxinhandler(ecx_contextt *context, uint8 group, int limit)
                if (++limitcnt >= limit) maxcnt = 0;
             }
          }
-         /* mbxin full detected */
-         else if ((*(context->grouplist[group].mbxstatus + cntoffset) & 0x08) > 0)
+         /* mbxin full detected, in piggyback mode by a status received in a
+            later cycle than the last read, an older one was read before */
+         else if (((*(context->grouplist[group].mbxstatus + cntoffset) & 0x08) > 0) &&
+                  (!context->mbxpiggybackMode ||
+                   ((int32)(context->grouplist[group].mbxstatuscycle - slaveitem->mbxreadcycle) > 0)))
          {
             uint16 mbxl = slaveitem->mbx_rl;
             uint16 mbxro = slaveitem->mbx_ro;
-            if ((mbxl > 0) && (mbx = ecx_getmbx(context)))
+            if ((mbxl > 0) &&
+                !(context->mbxpiggybackMode && ecx_mbxdgbusy(context, group, slave, EC_CMD_FPRD)) &&
+                (mbx = ecx_getmbx(context)))
             {
                /* keep track of work limit */
                if (++limitcnt >= limit) maxcnt = 0;
-               wkc = ecx_FPRD(&context->port, configadr, mbxro, mbxl, mbx, EC_TIMEOUTRET); /* get mailbox */
-               if (wkc > 0)
+               if (context->mbxpiggybackMode)
                {
-                  mbxh = (ec_mbxheadert *)mbx;
-                  if ((mbxh->mbxtype & 0x0f) == ECT_MBXT_ERR) /* Mailbox error response? */
-                  {
-                     MBXEp = (ec_mbxerrort *)mbx;
-                     ecx_mbxerror(context, slave, etohs(MBXEp->Detail));
-                  }
-                  else if ((mbxh->mbxtype & 0x0f) == ECT_MBXT_COE) /* CoE response? */
-                  {
-                     EMp = (ec_emcyt *)mbx;
-                     if ((etohs(EMp->CANOpen) >> 12) == 0x01) /* Emergency request? */
-                     {
-                        ecx_mbxemergencyerror(context, slave, etohs(EMp->ErrorCode), EMp->ErrorReg,
-                                              EMp->bData, etohs(EMp->w1), etohs(EMp->w2));
-                     }
-                     else
-                     {
-                        if (slaveitem->coembxin && (slaveitem->coembxinfull == FALSE))
-                        {
-                           slaveitem->coembxin = (uint8 *)mbx;
-                           mbx = NULL;
-                           slaveitem->coembxinfull = TRUE;
-                        }
-                        else
-                        {
-                           slaveitem->coembxoverrun++;
-                        }
-                     }
-                  }
-                  else if ((mbxh->mbxtype & 0x0f) == ECT_MBXT_SOE) /* SoE response? */
-                  {
-                     if (slaveitem->soembxin && (slaveitem->soembxinfull == FALSE))
-                     {
-                        slaveitem->soembxin = (uint8 *)mbx;
-                        mbx = NULL;
-                        slaveitem->soembxinfull = TRUE;
-                     }
-                     else
-                     {
-                        slaveitem->soembxoverrun++;
-                     }
-                  }
-                  else if ((mbxh->mbxtype & 0x0f) == ECT_MBXT_EOE) /* EoE response? */
-                  {
-                     ec_EOEt *eoembx = (ec_EOEt *)mbx;
-                     uint16 frameinfo1 = etohs(eoembx->frameinfo1);
-                     /* All non fragment data frame types are expected to be handled by
-                      * slave send/receive API if the EoE hook is set
-                      */
-                     if (EOE_HDR_FRAME_TYPE_GET(frameinfo1) == EOE_FRAG_DATA)
-                     {
-                        if (context->EOEhook)
-                        {
-                           if (context->EOEhook(context, slave, eoembx) > 0)
-                           {
-                              /* Fragment handled by EoE hook */
-                              wkc = 0;
-                           }
-                        }
-                     }
-                     /* Not handled by hook */
-                     if ((wkc > 0) && slaveitem->eoembxin && (slaveitem->eoembxinfull == FALSE))
-                     {
-                        slaveitem->eoembxin = (uint8 *)mbx;
-                        mbx = NULL;
-                        slaveitem->eoembxinfull = TRUE;
-                     }
-                     else
-                     {
-                        slaveitem->eoembxoverrun++;
-                     }
-                  }
-                  else if ((mbxh->mbxtype & 0x0f) == ECT_MBXT_FOE) /* FoE response? */
-                  {
-                     if (slaveitem->foembxin && (slaveitem->foembxinfull == FALSE))
-                     {
-                        slaveitem->foembxin = (uint8 *)mbx;
-                        mbx = NULL;
-                        slaveitem->foembxinfull = TRUE;
-                     }
-                     else
-                     {
-                        slaveitem->foembxoverrun++;
-                     }
-                  }
-                  else if ((mbxh->mbxtype & 0x0f) == ECT_MBXT_VOE) /* VoE response? */
-                  {
-                     if (slaveitem->voembxin && (slaveitem->voembxinfull == FALSE))
-                     {
-                        slaveitem->voembxin = (uint8 *)mbx;
-                        mbx = NULL;
-                        slaveitem->voembxinfull = TRUE;
-                     }
-                     else
-                     {
-                        slaveitem->voembxoverrun++;
-                     }
-                  }
-                  else if ((mbxh->mbxtype & 0x0f) == ECT_MBXT_AOE) /* AoE response? */
+                  /* read with the next processdata, see ecx_mbxdgdone() */
+                  if (!ecx_mbxdgqueue(context, group, EC_CMD_FPRD, slave, mbx))
                   {
-                     if (slaveitem->aoembxin && (slaveitem->aoembxinfull == FALSE))
-                     {
-                        slaveitem->aoembxin = (uint8 *)mbx;
-                        mbx = NULL;
-                        slaveitem->aoembxinfull = TRUE;
-                     }
-                     else
-                     {
-                        slaveitem->aoembxoverrun++;
-                     }
+                     ecx_dropmbx(context, mbx);
                   }
                }
                else
                {
-                  /* mailbox lost, initiate robust mailbox protocol */
-                  slaveitem->mbxrmpstate = 1;
-               }
-               /* release mailbox to pool if still owner */
-               if (mbx)
-               {
-                  ecx_dropmbx(context, mbx);
+                  wkc = ecx_FPRD(&context->port, configadr, mbxro, mbxl, mbx, EC_TIMEOUTRET); /* get mailbox */
+                  ecx_mbxinprocess(context, slave, mbx, wkc);
                }
             }
          }
@@ -1437,6 +1557,8 @@ int ecx_mbxinhandler(ecx_contextt *context, uint8 group, int limit)
  * This function processes outgoing mailbox messages for the given group,
  * checking the state of each message in the queue and sending appropriate
  * requests to the slaves. It supports retrying for failed requests.
+ * In mailbox piggyback mode the mailboxes are written with the next
+ * processdata instead.
  *
  * @param[in] context context struct
  * @param[in] group   group number
@@ -1469,21 +1591,33 @@ int ecx_mbxouthandler(ecx_contextt *context, uint8 group, int limit)
          limitcnt++;
          if (context->slavelist[slave].state >= EC_STATE_PRE_OP)
          {
-            /* write slave in mailbox 1st try*/
-            wkc = ecx_FPWR(&context->port, configadr, mbxwo, mbxl, mbx, EC_TIMEOUTRET);
-            if (wkc > 0)
+            if (context->mbxpiggybackMode)
             {
-               mbxqueue->mbxstate[ticketloc] = EC_MBXQUEUESTATE_DONE; // mbx tx ok
-               ecx_dropmbx(context, mbx);
-               mbxqueue->mbx[ticketloc] = NULL;
+               /* written with the next processdata, see ecx_mbxdgdone() */
+               if (ecx_mbxdgqueue(context, group, EC_CMD_FPWR, slave, mbx))
+               {
+                  mbxqueue->mbxstate[ticketloc] = EC_MBXQUEUESTATE_SEND;
+               }
             }
             else
             {
-               if (state != EC_MBXQUEUESTATE_FAIL)
-                  mbxqueue->mbxstate[ticketloc] = EC_MBXQUEUESTATE_FAIL; // mbx tx fail, retry
+               /* write slave in mailbox 1st try*/
+               wkc = ecx_FPWR(&context->port, configadr, mbxwo, mbxl, mbx, EC_TIMEOUTRET);
+               if (wkc > 0)
+               {
+                  mbxqueue->mbxstate[ticketloc] = EC_MBXQUEUESTATE_DONE; // mbx tx ok
+                  ecx_dropmbx(context, mbx);
+                  mbxqueue->mbx[ticketloc] = NULL;
+               }
+               else
+               {
+                  if (state != EC_MBXQUEUESTATE_FAIL)
+                     mbxqueue->mbxstate[ticketloc] = EC_MBXQUEUESTATE_FAIL; // mbx tx fail, retry
+               }
             }
          }
          /* fall through */
+      case EC_MBXQUEUESTATE_SEND: // mbx tx with processdata
       case EC_MBXQUEUESTATE_DONE: // mbx tx ok
          ecx_mbxrotatequeue(context, group, ticketloc);
          break;
@@ -1491,12 +1625,120 @@ int ecx_mbxouthandler(ecx_contextt *context, uint8 group, int limit)
       if (mbxqueue->mbxremove[ticketloc])
       {
          mbx = ecx_mbxdropqueue(context, group, ticketloc);
-         if (mbx) ecx_dropmbx(context, mbx);
+         if (mbx)
+         {
+            ecx_mbxdgcancel(context, group, mbx);
+            ecx_dropmbx(context, mbx);
+         }
       }
    }
    return limitcnt;
 }
 
+/** Complete a mailbox datagram sent with the processdata, called when the
+ * frame holding it is received or lost. A mailbox read is processed as by
+ * ecx_mbxinhandler(), a mailbox write is marked done in the transmit queue
+ * or retried by ecx_mbxouthandler().
+ * @param[in]  context        context struct
+ * @param[in]  mbxdg          mailbox datagram
+ * @param[in]  data           datagram data in rx frame, NULL if lost
+ * @param[in]  wkc            work counter of the datagram
+ * @param[in]  cycle          processdata cycle the datagram was sent with
+ */
+static void ecx_mbxdgdone(ecx_contextt *context, ec_mbxdgT *mbxdg, const uint8 *data, int wkc, uint32 cycle)
+{
+   ec_slavet *slaveitem = &context->slavelist[mbxdg->slave];
+   ec_mbxqueuet *mbxqueue;
+   ec_mbxbuft *mbx = NULL;
+   int n, ticketloc;
+
+   if (mbxdg->com == EC_CMD_FPRD)
+   {
+      if (wkc > 0)
+      {
+         memcpy(mbxdg->mbx, data, slaveitem->mbx_rl);
+      }
+      /* the mailbox status of this cycle and the ones before was read
+         before the mailbox, see ecx_mbxinhandler() */
+      slaveitem->mbxreadcycle = cycle;
+      ecx_mbxinprocess(context, mbxdg->slave, mbxdg->mbx, wkc);
+   }
+   else if (mbxdg->mbx)
+   {
+      mbxqueue = &(context->grouplist[slaveitem->group].mbxtxqueue);
+      osal_mutex_lock(mbxqueue->mbxmutex);
+      ticketloc = mbxqueue->listtail;
+      for (n = 0; n < mbxqueue->listcount; n++)
+      {
+         if ((mbxqueue->mbx[ticketloc] == mbxdg->mbx) &&
+             (mbxqueue->mbxstate[ticketloc] == EC_MBXQUEUESTATE_SEND))
+         {
+            if (wkc > 0)
+            {
+               mbxqueue->mbxstate[ticketloc] = EC_MBXQUEUESTATE_DONE; // mbx tx ok
+               mbx = mbxqueue->mbx[ticketloc];
+               mbxqueue->mbx[ticketloc] = NULL;
+            }
+            else
+            {
+               mbxqueue->mbxstate[ticketloc] = EC_MBXQUEUESTATE_FAIL; // mbx tx fail, retry
+            }
+            break;
+         }
+         if (++ticketloc >= EC_MBXPOOLSIZE) ticketloc = 0;
+      }
+      osal_mutex_unlock(mbxqueue->mbxmutex);
+      if (mbx) ecx_dropmbx(context, mbx);
+   }
+   mbxdg->mbx = NULL;
+   mbxdg->state = EC_MBXDG_FREE;
+}
+
+/** Release the mailbox datagrams of a group queued or sent with the
+ * processdata, see ecx_contextt.mbxpiggybackMode. Called when the groups
+ * are cleared or mapped again, the frames holding them may never be
+ * received. A read drops its mailbox buffer, a write is retried by
+ * ecx_mbxouthandler(). Stack entries of the frames no longer refer to them.
+ * @param[in]  context        context struct
+ * @param[in]  group          group number
+ */
+void ecx_releasembxdg(ecx_contextt *context, uint8 group)
+{
+   ec_mbxdgT *mbxdg = context->grouplist[group].mbxdg;
+   ec_idxstackT *idxstack;
+   int i, n, pos;
+
+   for (i = 0; i < EC_MAXMBXDG; i++)
+   {
+      if (mbxdg[i].state == EC_MBXDG_FREE)
+      {
+         continue;
+      }
+      /* sent with the groups of another stack if sent together */
+      for (n = 0; n < EC_MAXGROUP; n++)
+      {
+         idxstack = &context->grouplist[n].idxstack;
+         for (pos = 0; pos < EC_MAXBUF; pos++)
+         {
+            if (idxstack->data[pos] == &mbxdg[i])
+            {
+               idxstack->data[pos] = NULL;
+            }
+         }
+      }
+      if (mbxdg[i].com == EC_CMD_FPRD)
+      {
+         ecx_dropmbx(context, mbxdg[i].mbx);
+         mbxdg[i].mbx = NULL;
+         mbxdg[i].state = EC_MBXDG_FREE;
+      }
+      else
+      {
+         ecx_mbxdgdone(context, &mbxdg[i], NULL, 0, 0);
+      }
+   }
+}
+
 /**
  * Combined handler for both incoming and outgoing mailbox messages.
  *
@@ -2348,72 +2590,490 @@ uint32 ecx_readeeprom2(ecx_contextt *context, uint16 slave, int timeout)
    return edat;
 }
 
-/** Push index of segmented LRD/LWR/LRW combination.
- * @param[in]  context    context struct
- * @param[in] idx         Used datagram index.
+/** Push index of segmented LRD/LWR/LRW combination. If the stack is full the
+ * entry is not pushed and ec_idxstackT.overflow is set.
+ * @param[in] idxstack    Index stack of the group.
+ * @param[in] group       Group of the datagram.
+ * @param[in] idx         Used frame index.
  * @param[in] data        Pointer to process data segment.
  * @param[in] length      Length of data segment in bytes.
- * @param[in] DCO         Offset position of DC frame.
+ * @param[in] offset      Offset of datagram data in rx frame.
+ * @param[in] com         Datagram command.
+ * @param[in] skip        Leading output bytes not to copy back.
  */
-static void ecx_pushindex(ecx_contextt *context, uint8 idx, void *data, uint16 length, uint16 DCO)
+static void ecx_pushindex(ec_idxstackT *idxstack, uint8 group, uint8 idx, void *data, uint16 length, uint16 offset, uint8 com, uint16 skip)
 {
-   if (context->idxstack.pushed < EC_MAXBUF)
+   int pos;
+
+   if (idxstack->stacked >= EC_MAXBUF)
+   {
+      idxstack->overflow = TRUE;
+   }
+   else
    {
-      context->idxstack.idx[context->idxstack.pushed] = idx;
-      context->idxstack.data[context->idxstack.pushed] = data;
-      context->idxstack.length[context->idxstack.pushed] = length;
-      context->idxstack.dcoffset[context->idxstack.pushed] = DCO;
-      context->idxstack.pushed++;
+      pos = idxstack->pushed;
+      idxstack->idx[pos] = idx;
+      idxstack->data[pos] = data;
+      idxstack->length[pos] = length;
+      idxstack->offset[pos] = offset;
+      idxstack->type[pos] = com;
+      idxstack->skip[pos] = skip;
+      idxstack->cycleend[pos] = FALSE;
+      idxstack->done[pos] = FALSE;
+      idxstack->group[pos] = group;
+      idxstack->pushed = (uint8)((pos + 1) % EC_MAXBUF);
+      idxstack->stacked++;
    }
 }
 
-/** Pull index of segmented LRD/LWR/LRW combination.
+/** Number of indexes of the oldest cycle on the stack. Outside pipelined
+ * mode all indexes on the stack.
  * @param[in]  context        context struct
- * @return Stack location, -1 if stack is empty.
+ * @param[in]  idxstack       index stack of the group
+ * @return Number of indexes, 0 if stack is empty.
  */
-static int ecx_pullindex(ecx_contextt *context)
+static int ecx_cyclelength(ecx_contextt *context, ec_idxstackT *idxstack)
 {
-   int rval = -1;
-   if (context->idxstack.pulled < context->idxstack.pushed)
+   int n, pos;
+
+   n = 0;
+   while (n < idxstack->stacked)
    {
-      rval = context->idxstack.pulled;
-      context->idxstack.pulled++;
+      pos = (idxstack->pulled + n) % EC_MAXBUF;
+      n++;
+      if (context->pipelinedMode && idxstack->cycleend[pos])
+      {
+         break;
+      }
    }
 
-   return rval;
+   return n;
+}
+
+/** Pull indexes of segmented LRD/LWR/LRW combination.
+ * @param[in]  idxstack       index stack of the group
+ * @param[in]  cnt            number of indexes to pull
+ */
+static void ecx_pullindex(ec_idxstackT *idxstack, int cnt)
+{
+   idxstack->pulled = (uint8)((idxstack->pulled + cnt) % EC_MAXBUF);
+   idxstack->stacked = (uint8)(idxstack->stacked - cnt);
+}
+
+/** Mark the last pushed index as end of a cycle and the pushed indexes
+ * with the processdata cycle of their group.
+ * @param[in]  context        context struct
+ * @param[in]  idxstack       index stack of the group
+ * @param[in]  pushed         number of indexes pushed in this cycle
+ */
+static void ecx_markcycle(ecx_contextt *context, ec_idxstackT *idxstack, int pushed)
+{
+   int i, pos;
+
+   for (i = 1; i <= pushed; i++)
+   {
+      pos = (idxstack->pushed + EC_MAXBUF - i) % EC_MAXBUF;
+      idxstack->cycle[pos] = context->grouplist[idxstack->group[pos]].pdcycle;
+   }
+   if (pushed > 0)
+   {
+      idxstack->cycleend[(idxstack->pushed + EC_MAXBUF - 1) % EC_MAXBUF] = TRUE;
+   }
 }
 
 /**
  * Clear the idx stack.
  *
- * @param context           context struct
+ * @param idxstack          index stack of the group
  */
-static void ecx_clearindex(ecx_contextt *context)
+static void ecx_clearindex(ec_idxstackT *idxstack)
 {
 
-   context->idxstack.pushed = 0;
-   context->idxstack.pulled = 0;
+   idxstack->pushed = 0;
+   idxstack->pulled = 0;
+   idxstack->stacked = 0;
 }
 
-/** Transmit processdata to slaves.
- *
- * Uses LRW, or LRD/LWR if LRW is not allowed (blockLRW).
- *
- * In overlap mode, outputs are sent in the outgoing frame and inputs
- * will replace outputs in the incoming frame.
- *
- * In non-overlap mode, outputs are followed by extra space for inputs
- * in the incoming frame.
- *
- * The inputs are gathered with the receive processdata function.
- * In contrast to the base LRW function this function is non-blocking.
- * If the processdata does not fit in one datagram, multiple are used.
- * In order to recombine the slave response, a stack is used.
+/** Processdata frames built by ecx_main_send_processdata() */
+typedef struct
+{
+   /** list of queued indexes */
+   uint8 idxlist[EC_MAXBUF];
+   /** number of queued indexes */
+   int cnt;
+   /** index of frame open for more datagrams, -1 if none */
+   int open;
+   /** offset of last datagram header in open frame */
+   uint16 last;
+   /** index stack the datagrams are pushed on */
+   ec_idxstackT *stack;
+   /** template to record the datagrams in, NULL if none */
+   ec_pdtemplateT *record;
+   /** TRUE if frames were transmitted early or datagrams not recorded */
+   boolean incomplete;
+} ec_pdframesT;
+
+/** Queue frame for transmission by ecx_flushframes().
+ * @param[in]  context        context struct
+ * @param[in,out] frames      processdata frames
+ * @param[in]  idx            index of frame to queue
+ */
+static void ecx_queueframe(ecx_contextt *context, ec_pdframesT *frames, uint8 idx)
+{
+   /* list full, transmit what we have */
+   if (frames->cnt >= EC_MAXBUF)
+   {
+      ecx_outframes_red(&context->port, frames->idxlist, frames->cnt);
+      frames->cnt = 0;
+      frames->incomplete = TRUE;
+   }
+   frames->idxlist[frames->cnt++] = idx;
+}
+
+/** Queue the open frame and transmit all queued frames at once. The list of
+ * queued indexes is kept.
+ * @param[in]  context        context struct
+ * @param[in,out] frames      processdata frames
+ */
+static void ecx_flushframes(ecx_contextt *context, ec_pdframesT *frames)
+{
+   if (frames->open >= 0)
+   {
+      ecx_queueframe(context, frames, (uint8)frames->open);
+      frames->open = -1;
+   }
+   if (frames->cnt > 0)
+   {
+      ecx_outframes_red(&context->port, frames->idxlist, frames->cnt);
+   }
+}
+
+/** Record datagram in processdata frame template.
+ * @param[in]  frames         processdata frames
+ * @param[in]  idx            index of frame holding the datagram
+ * @param[in]  offset         offset to data in rx frame
+ * @param[in]  com            command
+ * @param[in]  length         length of datagram data
+ * @param[in]  data           databuffer copied in datagram
+ */
+static void ecx_recorddatagram(ec_pdframesT *frames, uint8 idx, uint16 offset, uint8 com, uint16 length, const void *data)
+{
+   ec_pdtemplateT *pdtemplate = frames->record;
+   int n;
+
+   if (pdtemplate->datagrams >= EC_MAXBUF)
+   {
+      frames->incomplete = TRUE;
+      return;
+   }
+   n = pdtemplate->datagrams++;
+   pdtemplate->dgidx[n] = idx;
+   /* rx frame is without ethernet header */
+   pdtemplate->dgoffset[n] = (uint16)(offset + ETH_HEADERSIZE);
+   pdtemplate->dglength[n] = length;
+   /* only outputs and the DC time written in bus shift mode change from
+      cycle to cycle */
+   if ((com == EC_CMD_LRW) || (com == EC_CMD_LWR) || (com == EC_CMD_FPWR))
+   {
+      pdtemplate->dgdata[n] = data;
+   }
+   else
+   {
+      pdtemplate->dgdata[n] = NULL;
+   }
+}
+
+/** Add datagram to processdata frames. The datagram is appended to the open
+ * frame if it still fits, otherwise the open frame is queued and a new frame
+ * is started.
+ * @param[in]  context        context struct
+ * @param[in,out] frames      processdata frames
+ * @param[in]  com            command
+ * @param[in]  ADP            Address Position
+ * @param[in]  ADO            Address Offset
+ * @param[in]  length         length of datagram excluding EtherCAT header
+ * @param[in]  data           databuffer to be copied in datagram
+ * @param[out] offset         offset to data in rx frame
+ * @return index of frame holding the datagram
+ */
+static uint8 ecx_pdframeadd(ecx_contextt *context, ec_pdframesT *frames, uint8 com,
+                            uint16 ADP, uint16 ADO, uint16 length, void *data, uint16 *offset)
+{
+   ecx_portt *port = &context->port;
+   ec_comt *datagramP;
+   uint8 idx;
+   int used;
+
+   if (frames->open >= 0)
+   {
+      idx = (uint8)frames->open;
+      /* size of all datagrams in frame. A full frame holds one datagram of
+         EC_MAXLRWDATA, every further datagram needs its own header and WKC */
+      used = port->txbuflength[idx] - ETH_HEADERSIZE - EC_ELENGTHSIZE;
+      if ((used + length) <= EC_MAXLRWDATA)
+      {
+         /* add "datagram follows" flag to previous last datagram */
+         datagramP = (ec_comt *)&(port->txbuf[idx][frames->last]);
+         datagramP->dlength = htoes(etohs(datagramP->dlength) | EC_DATAGRAMFOLLOWS);
+         frames->last = (uint16)(port->txbuflength[idx] - EC_ELENGTHSIZE);
+         *offset = ecx_adddatagram(port, &(port->txbuf[idx]), com, idx, FALSE, ADP, ADO, length, data);
+      }
+      else
+      {
+         ecx_queueframe(context, frames, idx);
+         frames->open = -1;
+      }
+   }
+   if (frames->open < 0)
+   {
+      /* get new index */
+      idx = ecx_getindex(port);
+      ecx_setupdatagram(port, &(port->txbuf[idx]), com, idx, ADP, ADO, length, data);
+      frames->open = idx;
+      frames->last = ETH_HEADERSIZE;
+      *offset = EC_HEADERSIZE;
+   }
+   if (frames->record)
+   {
+      ecx_recorddatagram(frames, idx, *offset, com, length, data);
+   }
+
+   return idx;
+}
+
+/** Check if the DC system time is written to the reference clock in front
+ * of the DC datagram of a group, see ecx_dcsync_init().
  * @param[in]  context        context struct
  * @param[in]  group          group number
- * @return >0 if processdata is transmitted.
+ * @return TRUE if written.
  */
-int ecx_send_processdata_group(ecx_contextt *context, uint8 group)
+static boolean ecx_pdbusshift(ecx_contextt *context, uint8 group)
+{
+   return context->DCbusshift &&
+          (context->grouplist[group].DCnext == context->slavelist[0].DCnext);
+}
+
+/** Add the DC system time FRMW to processdata frames, right after the first
+ * processdata datagram of a group. In bus shift mode the FPWR of the master
+ * time to the reference clock goes first.
+ * @param[in]  context        context struct
+ * @param[in]  group          group number
+ * @param[in,out] frames      processdata frames
+ */
+static void ecx_pdframeadddc(ecx_contextt *context, uint8 group, ec_pdframesT *frames)
+{
+   uint16 offset;
+   uint8 idx;
+
+   if (ecx_pdbusshift(context, group))
+   {
+      idx = ecx_pdframeadd(context, frames, EC_CMD_FPWR,
+                           context->slavelist[context->slavelist[0].DCnext].configadr,
+                           ECT_REG_DCSYSTIME, sizeof(uint32), &context->DCsettime, &offset);
+      ecx_pushindex(frames->stack, group, idx, NULL, sizeof(uint32), offset, EC_CMD_FPWR, 0);
+   }
+   idx = ecx_pdframeadd(context, frames, EC_CMD_FRMW,
+                        context->slavelist[context->grouplist[group].DCnext].configadr,
+                        ECT_REG_DCSYSTIME, sizeof(int64), &context->grouplist[group].DCtime, &offset);
+   ecx_pushindex(frames->stack, group, idx, &context->grouplist[group].DCtime, sizeof(int64), offset, EC_CMD_FRMW, 0);
+}
+
+/** Add the queued mailbox datagrams of a group to processdata frames, see
+ * ecx_contextt.mbxpiggybackMode. They go in the room left in the open frame
+ * or in a new frame sent with the others.
+ * @param[in]  context        context struct
+ * @param[in]  group          group number
+ * @param[in,out] frames      processdata frames
+ */
+static void ecx_pdframeaddmbx(ecx_contextt *context, uint8 group, ec_pdframesT *frames)
+{
+   ec_mbxdgT *mbxdg;
+   ec_slavet *slave;
+   uint16 ADO, length, offset;
+   uint8 idx;
+   int i;
+
+   for (i = 0; i < EC_MAXMBXDG; i++)
+   {
+      mbxdg = &(context->grouplist[group].mbxdg[i]);
+      /* a template never holds mailbox datagrams */
+      if ((mbxdg->state == EC_MBXDG_QUEUED) && !frames->record &&
+          (frames->stack->stacked < EC_MAXBUF))
+      {
+         slave = &context->slavelist[mbxdg->slave];
+         if (mbxdg->com == EC_CMD_FPRD)
+         {
+            ADO = slave->mbx_ro;
+            length = slave->mbx_rl;
+         }
+         else
+         {
+            ADO = slave->mbx_wo;
+            length = slave->mbx_l;
+         }
+         idx = ecx_pdframeadd(context, frames, mbxdg->com, slave->configadr, ADO, length, mbxdg->mbx, &offset);
+         ecx_pushindex(frames->stack, group, idx, mbxdg, length, offset, mbxdg->com, 0);
+         mbxdg->state = EC_MBXDG_SENT;
+      }
+   }
+}
+
+/** Check for mailbox datagrams to send with the processdata of groups.
+ * @param[in]  context        context struct
+ * @param[in]  groupmask      bit n set selects group n
+ * @return TRUE if a datagram is queued.
+ */
+static boolean ecx_pdmbxqueued(ecx_contextt *context, uint32 groupmask)
+{
+   uint8 group;
+   int i;
+
+   for (group = 0; (group < EC_MAXGROUP) && (group < 32); group++)
+   {
+      if (groupmask & ((uint32)1 << group))
+      {
+         for (i = 0; i < EC_MAXMBXDG; i++)
+         {
+            if (context->grouplist[group].mbxdg[i].state == EC_MBXDG_QUEUED)
+            {
+               return TRUE;
+            }
+         }
+      }
+   }
+
+   return FALSE;
+}
+
+/** Count down the register subscriptions of a group for the cycle being
+ * built and mark the ones to read in it.
+ * @param[in]  context        context struct
+ * @param[in]  group          group number
+ * @return TRUE if a register is read in the cycle.
+ */
+static boolean ecx_pdregdue(ecx_contextt *context, uint8 group)
+{
+   ec_regsubT *regsub;
+   boolean due = FALSE;
+   int i;
+
+   for (i = 0; i < EC_MAXREGSUB; i++)
+   {
+      regsub = &(context->grouplist[group].regsub[i]);
+      if (regsub->active)
+      {
+         if (regsub->next == 0)
+         {
+            regsub->due = TRUE;
+            regsub->next = (uint16)(regsub->divider - 1);
+            due = TRUE;
+         }
+         else
+         {
+            regsub->next--;
+         }
+      }
+   }
+
+   return due;
+}
+
+/** Add the register reads due in this cycle to processdata frames, see
+ * ecx_regsubscribe().
+ * @param[in]  context        context struct
+ * @param[in]  group          group number
+ * @param[in,out] frames      processdata frames
+ */
+static void ecx_pdframeaddreg(ecx_contextt *context, uint8 group, ec_pdframesT *frames)
+{
+   ec_regsubT *regsub;
+   uint16 offset;
+   uint8 idx, com;
+   int i;
+
+   for (i = 0; i < EC_MAXREGSUB; i++)
+   {
+      regsub = &(context->grouplist[group].regsub[i]);
+      /* a template never holds register reads */
+      if (regsub->active && regsub->due && !frames->record &&
+          (frames->stack->stacked < EC_MAXBUF))
+      {
+         com = regsub->slave ? EC_CMD_FPRD : EC_CMD_BRD;
+         idx = ecx_pdframeadd(context, frames, com,
+                              regsub->slave ? context->slavelist[regsub->slave].configadr : 0,
+                              regsub->ADO, regsub->length, regsub->data, &offset);
+         ecx_pushindex(frames->stack, group, idx, regsub, regsub->length, offset, com, 0);
+      }
+      regsub->due = FALSE;
+   }
+}
+
+/** Queue the frames of a zero copy group. The processdata is already in
+ * the frames, only the headers and WKC are reset and the DC datagram is
+ * added.
+ * @param[in]  context        context struct
+ * @param[in]  group          group number
+ * @param[in,out] frames      processdata frames
+ */
+static void ecx_queuezerocopy(ecx_contextt *context, uint8 group, ec_pdframesT *frames)
+{
+   ec_groupt *grp = &context->grouplist[group];
+   ecx_portt *port = &context->port;
+   ec_comt *datagramP;
+   uint16 sublength, offset;
+   uint8 idx;
+   int i;
+
+   /* frames of zero copy groups are not part of a template */
+   frames->incomplete = TRUE;
+   /* datagrams of one frame must be consecutive on the stack, nothing is
+      added to a frame of another group after the zero copy frames */
+   if (frames->open >= 0)
+   {
+      ecx_queueframe(context, frames, (uint8)frames->open);
+      frames->open = -1;
+   }
+   for (i = 0; i < grp->zcframes; i++)
+   {
+      idx = grp->zcidx[i];
+      sublength = (uint16)grp->IOsegment[i];
+      datagramP = (ec_comt *)&(port->txbuf[idx][ETH_HEADERSIZE]);
+      datagramP->elength = htoes(EC_ECATTYPE + EC_HEADERSIZE + sublength);
+      datagramP->dlength = htoes(sublength);
+      /* set WKC to zero */
+      port->txbuf[idx][ETH_HEADERSIZE + EC_HEADERSIZE + sublength] = 0x00;
+      port->txbuf[idx][ETH_HEADERSIZE + EC_HEADERSIZE + sublength + 1] = 0x00;
+      port->txbuflength[idx] = ETH_HEADERSIZE + EC_HEADERSIZE + EC_WKCSIZE + sublength;
+      ecx_pushindex(frames->stack, group, idx, NULL, sublength, EC_HEADERSIZE, EC_CMD_LRW, 0);
+      if ((i == 0) && grp->hasdc)
+      {
+         /* the room for the bus shift write next to the DC datagram is
+            checked by ecx_dcsync_init() and the zero copy layout */
+         if (ecx_pdbusshift(context, group) &&
+             ((sublength + EC_FIRSTDCDATAGRAM + EC_BUSSHIFTDATAGRAM) <= EC_MAXLRWDATA))
+         {
+            offset = ecx_adddatagram(port, &(port->txbuf[idx]), EC_CMD_FPWR, idx, TRUE,
+                                     context->slavelist[context->slavelist[0].DCnext].configadr,
+                                     ECT_REG_DCSYSTIME, sizeof(uint32), &context->DCsettime);
+            ecx_pushindex(frames->stack, group, idx, NULL, sizeof(uint32), offset, EC_CMD_FPWR, 0);
+         }
+         /* FPRMW in second datagram */
+         offset = ecx_adddatagram(port, &(port->txbuf[idx]), EC_CMD_FRMW, idx, FALSE,
+                                  context->slavelist[grp->DCnext].configadr,
+                                  ECT_REG_DCSYSTIME, sizeof(int64), &grp->DCtime);
+         ecx_pushindex(frames->stack, group, idx, &grp->DCtime, sizeof(int64), offset, EC_CMD_FRMW, 0);
+      }
+      ecx_queueframe(context, frames, idx);
+   }
+}
+
+/** Build processdata datagrams of one group and add them to the frames.
+ * @param[in]  context        context struct
+ * @param[in]  group          group number
+ * @param[in,out] frames      processdata frames
+ * @return >0 if processdata is queued.
+ */
+static int ecx_main_send_processdata(ecx_contextt *context, uint8 group, ec_pdframesT *frames)
 {
    uint32 LogAdr;
    uint16 w1, w2;
@@ -2425,7 +3085,7 @@ int ecx_send_processdata_group(ecx_contextt *context, uint8 group)
    boolean first = FALSE;
    uint16 currentsegment = 0;
    uint32 iomapinputoffset;
-   uint16 DCO;
+   uint16 offset, skip;
 
    wkc = 0;
    if (context->grouplist[group].hasdc)
@@ -2434,6 +3094,7 @@ int ecx_send_processdata_group(ecx_contextt *context, uint8 group)
    }
 
    ecx_clearmbxstatus(context, group);
+   context->grouplist[group].pdcycle++;
 
    /* For overlapping IO map use the biggest */
    if (context->overlappedMode == TRUE)
@@ -2457,8 +3118,13 @@ int ecx_send_processdata_group(ecx_contextt *context, uint8 group)
    {
 
       wkc = 1;
+      /* processdata in the frames ? */
+      if (context->grouplist[group].zcframes)
+      {
+         ecx_queuezerocopy(context, group, frames);
+      }
       /* LRW blocked by one or more slaves ? */
-      if (context->grouplist[group].blockLRW)
+      else if (context->grouplist[group].blockLRW)
       {
          /* if inputs available generate LRD */
          if (context->grouplist[group].Ibytes)
@@ -2478,24 +3144,16 @@ int ecx_send_processdata_group(ecx_contextt *context, uint8 group)
                {
                   sublength = (uint16)context->grouplist[group].IOsegment[currentsegment++];
                }
-               /* get new index */
-               idx = ecx_getindex(&context->port);
                w1 = LO_WORD(LogAdr);
                w2 = HI_WORD(LogAdr);
-               DCO = 0;
-               ecx_setupdatagram(&context->port, &(context->port.txbuf[idx]), EC_CMD_LRD, idx, w1, w2, sublength, data);
+               idx = ecx_pdframeadd(context, frames, EC_CMD_LRD, w1, w2, sublength, data, &offset);
+               /* push index and data pointer on stack */
+               ecx_pushindex(frames->stack, group, idx, data, sublength, offset, EC_CMD_LRD, 0);
                if (first)
                {
-                  /* FPRMW in second datagram */
-                  DCO = ecx_adddatagram(&context->port, &(context->port.txbuf[idx]), EC_CMD_FRMW, idx, FALSE,
-                                        context->slavelist[context->grouplist[group].DCnext].configadr,
-                                        ECT_REG_DCSYSTIME, sizeof(int64), &context->DCtime);
+                  ecx_pdframeadddc(context, group, frames);
                   first = FALSE;
                }
-               /* send frame */
-               ecx_outframe_red(&context->port, idx);
-               /* push index and data pointer on stack */
-               ecx_pushindex(context, idx, data, sublength, DCO);
                length -= sublength;
                LogAdr += sublength;
                data += sublength;
@@ -2516,24 +3174,16 @@ int ecx_send_processdata_group(ecx_contextt *context, uint8 group)
                {
                   sublength = (uint16)length;
                }
-               /* get new index */
-               idx = ecx_getindex(&context->port);
                w1 = LO_WORD(LogAdr);
                w2 = HI_WORD(LogAdr);
-               DCO = 0;
-               ecx_setupdatagram(&context->port, &(context->port.txbuf[idx]), EC_CMD_LWR, idx, w1, w2, sublength, data);
+               idx = ecx_pdframeadd(context, frames, EC_CMD_LWR, w1, w2, sublength, data, &offset);
+               /* push index and data pointer on stack */
+               ecx_pushindex(frames->stack, group, idx, data, sublength, offset, EC_CMD_LWR, 0);
                if (first)
                {
-                  /* FPRMW in second datagram */
-                  DCO = ecx_adddatagram(&context->port, &(context->port.txbuf[idx]), EC_CMD_FRMW, idx, FALSE,
-                                        context->slavelist[context->grouplist[group].DCnext].configadr,
-                                        ECT_REG_DCSYSTIME, sizeof(int64), &context->DCtime);
+                  ecx_pdframeadddc(context, group, frames);
                   first = FALSE;
                }
-               /* send frame */
-               ecx_outframe_red(&context->port, idx);
-               /* push index and data pointer on stack */
-               ecx_pushindex(context, idx, data, sublength, DCO);
                length -= sublength;
                LogAdr += sublength;
                data += sublength;
@@ -2557,144 +3207,922 @@ int ecx_send_processdata_group(ecx_contextt *context, uint8 group)
          do
          {
             sublength = (uint16)context->grouplist[group].IOsegment[currentsegment++];
-            /* get new index */
-            idx = ecx_getindex(&context->port);
             w1 = LO_WORD(LogAdr);
             w2 = HI_WORD(LogAdr);
-            DCO = 0;
-            ecx_setupdatagram(&context->port, &(context->port.txbuf[idx]), EC_CMD_LRW, idx, w1, w2, sublength, data);
-            if (first)
+            idx = ecx_pdframeadd(context, frames, EC_CMD_LRW, w1, w2, sublength, data, &offset);
+            /* in pipelined mode the outputs of the segment are not copied
+             * back, they may already hold the outputs of the next cycle */
+            skip = 0;
+            if (context->pipelinedMode && ((data + iomapinputoffset) < context->grouplist[group].inputs))
             {
-               /* FPRMW in second datagram */
-               DCO = ecx_adddatagram(&context->port, &(context->port.txbuf[idx]), EC_CMD_FRMW, idx, FALSE,
-                                     context->slavelist[context->grouplist[group].DCnext].configadr,
-                                     ECT_REG_DCSYSTIME, sizeof(int64), &context->DCtime);
-               first = FALSE;
+               skip = (uint16)(context->grouplist[group].inputs - (data + iomapinputoffset));
+               if (skip > sublength)
+               {
+                  skip = sublength;
+               }
             }
-            /* send frame */
-            ecx_outframe_red(&context->port, idx);
             /* push index and data pointer on stack.
              * the iomapinputoffset compensate for where the inputs are stored
              * in the IOmap if we use an overlapping IOmap. If a regular IOmap
              * is used it should always be 0.
              */
-            ecx_pushindex(context, idx, (data + iomapinputoffset), sublength, DCO);
+            ecx_pushindex(frames->stack, group, idx, (data + iomapinputoffset), sublength, offset, EC_CMD_LRW, skip);
+            if (first)
+            {
+               ecx_pdframeadddc(context, group, frames);
+               first = FALSE;
+            }
             length -= sublength;
             LogAdr += sublength;
             data += sublength;
          } while (length && (currentsegment < context->grouplist[group].nsegments));
       }
+      ecx_pdframeaddmbx(context, group, frames);
    }
+   ecx_pdframeaddreg(context, group, frames);
 
    return wkc;
 }
 
-/** Receive processdata from slaves.
- * Second part from ec_send_processdata().
- * Received datagrams are recombined with the processdata with help from the stack.
- * If a datagram contains input processdata it copies it to the processdata structure.
+/** Release a frame template, its indexes are free again.
  * @param[in]  context        context struct
- * @param[in]  group          group number
- * @param[in]  timeout        Timeout in us.
- * @return Work counter.
+ * @param[in]  pdtemplate     frame template
  */
-int ecx_receive_processdata_group(ecx_contextt *context, uint8 group, int timeout)
+static void ecx_releasepdtemplate(ecx_contextt *context, ec_pdtemplateT *pdtemplate)
 {
-   uint8 idx;
-   int pos;
-   int wkc = 0, wkc2;
-   uint16 le_wkc = 0;
-   int valid_wkc = 0;
-   int64 le_DCtime;
-   ec_idxstackT *idxstack;
-   ec_bufT *rxbuf;
-
-   /* just to prevent compiler warning for unused group */
-   wkc2 = group;
+   int i;
 
-   idxstack = &context->idxstack;
-   rxbuf = context->port.rxbuf;
-   /* get first index */
-   pos = ecx_pullindex(context);
-   /* read the same number of frames as send */
-   while (pos >= 0)
+   if (pdtemplate->valid)
    {
-      idx = idxstack->idx[pos];
-      wkc2 = ecx_waitinframe(&context->port, idx, timeout);
-      /* check if there is input data in frame */
-      if (wkc2 > EC_NOFRAME)
+      osal_mutex_lock(context->pdmutex);
+      for (i = 0; i < pdtemplate->frames; i++)
       {
-         if ((rxbuf[idx][EC_CMDOFFSET] == EC_CMD_LRD) || (rxbuf[idx][EC_CMDOFFSET] == EC_CMD_LRW))
-         {
-            if (idxstack->dcoffset[pos] > 0)
-            {
-               memcpy(idxstack->data[pos], &(rxbuf[idx][EC_HEADERSIZE]), idxstack->length[pos]);
-               memcpy(&le_wkc, &(rxbuf[idx][EC_HEADERSIZE + idxstack->length[pos]]), EC_WKCSIZE);
-               wkc = etohs(le_wkc);
-               memcpy(&le_DCtime, &(rxbuf[idx][idxstack->dcoffset[pos]]), sizeof(le_DCtime));
-               context->DCtime = etohll(le_DCtime);
-            }
-            else
-            {
-               /* copy input data back to process data buffer */
-               memcpy(idxstack->data[pos], &(rxbuf[idx][EC_HEADERSIZE]), idxstack->length[pos]);
-               wkc += wkc2;
-            }
-            valid_wkc = 1;
-         }
-         else if (rxbuf[idx][EC_CMDOFFSET] == EC_CMD_LWR)
-         {
-            if (idxstack->dcoffset[pos] > 0)
-            {
-               memcpy(&le_wkc, &(rxbuf[idx][EC_HEADERSIZE + idxstack->length[pos]]), EC_WKCSIZE);
-               /* output WKC counts 2 times when using LRW, emulate the same for LWR */
-               wkc = etohs(le_wkc) * 2;
-               memcpy(&le_DCtime, &(rxbuf[idx][idxstack->dcoffset[pos]]), sizeof(le_DCtime));
-               context->DCtime = etohll(le_DCtime);
-            }
-            else
-            {
-               /* output WKC counts 2 times when using LRW, emulate the same for LWR */
-               wkc += wkc2 * 2;
-            }
-            valid_wkc = 1;
-         }
+         context->pdreserved[pdtemplate->idx[i]] = FALSE;
+         ecx_setbufstat(&context->port, pdtemplate->idx[i], EC_BUF_EMPTY);
       }
-      /* release buffer */
-      ecx_setbufstat(&context->port, idx, EC_BUF_EMPTY);
-      /* get next index */
-      pos = ecx_pullindex(context);
+      osal_mutex_unlock(context->pdmutex);
    }
+   pdtemplate->valid = FALSE;
+   pdtemplate->frames = 0;
+   pdtemplate->datagrams = 0;
+   pdtemplate->stack.pushed = 0;
+}
 
-   ecx_clearindex(context);
+/** Release the frame templates of cyclic processdata of all groups. The
+ * next cycle builds its frames from scratch and keeps them as new template.
+ * Called when the mapping of the groups or the DC configuration changes.
+ * @param[in]  context        context struct
+ */
+void ecx_clearpdtemplate(ecx_contextt *context)
+{
+   int group;
 
-   /* if no frames has arrived */
-   if (valid_wkc == 0)
+   for (group = 0; group < EC_MAXGROUP; group++)
    {
-      return EC_NOFRAME;
+      ecx_releasepdtemplate(context, &context->grouplist[group].pdtemplate);
    }
-   return wkc;
 }
 
-/**
- * Send processdata to slaves.
- * Group number is zero (default).
+/** Subscribe to a register read with the processdata of a group. Every
+ * divider cycles the register is read by an FPRD added to the processdata
+ * frames, or a BRD of all slaves if slave is 0, and copied to data when the
+ * frames are received. This replaces polling from another thread, which
+ * takes frame indexes and a round trip for each read. The first read is in
+ * the next cycle. Cycles with a read are built without the frame template,
+ * see ecx_send_processdata_group(). Subscribe and unsubscribe before the
+ * group is exchanged or in the thread exchanging it.
  * @param[in]  context        context struct
- * @return Work counter.
+ * @param[in]  group          group number
+ * @param[in]  slave          slave number, 0 for all slaves
+ * @param[in]  ADO            register address
+ * @param[in]  length         register length in bytes
+ * @param[in]  divider        read every divider cycles, 1 for every cycle
+ * @param[out] data           buffer of length bytes the register is copied to
+ * @return Subscription number in ec_groupt.regsub, -1 if none is free or
+ * the parameters are invalid.
  */
-int ecx_send_processdata(ecx_contextt *context)
+int ecx_regsubscribe(ecx_contextt *context, uint8 group, uint16 slave, uint16 ADO, uint16 length, uint16 divider, void *data)
 {
-   return ecx_send_processdata_group(context, 0);
+   ec_regsubT *regsub;
+   int i;
+
+   if ((group >= EC_MAXGROUP) || (slave > context->slavecount) || (length == 0) ||
+       (length > EC_MAXLRWDATA) || (divider == 0) || (data == NULL))
+   {
+      return -1;
+   }
+   for (i = 0; i < EC_MAXREGSUB; i++)
+   {
+      regsub = &(context->grouplist[group].regsub[i]);
+      if (!regsub->active)
+      {
+         regsub->slave = slave;
+         regsub->ADO = ADO;
+         regsub->length = length;
+         regsub->divider = divider;
+         regsub->data = data;
+         regsub->wkc = EC_NOFRAME;
+         regsub->updates = 0;
+         regsub->next = 0;
+         regsub->due = FALSE;
+         regsub->active = TRUE;
+         return i;
+      }
+   }
+
+   return -1;
 }
 
-/**
- * Receive processdata from slaves.
- * Group number is zero (default).
+/** End a register subscription. A read still on the wire is not copied.
  * @param[in]  context        context struct
- * @param[in]  timeout        Timeout in us.
- * @return Work counter.
+ * @param[in]  group          group number
+ * @param[in]  sub            subscription number from ecx_regsubscribe()
+ * @return 1 if unsubscribed, 0 if not subscribed.
  */
-int ecx_receive_processdata(ecx_contextt *context, int timeout)
+int ecx_regunsubscribe(ecx_contextt *context, uint8 group, int sub)
 {
-   return ecx_receive_processdata_group(context, 0, timeout);
+   if ((group >= EC_MAXGROUP) || (sub < 0) || (sub >= EC_MAXREGSUB) ||
+       !context->grouplist[group].regsub[sub].active)
+   {
+      return 0;
+   }
+   context->grouplist[group].regsub[sub].active = FALSE;
+
+   return 1;
+}
+
+/** Keep the frames just built as template for the following cycles. Their
+ * indexes stay reserved.
+ * @param[in]  context        context struct
+ * @param[in]  frames         processdata frames of the cycle
+ * @param[in]  groupmask      groups of the frames
+ * @param[in]  pushed         number of index stack entries of the cycle
+ */
+static void ecx_keeppdtemplate(ecx_contextt *context, ec_pdframesT *frames, uint32 groupmask, int pushed)
+{
+   ec_pdtemplateT *pdtemplate = frames->record;
+   ec_idxstackT *idxstack = frames->stack;
+   int i, pos, reserved;
+
+   if (frames->incomplete || (pushed != pdtemplate->datagrams))
+   {
+      return;
+   }
+   /* leave enough indexes for mailbox and other traffic, templates of other
+      groups may be kept at the same time */
+   osal_mutex_lock(context->pdmutex);
+   reserved = 0;
+   for (i = 0; i < EC_MAXBUF; i++)
+   {
+      if (context->pdreserved[i])
+      {
+         reserved++;
+      }
+   }
+   if ((reserved + frames->cnt) > (EC_MAXBUF / 2))
+   {
+      osal_mutex_unlock(context->pdmutex);
+      return;
+   }
+   for (i = 0; i < frames->cnt; i++)
+   {
+      context->pdreserved[frames->idxlist[i]] = TRUE;
+   }
+   osal_mutex_unlock(context->pdmutex);
+   pdtemplate->groupmask = groupmask;
+   pdtemplate->frames = (uint8)frames->cnt;
+   for (i = 0; i < frames->cnt; i++)
+   {
+      pdtemplate->idx[i] = frames->idxlist[i];
+   }
+   for (i = 0; i < pushed; i++)
+   {
+      pos = (idxstack->pushed + EC_MAXBUF - pushed + i) % EC_MAXBUF;
+      pdtemplate->stack.idx[i] = idxstack->idx[pos];
+      pdtemplate->stack.data[i] = idxstack->data[pos];
+      pdtemplate->stack.length[i] = idxstack->length[pos];
+      pdtemplate->stack.offset[i] = idxstack->offset[pos];
+      pdtemplate->stack.type[i] = idxstack->type[pos];
+      pdtemplate->stack.skip[i] = idxstack->skip[pos];
+      pdtemplate->stack.group[i] = idxstack->group[pos];
+   }
+   pdtemplate->stack.pushed = (uint8)pushed;
+   pdtemplate->valid = TRUE;
+}
+
+/** Transmit the frames of the template again with current outputs.
+ * @param[in]  context        context struct
+ * @param[in]  pdtemplate     frame template
+ * @param[in]  idxstack       index stack to push the datagrams on
+ * @return >0 if processdata is transmitted.
+ */
+static int ecx_sendpdtemplate(ecx_contextt *context, ec_pdtemplateT *pdtemplate, ec_idxstackT *idxstack)
+{
+   ec_idxstackT *stack = &pdtemplate->stack;
+   uint8 *frame;
+   uint8 group;
+   int i;
+
+   for (group = 0; (group < EC_MAXGROUP) && (group < 32); group++)
+   {
+      if (pdtemplate->groupmask & ((uint32)1 << group))
+      {
+         ecx_clearmbxstatus(context, group);
+         context->grouplist[group].pdcycle++;
+      }
+   }
+   for (i = 0; i < pdtemplate->datagrams; i++)
+   {
+      frame = context->port.txbuf[pdtemplate->dgidx[i]];
+      if (pdtemplate->dgdata[i])
+      {
+         memcpy(&frame[pdtemplate->dgoffset[i]], pdtemplate->dgdata[i], pdtemplate->dglength[i]);
+      }
+      /* set WKC to zero */
+      frame[pdtemplate->dgoffset[i] + pdtemplate->dglength[i]] = 0x00;
+      frame[pdtemplate->dgoffset[i] + pdtemplate->dglength[i] + 1] = 0x00;
+   }
+   for (i = 0; i < stack->pushed; i++)
+   {
+      ecx_pushindex(idxstack, stack->group[i], stack->idx[i], stack->data[i], stack->length[i],
+                    stack->offset[i], stack->type[i], stack->skip[i]);
+   }
+   ecx_markcycle(context, idxstack, stack->pushed);
+   ecx_outframes_red(&context->port, pdtemplate->idx, pdtemplate->frames);
+
+   return 1;
+}
+
+/** Upper bound of the index stack entries of a processdata cycle of a group,
+ * called after ecx_pdregdue() marked the register reads of the cycle.
+ * @param[in]  context        context struct
+ * @param[in]  group          group number
+ * @return Number of datagrams.
+ */
+static int ecx_pdcyclesize(ecx_contextt *context, uint8 group)
+{
+   ec_groupt *grp = &context->grouplist[group];
+   int i, size;
+
+   size = grp->zcframes ? grp->zcframes : grp->nsegments;
+   /* LRD and LWR split at the first input segment */
+   if (grp->blockLRW)
+   {
+      size++;
+   }
+   /* DC time read and bus shift write */
+   if (grp->hasdc)
+   {
+      size += 2;
+   }
+   for (i = 0; i < EC_MAXMBXDG; i++)
+   {
+      if (grp->mbxdg[i].state == EC_MBXDG_QUEUED)
+      {
+         size++;
+      }
+   }
+   for (i = 0; i < EC_MAXREGSUB; i++)
+   {
+      if (grp->regsub[i].active && grp->regsub[i].due)
+      {
+         size++;
+      }
+   }
+
+   return size;
+}
+
+/** Check that a cycle fits on the index stack. In pipelined mode the stack
+ * holds the next cycle while the current one is collected, so a cycle may
+ * use at most half of it.
+ * @param[in]  context        context struct
+ * @param[in]  idxstack       index stack of the cycle
+ * @param[in]  size           upper bound of the datagrams of the cycle
+ * @return TRUE if the cycle can be sent.
+ */
+static boolean ecx_pdcyclefits(ecx_contextt *context, ec_idxstackT *idxstack, int size)
+{
+   if (context->pipelinedMode && (size > (EC_MAXBUF / 2)))
+   {
+      return FALSE;
+   }
+
+   return (idxstack->stacked + size) <= EC_MAXBUF;
+}
+
+/** Build processdata frames of multiple groups and transmit them at once.
+ * The datagrams are pushed on the index stack of the lowest selected group.
+ * Outside pipelined mode the frames are kept as template of that group and
+ * sent again by the following calls for the same groups. A template is
+ * only replaced when two cycles in a row are sent for other groups, so
+ * groups sent at different rates keep the template of the common cycle.
+ * @param[in]  context        context struct
+ * @param[in]  groupmask      bit n set selects group n
+ * @return >0 if processdata is transmitted, EC_ERROR if the cycle does not
+ * fit on the index stack, see ecx_contextt.pipelinedMode.
+ */
+static int ecx_main_send_processdata_groups(ecx_contextt *context, uint32 groupmask)
+{
+   ec_pdtemplateT *pdtemplate;
+   ec_idxstackT *idxstack;
+   ec_pdframesT frames;
+   int wkc = 0, stacked, size;
+   boolean extra;
+   uint8 group, n;
+
+   group = 0;
+   while ((group < EC_MAXGROUP) && (group < 32) && !(groupmask & ((uint32)1 << group)))
+   {
+      group++;
+   }
+   if ((group >= EC_MAXGROUP) || (group >= 32))
+   {
+      return 0;
+   }
+   pdtemplate = &context->grouplist[group].pdtemplate;
+   idxstack = &context->grouplist[group].idxstack;
+   /* pipelined cycles need their own indexes */
+   if (pdtemplate->valid &&
+       (context->pipelinedMode ||
+        ((pdtemplate->groupmask != groupmask) && (pdtemplate->lastmask == groupmask))))
+   {
+      ecx_releasepdtemplate(context, pdtemplate);
+   }
+   pdtemplate->lastmask = groupmask;
+   /* cycles with mailbox datagrams or register reads are built without the
+      template */
+   extra = ecx_pdmbxqueued(context, groupmask);
+   for (n = group; (n < EC_MAXGROUP) && (n < 32); n++)
+   {
+      if ((groupmask & ((uint32)1 << n)) && ecx_pdregdue(context, n))
+      {
+         extra = TRUE;
+      }
+   }
+   if (pdtemplate->valid && (pdtemplate->groupmask == groupmask) && !extra)
+   {
+      if (!ecx_pdcyclefits(context, idxstack, pdtemplate->stack.pushed))
+      {
+         return EC_ERROR;
+      }
+      return ecx_sendpdtemplate(context, pdtemplate, idxstack);
+   }
+   size = 0;
+   for (n = group; (n < EC_MAXGROUP) && (n < 32); n++)
+   {
+      if (groupmask & ((uint32)1 << n))
+      {
+         size += ecx_pdcyclesize(context, n);
+      }
+   }
+   if (!ecx_pdcyclefits(context, idxstack, size))
+   {
+      return EC_ERROR;
+   }
+   idxstack->overflow = FALSE;
+   frames.cnt = 0;
+   frames.open = -1;
+   frames.stack = idxstack;
+   frames.record = NULL;
+   frames.incomplete = FALSE;
+   if (!context->pipelinedMode && !pdtemplate->valid && !extra)
+   {
+      pdtemplate->datagrams = 0;
+      frames.record = pdtemplate;
+   }
+   stacked = idxstack->stacked;
+   for (; (group < EC_MAXGROUP) && (group < 32); group++)
+   {
+      if (groupmask & ((uint32)1 << group))
+      {
+         if (ecx_main_send_processdata(context, group, &frames) > 0)
+         {
+            wkc = 1;
+         }
+      }
+   }
+   ecx_markcycle(context, idxstack, idxstack->stacked - stacked);
+   /* send all frames at once */
+   ecx_flushframes(context, &frames);
+   if (idxstack->overflow)
+   {
+      return EC_ERROR;
+   }
+   if (frames.record && wkc)
+   {
+      ecx_keeppdtemplate(context, &frames, groupmask, idxstack->stacked - stacked);
+   }
+
+   return wkc;
+}
+
+/** Transmit processdata to slaves.
+ *
+ * Uses LRW, or LRD/LWR if LRW is not allowed (blockLRW).
+ *
+ * In overlap mode, outputs are sent in the outgoing frame and inputs
+ * will replace outputs in the incoming frame.
+ *
+ * In non-overlap mode, outputs are followed by extra space for inputs
+ * in the incoming frame.
+ *
+ * The inputs are gathered with the receive processdata function.
+ * In contrast to the base LRW function this function is non-blocking.
+ * If the processdata does not fit in one datagram, multiple are used.
+ * Datagrams are packed into as few frames as possible, a frame is only
+ * started when the next datagram does not fit in the current one.
+ * In order to recombine the slave response, a stack is used.
+ * All frames are built first and then transmitted at once.
+ *
+ * Each group has its own stack, so different groups can be sent and
+ * received from different threads at independent rates without locking,
+ * as long as each group is only used by one thread. Such threads read the
+ * DC time and NIC timestamps of their group from ec_groupt.
+ *
+ * Outside pipelined mode the frames are built once and kept with their
+ * indexes, later cycles only copy the outputs into them. They are built
+ * again after ecx_clearpdtemplate(), which ecx_config_map_group() and
+ * ecx_configdc() call, or when the group was sent together with other
+ * groups.
+ *
+ * In mailbox piggyback mode the mailbox datagrams queued by
+ * ecx_mbxhandler() are added to the frames, as are the register reads
+ * subscribed with ecx_regsubscribe(). A cycle holding them is built
+ * without the template.
+ * @param[in]  context        context struct
+ * @param[in]  group          group number
+ * @return >0 if processdata is transmitted, EC_ERROR if the cycle does not
+ * fit on the index stack, see ecx_contextt.pipelinedMode.
+ */
+int ecx_send_processdata_group(ecx_contextt *context, uint8 group)
+{
+   ec_idxstackT *idxstack = &context->grouplist[group].idxstack;
+   ec_pdframesT frames;
+   int wkc, stacked;
+
+   if (group < 32)
+   {
+      return ecx_main_send_processdata_groups(context, (uint32)1 << group);
+   }
+   /* no template beyond the group mask */
+   ecx_pdregdue(context, group);
+   if (!ecx_pdcyclefits(context, idxstack, ecx_pdcyclesize(context, group)))
+   {
+      return EC_ERROR;
+   }
+   idxstack->overflow = FALSE;
+   frames.cnt = 0;
+   frames.open = -1;
+   frames.stack = idxstack;
+   frames.record = NULL;
+   frames.incomplete = FALSE;
+   stacked = idxstack->stacked;
+   wkc = ecx_main_send_processdata(context, group, &frames);
+   ecx_markcycle(context, idxstack, idxstack->stacked - stacked);
+   /* send all frames of the group at once */
+   ecx_flushframes(context, &frames);
+   if (idxstack->overflow)
+   {
+      return EC_ERROR;
+   }
+
+   return wkc;
+}
+
+/** Transmit processdata of multiple groups to slaves.
+ *
+ * Frames of all selected groups are built first and then transmitted at once,
+ * see ecx_send_processdata_group(). Datagrams of different groups share
+ * frames when they fit. All groups use the index stack of the lowest
+ * selected group, so the inputs of all of them are collected by
+ * ecx_receive_processdata_group() for that group.
+ * @param[in]  context        context struct
+ * @param[in]  groupmask      bit n set selects group n
+ * @return >0 if processdata is transmitted, EC_ERROR if the cycle does not
+ * fit on the index stack, see ecx_contextt.pipelinedMode.
+ */
+int ecx_send_processdata_groups(ecx_contextt *context, uint32 groupmask)
+{
+   return ecx_main_send_processdata_groups(context, groupmask);
+}
+
+/** Groups due in a scheduler tick. A group is due when its divider is set
+ * and tick % divider equals its phase.
+ * @param[in]  context        context struct
+ * @param[in]  tick           scheduler tick
+ * @return Due groups, bit n set is group n.
+ */
+uint32 ecx_duegroups(ecx_contextt *context, uint32 tick)
+{
+   ec_groupt *grp;
+   uint32 groupmask = 0;
+   uint8 group;
+
+   for (group = 0; (group < EC_MAXGROUP) && (group < 32); group++)
+   {
+      grp = &context->grouplist[group];
+      if (grp->divider && ((tick % grp->divider) == (uint32)(grp->phase % grp->divider)))
+      {
+         groupmask |= (uint32)1 << group;
+      }
+   }
+
+   return groupmask;
+}
+
+/** Transmit processdata of the groups due in the next scheduler tick.
+ *
+ * Multi-rate alternative to ecx_send_processdata_group(). A group with a
+ * divider is sent every divider ticks, in the ticks given by its phase.
+ * F.e. servo drives in group 0 with divider 1 and slow IO in group 1 with
+ * divider 8 and phase 3. The due groups share frames, see
+ * ecx_send_processdata_groups(), so a tick only carries the datagrams of
+ * its groups. Groups without divider are not sent. The inputs are
+ * collected by ecx_receive_processdata_tick(). Not for pipelined mode.
+ * @param[in]  context        context struct
+ * @return >0 if processdata is transmitted, 0 if no group is due, EC_ERROR
+ * if the cycle does not fit on the index stack.
+ */
+int ecx_send_processdata_tick(ecx_contextt *context)
+{
+   context->schedmask = ecx_duegroups(context, context->schedtick++);
+   if (!context->schedmask)
+   {
+      return 0;
+   }
+
+   return ecx_send_processdata_groups(context, context->schedmask);
+}
+
+/** Receive processdata of the groups sent in the last scheduler tick.
+ * The work counter of each of these groups is stored in ec_groupt.lastwkc,
+ * the other groups keep the one of their last tick.
+ *
+ * The due groups share the index stack of the lowest of them, so the
+ * returned work counter is the sum over all groups of the tick. A sum can
+ * hide a fault, f.e. a missing slave in one group and a double counted
+ * mailbox status in another. Check ec_groupt.lastwkc of each due group
+ * against its own expected work counter, outputsWKC * 2 + inputsWKC.
+ * @param[in]  context        context struct
+ * @param[in]  timeout        Timeout in us.
+ * @return Work counter of all groups of the tick, 0 if no group was due,
+ * EC_NOFRAME if no frame of one of the due groups with processdata arrived.
+ */
+int ecx_receive_processdata_tick(ecx_contextt *context, int timeout)
+{
+   ec_groupt *grp;
+   uint8 group;
+   int wkc = 0;
+   boolean received = FALSE;
+
+   for (group = 0; (group < EC_MAXGROUP) && (group < 32); group++)
+   {
+      if (context->schedmask & ((uint32)1 << group))
+      {
+         if (!received)
+         {
+            wkc = ecx_receive_processdata_group(context, group, timeout);
+            received = TRUE;
+         }
+         grp = &context->grouplist[group];
+         if ((grp->Obytes || grp->Ibytes) && (grp->lastwkc == EC_NOFRAME))
+         {
+            wkc = EC_NOFRAME;
+         }
+      }
+   }
+
+   return wkc;
+}
+
+/** Keep the cycle of a received mailbox status of a group, see
+ * ecx_mbxinhandler().
+ * @param[in]  context        context struct
+ * @param[in]  idxstack       index stack of the group
+ * @param[in]  pos            stack entry of the LRD or LRW datagram
+ * @param[in]  data           processdata the datagram is copied to
+ */
+static void ecx_pdmbxstatus(ecx_contextt *context, ec_idxstackT *idxstack, int pos, const uint8 *data)
+{
+   ec_groupt *grp = &context->grouplist[idxstack->group[pos]];
+
+   if (grp->mbxstatuslength && (grp->mbxstatus >= data) &&
+       (grp->mbxstatus < (data + idxstack->length[pos])))
+   {
+      grp->mbxstatuscycle = idxstack->cycle[pos];
+   }
+}
+
+/** Complete a register read or mailbox datagram sent with the processdata,
+ * called when the frame holding it is received or lost.
+ * @param[in]  context        context struct
+ * @param[in]  idxstack       index stack of the group
+ * @param[in]  pos            stack entry of the datagram
+ * @param[in]  data           datagram data in rx frame, NULL if lost
+ * @param[in]  wkc            work counter of the datagram
+ */
+static void ecx_pddatagramdone(ecx_contextt *context, ec_idxstackT *idxstack, int pos, const uint8 *data, int wkc)
+{
+   ec_regsubT *regsub = context->grouplist[idxstack->group[pos]].regsub;
+   uint8 com = idxstack->type[pos];
+   int i;
+
+   /* the DC time write of bus shift mode has no data */
+   if (((com != EC_CMD_BRD) && (com != EC_CMD_FPRD) && (com != EC_CMD_FPWR)) ||
+       !idxstack->data[pos])
+   {
+      return;
+   }
+   for (i = 0; i < EC_MAXREGSUB; i++)
+   {
+      if (idxstack->data[pos] == &regsub[i])
+      {
+         /* not copied if unsubscribed meanwhile */
+         if (regsub[i].active && (regsub[i].length == idxstack->length[pos]))
+         {
+            regsub[i].wkc = data ? wkc : EC_NOFRAME;
+            if (data && (wkc > 0))
+            {
+               memcpy(regsub[i].data, data, regsub[i].length);
+               regsub[i].updates++;
+            }
+         }
+         return;
+      }
+   }
+   ecx_mbxdgdone(context, (ec_mbxdgT *)idxstack->data[pos], data, wkc, idxstack->cycle[pos]);
+}
+
+/** Copy the datagrams of a received frame to the processdata and release
+ * the frame buffer.
+ * @param[in]  context        context struct
+ * @param[in]  idxstack       index stack of the group
+ * @param[in]  n              entry of the first datagram of the frame,
+ *                            counted from the oldest entry on the stack
+ * @param[in]  cnt            number of entries of the cycle
+ * @param[in]  wkc2           work counter of the frame, EC_NOFRAME if lost
+ * @return Entry after the last datagram of the frame.
+ */
+static int ecx_collectframe(ecx_contextt *context, ec_idxstackT *idxstack, int n, int cnt, int wkc2)
+{
+   ec_bufT *rxbuf = context->port.rxbuf;
+   uint16 le_wkc = 0;
+   int64 le_DCtime;
+   uint16 offset, length, skip;
+   ec_timet txtime, rxtime;
+   uint8 idx;
+   int pos;
+
+   pos = (idxstack->pulled + n) % EC_MAXBUF;
+   idx = idxstack->idx[pos];
+   if ((wkc2 > EC_NOFRAME) && (idxstack->collected++ == 0))
+   {
+      memset(&idxstack->txtime, 0, sizeof(idxstack->txtime));
+      memset(&idxstack->rxtime, 0, sizeof(idxstack->rxtime));
+   }
+   /* datagrams of one frame are consecutive on the stack */
+   do
+   {
+      /* check if there is input data in datagram */
+      if (wkc2 > EC_NOFRAME)
+      {
+         offset = idxstack->offset[pos];
+         length = idxstack->length[pos];
+         memcpy(&le_wkc, &(rxbuf[idx][offset + length]), EC_WKCSIZE);
+         switch (rxbuf[idx][offset - EC_HEADERSIZE + EC_CMDOFFSET])
+         {
+         case EC_CMD_LRD:
+         case EC_CMD_LRW:
+            /* copy input data back to process data buffer, zero copy
+               groups have their inputs in the rx frame already */
+            skip = idxstack->skip[pos];
+            if (idxstack->data[pos])
+            {
+               memcpy((uint8 *)idxstack->data[pos] + skip, &(rxbuf[idx][offset + skip]), length - skip);
+            }
+            ecx_pdmbxstatus(context, idxstack, pos, idxstack->data[pos] ? (uint8 *)idxstack->data[pos] : &(rxbuf[idx][offset]));
+            idxstack->wkc += etohs(le_wkc);
+            idxstack->validwkc = TRUE;
+            idxstack->groupwkc[idxstack->group[pos]] += etohs(le_wkc);
+            idxstack->groupvalidwkc[idxstack->group[pos]] = TRUE;
+            break;
+         case EC_CMD_LWR:
+            /* output WKC counts 2 times when using LRW, emulate the same for LWR */
+            idxstack->wkc += etohs(le_wkc) * 2;
+            idxstack->validwkc = TRUE;
+            idxstack->groupwkc[idxstack->group[pos]] += etohs(le_wkc) * 2;
+            idxstack->groupvalidwkc[idxstack->group[pos]] = TRUE;
+            break;
+         case EC_CMD_FRMW:
+            memcpy(&le_DCtime, &(rxbuf[idx][offset]), sizeof(le_DCtime));
+            context->grouplist[idxstack->group[pos]].DCtime = etohll(le_DCtime);
+            context->DCtime = context->grouplist[idxstack->group[pos]].DCtime;
+            break;
+         case EC_CMD_BRD:
+         case EC_CMD_FPRD:
+         case EC_CMD_FPWR:
+            ecx_pddatagramdone(context, idxstack, pos, &(rxbuf[idx][offset]), etohs(le_wkc));
+            break;
+         default:
+            break;
+         }
+      }
+      else
+      {
+         ecx_pddatagramdone(context, idxstack, pos, NULL, 0);
+      }
+      idxstack->done[pos] = TRUE;
+      n++;
+      pos = (idxstack->pulled + n) % EC_MAXBUF;
+   } while ((n < cnt) && (idxstack->idx[pos] == idx));
+   /* keep send time of first and receive time of last frame */
+   if ((wkc2 > EC_NOFRAME) && ecx_getframetime(&context->port, idx, &txtime, &rxtime))
+   {
+      if (!osal_timespecisset(&idxstack->txtime) ||
+          osal_timespeccmp(&txtime, &idxstack->txtime, <))
+      {
+         idxstack->txtime = txtime;
+      }
+      if (osal_timespeccmp(&rxtime, &idxstack->rxtime, >))
+      {
+         idxstack->rxtime = rxtime;
+      }
+   }
+   /* release buffer, a template or zero copy group keeps its index */
+   ecx_setbufstat(&context->port, idx, context->pdreserved[idx] ? EC_BUF_ALLOC : EC_BUF_EMPTY);
+
+   return n;
+}
+
+/** Remove a completely collected cycle from the stack.
+ * @param[in]  context        context struct
+ * @param[in]  idxstack       index stack of the group
+ * @param[in]  cnt            number of entries of the cycle
+ * @return Work counter of the cycle, EC_NOFRAME if no frame has arrived.
+ */
+static int ecx_endcycle(ecx_contextt *context, ec_idxstackT *idxstack, int cnt)
+{
+   int wkc, n;
+   uint8 group;
+
+   wkc = idxstack->validwkc ? idxstack->wkc : EC_NOFRAME;
+   if (!idxstack->collected)
+   {
+      memset(&idxstack->txtime, 0, sizeof(idxstack->txtime));
+      memset(&idxstack->rxtime, 0, sizeof(idxstack->rxtime));
+   }
+   for (n = 0; n < cnt; n++)
+   {
+      group = idxstack->group[(idxstack->pulled + n) % EC_MAXBUF];
+      context->grouplist[group].lastwkc = idxstack->groupvalidwkc[group] ? idxstack->groupwkc[group] : EC_NOFRAME;
+      context->grouplist[group].pdtxtime = idxstack->txtime;
+      context->grouplist[group].pdrxtime = idxstack->rxtime;
+   }
+   memset(idxstack->groupwkc, 0, sizeof(idxstack->groupwkc));
+   memset(idxstack->groupvalidwkc, 0, sizeof(idxstack->groupvalidwkc));
+   context->pdtxtime = idxstack->txtime;
+   context->pdrxtime = idxstack->rxtime;
+   idxstack->wkc = 0;
+   idxstack->validwkc = FALSE;
+   idxstack->collected = 0;
+   ecx_pullindex(idxstack, cnt);
+   /* in pipelined mode the next cycle stays on the stack */
+   if (!context->pipelinedMode)
+   {
+      ecx_clearindex(idxstack);
+   }
+
+   return wkc;
+}
+
+/** Receive processdata from slaves.
+ * Second part from ec_send_processdata().
+ * Received datagrams are recombined with the processdata with help from the stack.
+ * If a datagram contains input processdata it copies it to the processdata structure.
+ * In pipelined mode only the frames of the oldest transmitted cycle are
+ * collected, the frames of the next cycle may already be on the wire.
+ * Frames already collected by ecx_poll_processdata_group() are not waited
+ * for again.
+ * @param[in]  context        context struct
+ * @param[in]  group          group number
+ * @param[in]  timeout        Timeout in us.
+ * @return Work counter.
+ */
+int ecx_receive_processdata_group(ecx_contextt *context, uint8 group, int timeout)
+{
+   ec_idxstackT *idxstack = &context->grouplist[group].idxstack;
+   int n, cnt, pos;
+   int wkc2;
+
+   cnt = ecx_cyclelength(context, idxstack);
+   /* read the same number of frames as send */
+   n = 0;
+   while (n < cnt)
+   {
+      pos = (idxstack->pulled + n) % EC_MAXBUF;
+      if (idxstack->done[pos])
+      {
+         n++;
+      }
+      else
+      {
+         wkc2 = ecx_waitinframe(&context->port, idxstack->idx[pos], timeout);
+         n = ecx_collectframe(context, idxstack, n, cnt, wkc2);
+      }
+   }
+
+   return ecx_endcycle(context, idxstack, cnt);
+}
+
+/** Non blocking receive of processdata from slaves.
+ * Alternative to ecx_receive_processdata_group() for applications with
+ * their own event loop. Collects the frames of the cycle that have arrived
+ * so far and copies their inputs to the processdata structure, then
+ * returns without waiting. Call it again when the socket of the port,
+ * ecx_portt.sockhandle, becomes readable, until no frame is pending. A
+ * cycle that does not complete in time is finished by
+ * ecx_receive_processdata_group() with a timeout. In redundant mode frames
+ * are only collected by ecx_receive_processdata_group().
+ * @param[in]  context        context struct
+ * @param[in]  group          group number
+ * @param[out] wkc            Work counter of the cycle when it is complete,
+ *                            EC_NOFRAME if no frame has arrived.
+ * @return Number of frames of the cycle still pending, 0 when the cycle is
+ * complete.
+ */
+int ecx_poll_processdata_group(ecx_contextt *context, uint8 group, int *wkc)
+{
+   ec_idxstackT *idxstack = &context->grouplist[group].idxstack;
+   int n, cnt, pos, pending;
+   int wkc2;
+   uint8 idx;
+
+   cnt = ecx_cyclelength(context, idxstack);
+   pending = 0;
+   n = 0;
+   while (n < cnt)
+   {
+      pos = (idxstack->pulled + n) % EC_MAXBUF;
+      idx = idxstack->idx[pos];
+      if (idxstack->done[pos])
+      {
+         n++;
+      }
+      else if ((wkc2 = ecx_pollinframe(&context->port, idx)) > EC_NOFRAME)
+      {
+         n = ecx_collectframe(context, idxstack, n, cnt, wkc2);
+      }
+      else
+      {
+         /* skip the other datagrams of the frame */
+         pending++;
+         do
+         {
+            n++;
+            pos = (idxstack->pulled + n) % EC_MAXBUF;
+         } while ((n < cnt) && (idxstack->idx[pos] == idx));
+      }
+   }
+   if (!pending)
+   {
+      *wkc = ecx_endcycle(context, idxstack, cnt);
+   }
+
+   return pending;
+}
+
+/**
+ * Send processdata to slaves.
+ * Group number is zero (default).
+ * @param[in]  context        context struct
+ * @return Work counter.
+ */
+int ecx_send_processdata(ecx_contextt *context)
+{
+   return ecx_send_processdata_group(context, 0);
+}
+
+/**
+ * Receive processdata from slaves.
+ * Group number is zero (default).
+ * @param[in]  context        context struct
+ * @param[in]  timeout        Timeout in us.
+ * @return Work counter.
+ */
+int ecx_receive_processdata(ecx_contextt *context, int timeout)
+{
+   return ecx_receive_processdata_group(context, 0, timeout);
+}
+
+/**
+ * Non blocking receive of processdata from slaves.
+ * Group number is zero (default).
+ * @param[in]  context        context struct
+ * @param[out] wkc            Work counter of the cycle when it is complete.
+ * @return Number of frames of the cycle still pending.
+ */
+int ecx_poll_processdata(ecx_contextt *context, int *wkc)
+{
+   return ecx_poll_processdata_group(context, 0, wkc);
 }